@@ -0,0 +1,472 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+/*
+ * Offline benchmark of the hot paths of the plugin, without a TeamSpeak client or Guild Wars 2.
+ *
+ * Usage: gw2_bench [fixtures directory] [Mumble Link capture]
+ *
+ * The fixtures directory holds API responses as they are returned by the server: maps.json, optionally world_names.json,
+ * and map_floor_<continent>_<floor>.json for the floors that should be searched for waypoints.
+ * It defaults to bench\fixtures (the working directory when started from Visual Studio is the bench directory), which has
+ * a small set of made-up responses for two maps and session.mumblelink, a recorded walk across both of them.
+ * Without a capture argument, session.mumblelink of the fixtures directory is used if there is one.
+ * WaypointTracker only keeps results of maps whose floors are all there, with missing ones every update is a full search.
+ * The capture is either a recording made with "/gw2 record" (see MumbleLink::Recorder) or a sequence of raw LinkedMem structs;
+ * without one, a character running in circles on the first map that has floor data is simulated.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include "public_errors.h"
+#include "gw2api/batchtransform.h"
+#include "gw2api/gw2api.h"
+#include "gw2api/metrics.h"
+#include "gw2api/mumblelink.h"
+#include "gw2api/mumblelinkrecorder.h"
+#include "commands.h"
+#include "deadreckoning.h"
+#include "globals.h"
+#include "gw2info.h"
+#include "gw2infocodec.h"
+#include "gw2mathutils.h"
+#include "proximityindex.h"
+#include "stringutils.h"
+using namespace std;
+using namespace Gw2Api;
+
+namespace {
+
+	const size_t simulatedFrameCount = 10000;
+	const size_t remoteFrameCount = 200; // Deltas applied per client in the container benchmarks
+	const int clientCounts[] = { 10, 100, 1000 };
+	const size_t trailLength = 256; // Points per trail in the batch conversion benchmark
+	const uint64 serverConnectionHandlerID = 1;
+	const char* const defaultFixtures = "fixtures";
+
+	/* Collects the duration of every single operation and reports the throughput and latency distribution */
+	class Benchmark {
+	public:
+		Benchmark(const string& name) : name(name), start(0) { }
+
+		void begin() { start = Gw2Api::Metrics::now(); }
+		void end() { samples.push_back(Gw2Api::Metrics::elapsedMilliseconds(start, Gw2Api::Metrics::now()) * 1000); }
+
+		void report() {
+			if (samples.empty()) {
+				printf("%-52s %10s\n", name.c_str(), "skipped");
+				return;
+			}
+			sort(samples.begin(), samples.end());
+			double total = 0;
+			for (size_t i = 0; i < samples.size(); i++)
+				total += samples[i];
+			printf("%-52s %10u %14.0f %10.3f %10.3f %10.3f %10.3f\n", name.c_str(), (unsigned)samples.size(),
+				total > 0 ? samples.size() / (total / 1000000) : 0.0, total / samples.size(),
+				getPercentile(0.5), getPercentile(0.99), samples.back());
+		}
+
+	private:
+		double getPercentile(double percentile) const {
+			size_t index = (size_t)(percentile * samples.size());
+			return samples[index < samples.size() ? index : samples.size() - 1];
+		}
+
+		string name;
+		LONGLONG start;
+		vector<double> samples; // In microseconds
+	};
+
+	/* Stand-ins for the TeamSpeak functions Commands uses */
+	char benchPluginID[] = "gw2_bench";
+	size_t sentCommandBytes = 0;
+
+	unsigned int benchGetClientID(uint64 serverConnectionHandlerID, anyID* result) {
+		*result = 1;
+		return ERROR_ok;
+	}
+
+	void benchSendPluginCommand(uint64 serverConnectionHandlerID, const char* pluginID, const char* command, int targetMode, const anyID* targetIDs, const char* returnCode) {
+		sentCommandBytes += strlen(command);
+	}
+
+	bool readFile(const string& path, string* contents) {
+		ifstream file(path.c_str(), ios::in | ios::binary);
+		if (!file)
+			return false;
+		ostringstream stream;
+		stream << file.rdbuf();
+		*contents = stream.str();
+		return true;
+	}
+
+	template<class T, class P>
+	bool loadFixture(const string& path, const Requests::ApiRequest& request, std::shared_ptr<const T>* response) {
+		string body;
+		if (!readFile(path, &body))
+			return false;
+		P parser;
+		if (!parseResponse(request, parser, body, time(NULL), response)) {
+			printf("Could not parse %s\n", path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/* Loads every map_floor_<continent>_<floor>.json in the directory into the cache */
+	size_t loadMapFloorFixtures(const string& directory) {
+		size_t count = 0;
+		WIN32_FIND_DATAA findData;
+		HANDLE hFind = FindFirstFileA((directory + "\\map_floor_*.json").c_str(), &findData);
+		if (hFind == INVALID_HANDLE_VALUE)
+			return 0;
+		do {
+			int continent_id, floor;
+			if (sscanf_s(findData.cFileName, "map_floor_%d_%d.json", &continent_id, &floor) != 2)
+				continue;
+			MapFloorRootEntryPtr mapFloorRoot;
+			if (loadFixture<MapFloorRootEntry, Parsers::MapFloorRootParser>(directory + "\\" + findData.cFileName,
+				Requests::MapFloorRequest(continent_id, floor), &mapFloorRoot))
+				count++;
+		} while (FindNextFileA(hFind, &findData));
+		FindClose(hFind);
+		return count;
+	}
+
+	bool loadCapture(const string& path, vector<MumbleLink::LinkedMem>* frames) {
+		MumbleLink::Replayer replayer;
+		if (replayer.open(path)) {
+			while (replayer.next())
+				frames->push_back(*replayer.getMemory());
+			return !frames->empty();
+		}
+
+		string contents;
+		if (!readFile(path, &contents) || contents.size() < sizeof(MumbleLink::LinkedMem))
+			return false;
+		frames->resize(contents.size() / sizeof(MumbleLink::LinkedMem));
+		memcpy(&(*frames)[0], contents.data(), frames->size() * sizeof(MumbleLink::LinkedMem));
+		return true;
+	}
+
+	void copyWide(const string& source, wchar_t* destination, size_t size) {
+		size_t i = 0;
+		for (; i < source.size() && i < size - 1; i++)
+			destination[i] = (wchar_t)(unsigned char)source[i];
+		destination[i] = 0;
+	}
+
+	/* 60 frames per second of a character running in a circle with a radius of 100 meters around the center of the map */
+	void simulateFrames(int map_id, vector<MumbleLink::LinkedMem>* frames) {
+		frames->resize(simulatedFrameCount);
+		string identity = "{\"name\":\"Bench Character\",\"profession\":1,\"map_id\":" + to_string(map_id) +
+			",\"world_id\":1001,\"team_color_id\":0,\"commander\":false}";
+		for (size_t i = 0; i < frames->size(); i++) {
+			MumbleLink::LinkedMem& frame = (*frames)[i];
+			memset(&frame, 0, sizeof(frame));
+			frame.uiVersion = 2;
+			frame.uiTick = (uint32_t)i + 1;
+			double angle = i * 0.005;
+			frame.fAvatarPosition[0] = (float)(100 * cos(angle));
+			frame.fAvatarPosition[2] = (float)(100 * sin(angle));
+			copyWide("Guild Wars 2", frame.name, 256);
+			copyWide(identity, frame.identity, 256);
+		}
+	}
+
+	/* Picks the first map of which at least one floor is in the cache */
+	int findSimulatedMap(const MapsRootEntryPtr& maps) {
+		for (MapEntries::const_iterator it = maps->maps.begin(); it != maps->maps.end(); it++) {
+			for (size_t i = 0; i < it->second.floors.size(); i++) {
+				MapFloorRootEntryPtr mapFloorRoot;
+				if (getCachedMapFloor(it->second.continent_id, it->second.floors[i], &mapFloorRoot))
+					return it->first;
+			}
+		}
+		return maps->maps.empty() ? 0 : maps->maps.begin()->first;
+	}
+
+}
+
+
+int main(int argc, char* argv[]) {
+	string fixtures = argc >= 2 ? argv[1] : defaultFixtures;
+
+	MapsRootEntryPtr maps;
+	if (!loadFixture<MapsRootEntry, Parsers::MapsRootParser>(fixtures + "\\maps.json", Requests::MapsRequest(), &maps)) {
+		printf("Could not load %s\\maps.json\n", fixtures.c_str());
+		printf("Usage: %s [fixtures directory] [Mumble Link capture]\n", argv[0]);
+		return 1;
+	}
+	WorldNamesRootEntryPtr worldNames;
+	loadFixture<WorldNamesRootEntry, Parsers::WorldNamesRootParser>(fixtures + "\\world_names.json", Requests::WorldNamesRequest(), &worldNames);
+	size_t floorCount = loadMapFloorFixtures(fixtures);
+
+	vector<MumbleLink::LinkedMem> frames;
+	if (argc >= 3) {
+		if (!loadCapture(argv[2], &frames)) {
+			printf("Could not load the capture %s\n", argv[2]);
+			return 1;
+		}
+	} else if (!loadCapture(fixtures + "\\session.mumblelink", &frames)) {
+		simulateFrames(findSimulatedMap(maps), &frames);
+	}
+	printf("%u maps, %u floors, %u frames\n\n", (unsigned)maps->maps.size(), (unsigned)floorCount, (unsigned)frames.size());
+
+	Globals::pluginID = benchPluginID;
+	Globals::ts3Functions.getClientID = benchGetClientID;
+	Globals::ts3Functions.sendPluginCommand = benchSendPluginCommand;
+
+	Benchmark identityDecode("identity decode");
+	Benchmark positionConversion("MapTransform::toContinentPosition");
+	Benchmark waypointSearch("getClosestWaypoint");
+	Benchmark waypointTracking("WaypointTracker::update");
+	Benchmark toJson("Gw2Info::toJson");
+	Benchmark fromJson("Gw2Info parse");
+	Benchmark encode("Gw2InfoCodec delta encode");
+	Benchmark publish("Commands::publishGW2Info");
+
+	// The local pipeline, frame by frame like the Mumble Link loop
+	MumbleLink::LinkedMem link;
+	MumbleLink::initLink(&link);
+	vector<Gw2Info> infos;
+	infos.reserve(frames.size());
+	vector<string> packed;
+	packed.reserve(frames.size());
+	VelocityEstimator velocity;
+	Gw2InfoCodec::Encoder encoder;
+	WaypointTracker waypointTracker;
+	size_t trackerMismatches = 0;
+	vector<Commands::PublishTarget> targets(1);
+	targets[0].serverConnectionHandlerID = serverConnectionHandlerID;
+	targets[0].compact = true;
+	int trailMapId = 0;
+	Rect trailMapRect;
+	Rect trailContinentRect;
+	vector<float> trailX;
+	vector<float> trailZ;
+	for (size_t i = 0; i < frames.size(); i++) {
+		link = frames[i];
+		if (!MumbleLink::isActive() || !MumbleLink::isGW2())
+			continue;
+
+		identityDecode.begin();
+		MumbleLink::MumbleIdentity identity = MumbleLink::getIdentity();
+		identityDecode.end();
+
+		Gw2Info info;
+		info.characterName = identity.name;
+		info.profession = identity.profession;
+		info.mapId = identity.map_id;
+		info.worldId = identity.world_id;
+		info.teamColorId = identity.team_color_id;
+		info.commander = identity.commander;
+
+		ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
+		if (getCachedMap(info.mapId, &map)) {
+			info.mapName = map.value->map_name;
+			info.regionId = map.value->region_id;
+			info.regionName = map.value->region_name;
+			info.continentId = map.value->continent_id;
+			info.continentName = map.value->continent_name;
+
+			MapTransform transform;
+			bool isTransformPending;
+			positionConversion.begin();
+			if (getMapTransform(info.mapId, &transform, &isTransformPending, Async::Callback()))
+				info.characterContinentPosition = transform.toContinentPosition(MumbleLink::getAvatarPosition());
+			positionConversion.end();
+			if (trailMapId == 0 || trailMapId == info.mapId) {
+				trailMapId = info.mapId;
+				trailMapRect = map.value->map_rect;
+				trailContinentRect = map.value->continent_rect;
+				trailX.push_back((float)MumbleLink::getAvatarPosition().x);
+				trailZ.push_back((float)MumbleLink::getAvatarPosition().z);
+			}
+
+			PointOfInterestEntry waypoint;
+			bool isPending;
+			waypointSearch.begin();
+			bool hasWaypoint = getClosestWaypoint(info.characterContinentPosition, info.mapId, &waypoint, &isPending, Async::Callback());
+			waypointSearch.end();
+			if (hasWaypoint) {
+				info.waypointId = waypoint.poi_id;
+				info.waypointName = waypoint.name;
+				info.waypointContinentPosition = waypoint.coord;
+			}
+
+			// Has to agree with the full search on every frame
+			PointOfInterestEntry trackedWaypoint;
+			waypointTracking.begin();
+			bool hasTrackedWaypoint = waypointTracker.update(info.characterContinentPosition, info.mapId, &trackedWaypoint, &isPending, Async::Callback());
+			waypointTracking.end();
+			if (hasTrackedWaypoint != hasWaypoint || (hasWaypoint && trackedWaypoint.poi_id != waypoint.poi_id))
+				trackerMismatches++;
+		}
+		velocity.addSample(info.characterContinentPosition.toVector2D(), i * 1000 / 60);
+		info.characterContinentVelocity = velocity.getVelocity();
+
+		toJson.begin();
+		string json = info.toJson((uint32_t)i + 1, false);
+		toJson.end();
+		fromJson.begin();
+		Gw2Info parsed(json);
+		fromJson.end();
+
+		encode.begin();
+		bool changed = encoder.encode(info, infos.empty() ? NULL : &infos.back(), (uint32_t)packed.size() + 1, true);
+		encode.end();
+		if (changed) {
+			infos.push_back(info);
+			packed.push_back(encoder.text());
+		}
+
+		publish.begin();
+		Commands::publishGW2Info(targets, info);
+		publish.end();
+	}
+
+	printf("%-52s %10s %14s %10s %10s %10s %10s\n", "", "ops", "ops/s", "mean us", "p50 us", "p99 us", "max us");
+	identityDecode.report();
+	positionConversion.report();
+	waypointSearch.report();
+	waypointTracking.report();
+	toJson.report();
+	fromJson.report();
+	encode.report();
+	publish.report();
+	printf("%-52s %10u bytes\n", "published", (unsigned)sentCommandBytes);
+	printf("%-52s %10llu searches, %llu reused, %u mismatches\n", "tracked closest waypoint", waypointTracker.getStatistics().searches,
+		waypointTracker.getStatistics().reused, (unsigned)trackerMismatches);
+
+	// Converting the positions of one map as trails of a fixed length, point by point and in batches
+	if (!trailX.empty()) {
+		Benchmark scalarTrail("Gw2Position::toContinentPosition (" + to_string((int)trailLength) + " points)");
+		Benchmark batchTrail("BatchTransform::transform (" + to_string((int)trailLength) + " points)");
+		Gw2Position reference(Vector3D(), Gw2Position::Mumble, trailMapId, trailMapRect, trailContinentRect);
+		AffineTransform2D transform = reference.getTransform(Gw2Position::Mumble, Gw2Position::Continent);
+		vector<float> outX(trailLength);
+		vector<float> outZ(trailLength);
+		for (size_t start = 0; start + trailLength <= trailX.size(); start += trailLength) {
+			scalarTrail.begin();
+			for (size_t i = 0; i < trailLength; i++) {
+				Vector3D continent = reference.toContinentPosition(Vector3D(trailX[start + i], 0, trailZ[start + i]), Gw2Position::Mumble);
+				outX[i] = (float)continent.x;
+				outZ[i] = (float)continent.z;
+			}
+			scalarTrail.end();
+			batchTrail.begin();
+			BatchTransform::transform(transform, &trailX[start], &trailZ[start], &outX[0], &outZ[0], trailLength);
+			batchTrail.end();
+		}
+		scalarTrail.report();
+		batchTrail.report();
+	}
+
+	// Splitting received commands up, as ts3plugin_onPluginCommandEvent does before decoding them
+	if (!packed.empty()) {
+		Benchmark parse("Commands::parseCommand");
+		size_t messageCount = min(packed.size(), remoteFrameCount);
+		for (size_t m = 0; m < messageCount; m++) {
+			string command = "GW2InfoPacked 1 " + packed[m];
+			Commands::ParsedCommand parsed;
+			parse.begin();
+			Commands::parseCommand(command.c_str(), parsed);
+			parse.end();
+		}
+		parse.report();
+	}
+
+	// The receiving side with an increasing number of clients that all send the same session,
+	// the first message of each client is a snapshot and the rest are deltas
+	for (size_t c = 0; c < sizeof(clientCounts) / sizeof(clientCounts[0]); c++) {
+		int clientCount = clientCounts[c];
+		string suffix = " (" + to_string(clientCount) + " clients)";
+		Benchmark update("Gw2RemoteInfoContainer update" + suffix);
+		Benchmark render("Gw2RemoteInfoContainer getInfoData" + suffix);
+		Benchmark summary("Gw2RemoteInfoContainer channel summary" + suffix);
+
+		// Spread over a few channels, the summary of the first one is shown after every round of updates
+		const uint64 channelCount = 4;
+		Gw2RemoteInfoContainer container;
+		container.setChannelResolver([=](uint64 serverConnectionHandlerID, anyID clientID) -> uint64 { return 1 + clientID % channelCount; });
+		Gw2InfoCodec::Decoder decoder;
+		string infoData;
+		size_t messageCount = min(packed.size(), remoteFrameCount);
+		for (size_t m = 0; m < messageCount; m++) {
+			if (!decoder.decode(packed[m]))
+				continue;
+			for (int client = 1; client <= clientCount; client++) {
+				update.begin();
+				container.updateRemoteGW2Info(serverConnectionHandlerID, (anyID)client, decoder);
+				update.end();
+			}
+			for (int client = 1; client <= clientCount; client++) {
+				render.begin();
+				container.getInfoData(serverConnectionHandlerID, (anyID)client, PLUGIN_CLIENT, infoData);
+				render.end();
+			}
+			summary.begin();
+			container.getInfoData(serverConnectionHandlerID, 1, PLUGIN_CHANNEL, infoData);
+			summary.end();
+		}
+		update.report();
+		render.report();
+		summary.report();
+	}
+
+	// Clients spread over a map of this size with a few small moves each, answering who is closest to one of them
+	const double spreadMapSize = 4096;
+	const size_t nearbyCount = 10;
+	unsigned int seed = 12345;
+	for (size_t c = 0; c < sizeof(clientCounts) / sizeof(clientCounts[0]); c++) {
+		int clientCount = clientCounts[c];
+		string suffix = " (" + to_string(clientCount) + " clients)";
+		Benchmark move("ProximityIndex update" + suffix);
+		Benchmark nearest("ProximityIndex findNearest" + suffix);
+
+		ProximityIndex index;
+		vector<Vector2D> positions(clientCount);
+		vector<ProximityIndex::Neighbour> neighbours;
+		for (size_t m = 0; m < remoteFrameCount; m++) {
+			for (int client = 0; client < clientCount; client++) {
+				if (m == 0) {
+					seed = seed * 1103515245 + 12345;
+					positions[client].x = (seed >> 8) % (unsigned int)spreadMapSize;
+					seed = seed * 1103515245 + 12345;
+					positions[client].y = (seed >> 8) % (unsigned int)spreadMapSize;
+				} else {
+					positions[client].x += (double)(int)(m % 7) - 3;
+					positions[client].y += (double)(int)(m % 5) - 2;
+				}
+				move.begin();
+				index.update(serverConnectionHandlerID, (anyID)(client + 1), 1, positions[client]);
+				move.end();
+			}
+			int client = (int)(m % clientCount);
+			nearest.begin();
+			index.findNearest(serverConnectionHandlerID, 1, positions[client], nearbyCount, (anyID)(client + 1), neighbours);
+			nearest.end();
+		}
+		move.report();
+		nearest.report();
+	}
+
+	return 0;
+}
@@ -10,16 +10,67 @@
  * GNU General Public License for more details.
 */
 
+#include <algorithm>
+#include <map>
 #include "public_errors.h"
 #include "public_rare_definitions.h"
 #include "rapidjson/document.h"
+#include "gw2api/metrics.h"
 #include "commands.h"
 #include "globals.h"
+#include "gw2infocodec.h"
 #include "stringutils.h"
 using namespace std;
 
 namespace Commands {
 
+	/* Snapshot requests are collected for this long (in ms) and then answered with one command */
+	const DWORD replyWindow = 100;
+	/* Sync replies are spread over this much time (in ms) per client on the server, within the limits below */
+	const DWORD syncReplyWindowPerClient = 20;
+	const DWORD minSyncReplyWindow = 500;
+	const DWORD maxSyncReplyWindow = 10000;
+	/* Replies that are due within this many ms are sent right away, GetTickCount64 isn't more precise anyway */
+	const DWORD replyTimerTolerance = 16;
+
+	/* What has been sent to a server connection so far, deltas are relative to this */
+	struct PublishedInfo {
+		PublishedInfo() : sequence(0), hasSnapshot(false), generation(0) { }
+
+		Gw2Info info;
+		uint32_t sequence;
+		bool hasSnapshot;
+		uint32_t generation; // Connections with the same generation have been sent the same info, so they share encoded messages
+		std::string snapshotTexts[2]; // info as snapshot with sequence for replies, JSON and compact; empty until it's needed
+	};
+
+	/* Clients on a server connection that are waiting for a snapshot */
+	struct PendingReplies {
+		PendingReplies() : compact(true), dueTime(0) { }
+
+		std::vector<anyID> clientIDs;
+		bool compact;
+		ULONGLONG dueTime; // GetTickCount64 when the replies are sent, the earliest of the clients
+	};
+
+	class PublishedInfoContainer {
+	public:
+		PublishedInfoContainer() : generation(0), hTimerQueue(NULL), hReplyTimer(NULL), replyTimerDueTime(0), randomState(GetTickCount()) { InitializeCriticalSection(&cs); }
+		~PublishedInfoContainer() { DeleteCriticalSection(&cs); }
+
+		CRITICAL_SECTION cs;
+		std::map<uint64, PublishedInfo> infos;
+		std::map<uint64, PendingReplies> pendingReplies;
+		Gw2InfoCodec::Encoder encoder;
+		uint32_t generation;
+		HANDLE hTimerQueue;
+		HANDLE hReplyTimer; // Set while replies are waiting to be sent
+		ULONGLONG replyTimerDueTime;
+		uint32_t randomState; // For the sync reply delays
+	};
+
+	static PublishedInfoContainer publishedInfos;
+
 	bool getOwnClientID(uint64 serverConnectionHandlerID, anyID* myID) {
 		if (!Globals::pluginID) {
 			debuglog("GW2Plugin: Plugin not registered, unable to get own ID\n");
@@ -33,40 +84,71 @@ namespace Commands {
 		return true;
 	}
 
-	bool parseCommand(const string& command, CommandType& commandType, vector<string>& commandParameters) {
-		commandType = CMD_NONE;
-		vector<string> s = split(string(command), ' ', 2);
-		vector<string> params;
-		if (s.size() > 0) {
-			if (s.at(0) == "GW2Info") {
-				commandType = CMD_GW2INFO;
-				if (s.size() > 1)
-					params = split(s.at(1), ' ', 2);
-			} else if (s.at(0) == "RequestGW2Info") {
-				commandType = CMD_REQUESTGW2INFO;
-				if (s.size() > 1)
-					params.push_back(s.at(1));
-			} else {
-				return false;
-			}
+	static const char* getCommandName(CommandType type) {
+		switch (type) {
+			case CMD_GW2INFO:
+				return "GW2Info";
+			case CMD_REQUESTGW2INFO:
+				return "RequestGW2Info";
+			case CMD_GW2INFOPACKED:
+				return "GW2InfoPacked";
+			case CMD_SYNCGW2INFO:
+				return "SyncGW2Info";
+			default:
+				return "";
 		}
-		commandParameters = params;
-		return true;
 	}
 
-	void send(uint64 serverConnectionHandlerID, CommandType type, const string& parameters, int targetMode, const anyID* targetIDs, const char* returnCode) {
-		string command;
+	bool parseCommand(const char* command, ParsedCommand& parsed) {
+		parsed.type = CMD_NONE;
+		parsed.parameterCount = 0;
+		size_t commandLength = strlen(command);
+		if (commandLength == 0)
+			return true;
+		Gw2Api::Metrics::add(Gw2Api::Metrics::CommandsReceived);
+		Gw2Api::Metrics::add(Gw2Api::Metrics::CommandBytesReceived, commandLength);
 
-		switch (type) {
-			case CMD_GW2INFO:
-				command = "GW2Info";
+		const char* nameEnd = (const char*)memchr(command, ' ', commandLength);
+		StringRef name(command, nameEnd != NULL ? nameEnd - command : commandLength);
+
+		// Every command name has a different length, so that's enough to pick the only candidate to compare with
+		size_t parameterCount;
+		switch (name.size()) {
+			case 7:
+				parsed.type = CMD_GW2INFO;
+				parameterCount = 2;
 				break;
-			case CMD_REQUESTGW2INFO:
-				command = "RequestGW2Info";
+			case 11:
+				parsed.type = CMD_SYNCGW2INFO;
+				parameterCount = 2;
+				break;
+			case 13:
+				parsed.type = CMD_GW2INFOPACKED;
+				parameterCount = 2;
 				break;
+			case 14:
+				parsed.type = CMD_REQUESTGW2INFO;
+				parameterCount = 2;
+				break;
+			default:
+				return false;
 		}
+		const char* expectedName = getCommandName(parsed.type);
+		if (!name.equals(expectedName, strlen(expectedName))) {
+			parsed.type = CMD_NONE;
+			return false;
+		}
+
+		if (nameEnd != NULL)
+			parsed.parameterCount = split(StringRef(nameEnd + 1, command + commandLength - nameEnd - 1), ' ', parsed.parameters, parameterCount);
+		return true;
+	}
 
+	void send(uint64 serverConnectionHandlerID, CommandType type, const string& parameters, int targetMode, const anyID* targetIDs, const char* returnCode) {
+		string command = getCommandName(type);
 		command += " " + parameters;
+		Gw2Api::Metrics::add(Gw2Api::Metrics::CommandsSent);
+		Gw2Api::Metrics::add(Gw2Api::Metrics::CommandBytesSent, command.size());
 		Globals::ts3Functions.sendPluginCommand(serverConnectionHandlerID, Globals::pluginID, command.c_str(), targetMode, targetIDs, returnCode);
 	}
 
@@ -75,17 +157,282 @@ namespace Commands {
 		if (!getOwnClientID(serverConnectionHandlerID, &myID))
 			return;
 
-		string parameters = to_string(myID);
-		send(serverConnectionHandlerID, CMD_REQUESTGW2INFO, parameters, PluginCommandTarget_SERVER, targetIDs, NULL);
+		// Older clients only read the client ID; the version tells the receiver whether we understand deltas
+		string parameters = to_string(myID) + " " + PLUGIN_VERSION;
+		send(serverConnectionHandlerID, CMD_REQUESTGW2INFO, parameters, targetMode, targetIDs, NULL);
+	}
+
+	void syncGW2Info(uint64 serverConnectionHandlerID) {
+		anyID myID;
+		if (!getOwnClientID(serverConnectionHandlerID, &myID))
+			return;
+
+		// Same parameters as RequestGW2Info; older clients don't know the command and ignore it
+		string parameters = to_string(myID) + " " + PLUGIN_VERSION;
+		send(serverConnectionHandlerID, CMD_SYNCGW2INFO, parameters, PluginCommandTarget_SERVER, NULL, NULL);
+	}
+
+	/* Needs to be called with publishedInfos.cs held; encodes only once per published info, so repeated replies don't serialize anything */
+	static const string& getSnapshotText(PublishedInfo& published, bool compact) {
+		string& text = published.snapshotTexts[compact ? 1 : 0];
+		if (text.empty()) {
+			Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::Serialize);
+			if (compact) {
+				publishedInfos.encoder.encode(published.info, NULL, published.sequence, true);
+				text = publishedInfos.encoder.text();
+			} else {
+				text = published.info.toJson(published.sequence, false);
+			}
+		}
+		return text;
 	}
 
-	void sendGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, int targetMode, const anyID* targetIDs) {
+	void sendGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, bool compact) {
 		anyID myID;
 		if (!getOwnClientID(serverConnectionHandlerID, &myID))
 			return;
 
-		string parameters = to_string(myID) + " " + gw2Info.toJson().c_str();
-		send(serverConnectionHandlerID, CMD_GW2INFO, parameters, PluginCommandTarget_SERVER, targetIDs, NULL);
+		EnterCriticalSection(&publishedInfos.cs);
+		PublishedInfo& published = publishedInfos.infos[serverConnectionHandlerID];
+		published.info = gw2Info;
+		published.sequence++;
+		published.hasSnapshot = true;
+		published.generation = ++publishedInfos.generation;
+		published.snapshotTexts[0].clear();
+		published.snapshotTexts[1].clear();
+		string parameters = to_string(myID) + " " + getSnapshotText(published, compact);
+		// Everyone gets this one, including the clients that are still waiting for a reply
+		publishedInfos.pendingReplies.erase(serverConnectionHandlerID);
+		LeaveCriticalSection(&publishedInfos.cs);
+
+		send(serverConnectionHandlerID, compact ? CMD_GW2INFOPACKED : CMD_GW2INFO, parameters, PluginCommandTarget_SERVER, NULL, NULL);
+	}
+
+	static VOID CALLBACK sendReplies(PVOID lpParameter, BOOLEAN timerOrWaitFired);
+
+	/* Needs to be called with publishedInfos.cs held; makes sure the reply timer fires at dueTime or earlier */
+	static void scheduleReplies(ULONGLONG dueTime) {
+		if (publishedInfos.hTimerQueue == NULL)
+			return;
+		if (publishedInfos.hReplyTimer != NULL) {
+			if (publishedInfos.replyTimerDueTime <= dueTime)
+				return;
+			// Doesn't wait; if it's firing right now, sendReplies sends what's due and schedules the rest again
+			DeleteTimerQueueTimer(publishedInfos.hTimerQueue, publishedInfos.hReplyTimer, NULL);
+			publishedInfos.hReplyTimer = NULL;
+		}
+		ULONGLONG now = GetTickCount64();
+		DWORD delay = dueTime > now ? (DWORD)(dueTime - now) : 0;
+		if (CreateTimerQueueTimer(&publishedInfos.hReplyTimer, publishedInfos.hTimerQueue, sendReplies, NULL, delay, 0, WT_EXECUTEONLYONCE))
+			publishedInfos.replyTimerDueTime = dueTime;
+		else
+			publishedInfos.hReplyTimer = NULL;
+	}
+
+	/* Needs to be called with publishedInfos.cs held */
+	static void queueReply(uint64 serverConnectionHandlerID, anyID clientID, bool compact, DWORD delay) {
+		ULONGLONG dueTime = GetTickCount64() + delay;
+		PendingReplies& pending = publishedInfos.pendingReplies[serverConnectionHandlerID];
+		if (find(pending.clientIDs.begin(), pending.clientIDs.end(), clientID) == pending.clientIDs.end())
+			pending.clientIDs.push_back(clientID);
+		pending.compact = pending.compact && compact;
+		if (pending.dueTime == 0 || dueTime < pending.dueTime)
+			pending.dueTime = dueTime;
+		scheduleReplies(pending.dueTime);
+	}
+
+	static VOID CALLBACK sendReplies(PVOID lpParameter, BOOLEAN timerOrWaitFired) {
+		map<uint64, PendingReplies> pendingReplies;
+		EnterCriticalSection(&publishedInfos.cs);
+		HANDLE hReplyTimer = publishedInfos.hReplyTimer;
+		publishedInfos.hReplyTimer = NULL;
+		if (hReplyTimer != NULL && publishedInfos.hTimerQueue != NULL)
+			DeleteTimerQueueTimer(publishedInfos.hTimerQueue, hReplyTimer, NULL); // Doesn't wait, so it's safe from within the callback
+		// Only the replies that are due, the others wait for the next timer
+		ULONGLONG now = GetTickCount64();
+		ULONGLONG nextDueTime = 0;
+		for (map<uint64, PendingReplies>::iterator it = publishedInfos.pendingReplies.begin(); it != publishedInfos.pendingReplies.end();) {
+			if (it->second.dueTime <= now + replyTimerTolerance) {
+				pendingReplies.insert(*it);
+				it = publishedInfos.pendingReplies.erase(it);
+			} else {
+				if (nextDueTime == 0 || it->second.dueTime < nextDueTime)
+					nextDueTime = it->second.dueTime;
+				it++;
+			}
+		}
+		if (nextDueTime != 0)
+			scheduleReplies(nextDueTime);
+		LeaveCriticalSection(&publishedInfos.cs);
+
+		for (map<uint64, PendingReplies>::iterator it = pendingReplies.begin(); it != pendingReplies.end(); it++) {
+			anyID myID;
+			if (!getOwnClientID(it->first, &myID))
+				continue;
+
+			// Replies repeat the last published snapshot without bumping the sequence, so deltas to everyone else stay valid
+			EnterCriticalSection(&publishedInfos.cs);
+			map<uint64, PublishedInfo>::iterator published = publishedInfos.infos.find(it->first);
+			if (published == publishedInfos.infos.end() || !published->second.hasSnapshot) {
+				LeaveCriticalSection(&publishedInfos.cs);
+				continue;
+			}
+			string parameters = to_string(myID) + " " + getSnapshotText(published->second, it->second.compact);
+			LeaveCriticalSection(&publishedInfos.cs);
+
+			vector<anyID>& targetIDs = it->second.clientIDs;
+			debuglog("GW2Plugin: Replying to %d snapshot request(s) at once\n", targetIDs.size());
+			targetIDs.push_back(0);
+			send(it->first, it->second.compact ? CMD_GW2INFOPACKED : CMD_GW2INFO, parameters, PluginCommandTarget_CLIENT, &targetIDs[0], NULL);
+		}
+	}
+
+	void replyGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, anyID clientID, bool compact) {
+		EnterCriticalSection(&publishedInfos.cs);
+		map<uint64, PublishedInfo>::const_iterator published = publishedInfos.infos.find(serverConnectionHandlerID);
+		if (published == publishedInfos.infos.end() || !published->second.hasSnapshot || publishedInfos.hTimerQueue == NULL) {
+			// Nothing to repeat yet; a new snapshot answers everyone
+			LeaveCriticalSection(&publishedInfos.cs);
+			sendGW2Info(serverConnectionHandlerID, gw2Info, compact);
+			return;
+		}
+		queueReply(serverConnectionHandlerID, clientID, compact, replyWindow);
+		LeaveCriticalSection(&publishedInfos.cs);
+	}
+
+	void replySyncGW2Info(uint64 serverConnectionHandlerID, anyID clientID, bool compact, size_t clientCount) {
+		anyID myID;
+		if (!getOwnClientID(serverConnectionHandlerID, &myID) || clientID == myID)
+			return;
+
+		DWORD window = (DWORD)min<size_t>(clientCount * syncReplyWindowPerClient, maxSyncReplyWindow);
+		if (window < minSyncReplyWindow)
+			window = minSyncReplyWindow;
+
+		EnterCriticalSection(&publishedInfos.cs);
+		map<uint64, PublishedInfo>::const_iterator published = publishedInfos.infos.find(serverConnectionHandlerID);
+		if (published != publishedInfos.infos.end() && published->second.hasSnapshot) {
+			publishedInfos.randomState = publishedInfos.randomState * 1103515245 + 12345;
+			queueReply(serverConnectionHandlerID, clientID, compact, (publishedInfos.randomState >> 8) % window);
+		}
+		LeaveCriticalSection(&publishedInfos.cs);
+	}
+
+	/* An encoded message without the client ID in front, shared by all connections it has been encoded for */
+	struct PublishedMessage {
+		uint32_t generation;
+		uint32_t sequence;
+		bool compact;
+		bool hasSnapshot;
+		bool changed;
+		string text;
+	};
+
+	void publishGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, bool compact) {
+		vector<PublishTarget> targets(1);
+		targets[0].serverConnectionHandlerID = serverConnectionHandlerID;
+		targets[0].compact = compact;
+		publishGW2Info(targets, gw2Info);
+	}
+
+	void publishGW2Info(const vector<PublishTarget>& targets, const Gw2Info& gw2Info) {
+		// Client IDs are never 0, it marks connections we can't send to
+		vector<anyID> myIDs(targets.size(), 0);
+		for (size_t i = 0; i < targets.size(); i++) {
+			if (!getOwnClientID(targets[i].serverConnectionHandlerID, &myIDs[i]))
+				myIDs[i] = 0;
+		}
+
+		vector<PublishedMessage> messages;
+		vector<size_t> messageIndices(targets.size(), string::npos);
+		EnterCriticalSection(&publishedInfos.cs);
+		uint32_t generation = ++publishedInfos.generation;
+		for (size_t i = 0; i < targets.size(); i++) {
+			if (myIDs[i] == 0)
+				continue;
+			PublishedInfo& published = publishedInfos.infos[targets[i].serverConnectionHandlerID];
+			bool compact = targets[i].compact;
+
+			// Connections that are in the same state get the same message, so it's encoded only once
+			size_t m = 0;
+			while (m < messages.size() && !(messages[m].generation == published.generation && messages[m].sequence == published.sequence &&
+				messages[m].compact == compact && messages[m].hasSnapshot == published.hasSnapshot))
+				m++;
+			if (m == messages.size()) {
+				Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::Serialize);
+				PublishedMessage message;
+				message.generation = published.generation;
+				message.sequence = published.sequence;
+				message.compact = compact;
+				message.hasSnapshot = published.hasSnapshot;
+				message.changed = !published.hasSnapshot || publishedInfos.encoder.encode(gw2Info, &published.info, published.sequence + 1, compact);
+				if (message.changed) {
+					// Deltas are only sent in compact mode, otherwise everyone gets a full JSON snapshot with names
+					if (compact && published.hasSnapshot) {
+						message.text = publishedInfos.encoder.text(); // The delta from above
+					} else if (compact) {
+						publishedInfos.encoder.encode(gw2Info, NULL, published.sequence + 1, true);
+						message.text = publishedInfos.encoder.text();
+					} else {
+						message.text = gw2Info.toJson(published.sequence + 1, false);
+					}
+				}
+				messages.push_back(message);
+			}
+			if (!messages[m].changed)
+				continue;
+
+			if (!compact || !published.hasSnapshot)
+				publishedInfos.pendingReplies.erase(targets[i].serverConnectionHandlerID); // Answered by this snapshot
+			published.info = gw2Info;
+			published.sequence++;
+			published.hasSnapshot = true;
+			published.generation = generation;
+			// A snapshot that has just been sent can be repeated as is for replies
+			bool isSnapshot = !compact || !messages[m].hasSnapshot;
+			published.snapshotTexts[0].clear();
+			published.snapshotTexts[1].clear();
+			if (isSnapshot)
+				published.snapshotTexts[compact ? 1 : 0] = messages[m].text;
+			messageIndices[i] = m;
+		}
+		LeaveCriticalSection(&publishedInfos.cs);
+
+		Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::Send);
+		for (size_t i = 0; i < targets.size(); i++) {
+			if (messageIndices[i] == string::npos)
+				continue;
+			const PublishedMessage& message = messages[messageIndices[i]];
+			string parameters = to_string(myIDs[i]) + " " + message.text;
+			send(targets[i].serverConnectionHandlerID, message.compact ? CMD_GW2INFOPACKED : CMD_GW2INFO, parameters, PluginCommandTarget_SERVER, NULL, NULL);
+		}
+	}
+
+	void removeServerConnection(uint64 serverConnectionHandlerID) {
+		EnterCriticalSection(&publishedInfos.cs);
+		publishedInfos.infos.erase(serverConnectionHandlerID);
+		publishedInfos.pendingReplies.erase(serverConnectionHandlerID);
+		LeaveCriticalSection(&publishedInfos.cs);
+	}
+
+	void init() {
+		EnterCriticalSection(&publishedInfos.cs);
+		if (publishedInfos.hTimerQueue == NULL)
+			publishedInfos.hTimerQueue = CreateTimerQueue();
+		LeaveCriticalSection(&publishedInfos.cs);
+	}
+
+	void shutdown() {
+		EnterCriticalSection(&publishedInfos.cs);
+		HANDLE hTimerQueue = publishedInfos.hTimerQueue;
+		publishedInfos.hTimerQueue = NULL;
+		publishedInfos.hReplyTimer = NULL;
+		publishedInfos.pendingReplies.clear();
+		LeaveCriticalSection(&publishedInfos.cs);
+
+		// Waits for a running sendReplies and deletes the pending timer
+		if (hTimerQueue != NULL)
+			DeleteTimerQueueEx(hTimerQueue, INVALID_HANDLE_VALUE);
 	}
 
 }
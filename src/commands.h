@@ -14,8 +14,10 @@
 
 #include <stdio.h>
 #include <string>
+#include <vector>
 #include "public_definitions.h"
 #include "gw2info.h"
+#include "stringutils.h"
 
 #if _DEBUG
 #define debuglog(str, ...) printf(str, __VA_ARGS__);
@@ -28,13 +30,64 @@ namespace Commands {
 	enum CommandType { 
 		CMD_NONE = 0,
 		CMD_GW2INFO, 
-		CMD_REQUESTGW2INFO
+		CMD_REQUESTGW2INFO,
+		CMD_GW2INFOPACKED,
+		CMD_SYNCGW2INFO
 	};
 
-	bool parseCommand(const std::string& command, CommandType& commandType, std::vector<std::string>& commandParameters);
+	/* A received command split up without copying; the parameters point into the command text, the last one holds the rest of it */
+	struct ParsedCommand {
+		static const size_t maxParameters = 2;
+
+		CommandType type;
+		StringRef parameters[maxParameters];
+		size_t parameterCount;
+	};
+
+	/* Returns false for commands of other plugin versions this one doesn't know */
+	bool parseCommand(const char* command, ParsedCommand& parsed);
 
 	void send(uint64 serverConnectionHandlerID, CommandType type, const std::string& parameters, int targetMode, const anyID* targetIDs, const char* returnCode);
+	/* Starts the timer queue that sends batched replies; replies are sent right away without it */
+	void init();
+	/* Drops replies that haven't been sent yet */
+	void shutdown();
+
+	/* targetIDs is a zero-terminated list of clients, only used with PluginCommandTarget_CLIENT */
 	void requestGW2Info(uint64 serverConnectionHandlerID, int targetMode, const anyID* targetIDs);
-	void sendGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, int targetMode, const anyID* targetIDs);
+	/* Asks everyone on the server for their info at once, after joining; see replySyncGW2Info */
+	void syncGW2Info(uint64 serverConnectionHandlerID);
+	/*
+	 * Broadcasts a full snapshot, which also becomes the base for following deltas.
+	 * Compact snapshots are packed and leave the names out; only use them if every receiver supports that (see Gw2Info::supportsCompact).
+	 * Otherwise the snapshot is sent as JSON with names, which every version understands.
+	 */
+	void sendGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, bool compact);
+	/*
+	 * Answers a snapshot request. Requests are collected for a short while and answered together with the last broadcast snapshot,
+	 * so a burst of requests results in one command; gw2Info is only used if nothing has been broadcast yet.
+	 */
+	void replyGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, anyID clientID, bool compact);
+	/*
+	 * Answers a sync request like a snapshot request, but after a random delay that grows with clientCount (the size of the server),
+	 * so not everyone answers the new client at the same moment. A snapshot broadcast in the meantime answers it as well.
+	 * Nothing is sent if nothing has been broadcast to the server yet.
+	 */
+	void replySyncGW2Info(uint64 serverConnectionHandlerID, anyID clientID, bool compact, size_t clientCount);
+	/* Broadcasts a packed delta of what changed since the previous snapshot or delta in compact mode, otherwise a full JSON snapshot with names */
+	void publishGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, bool compact);
+
+	/* A server connection to publish to; compact like above */
+	struct PublishTarget {
+		uint64 serverConnectionHandlerID;
+		bool compact;
+	};
+	/*
+	 * Publishes to several server connections at once. Every connection keeps its own sequence and base for deltas,
+	 * but connections that have been sent the same info so far share the encoded message.
+	 */
+	void publishGW2Info(const std::vector<PublishTarget>& targets, const Gw2Info& gw2Info);
+	/* Forgets what has been sent to a server connection, so the next publish starts with a snapshot again */
+	void removeServerConnection(uint64 serverConnectionHandlerID);
 
 }
@@ -13,6 +13,7 @@
 #pragma once
 #include <QtCore/QSettings>
 #include <QtGui/QDialog>
+#include "gw2api/gw2api.h"
 #include "configdialog.h"
 #include "globals.h"
 
@@ -23,19 +24,38 @@ ConfigDialog::~ConfigDialog() { }
 void ConfigDialog::SetupUi() {
 	setupUi(this);
 	QSettings cfg(QString::fromStdString(Globals::getConfigFilePath()), QSettings::IniFormat);
-	spinBox_locationTransmissionThreshold->setValue(cfg.value("locationTransmissionThreshold", DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD).toInt());
+	spinBox_locationTransmissionThreshold->setValue(Globals::readMilliseconds(cfg, "locationTransmissionThresholdMs", "locationTransmissionThreshold", DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD));
 	spinBox_distanceTransmissionThreshold->setValue(cfg.value("distanceTransmissionThreshold", DEFAULTCONFIG_DISTANCETRANSMISSIONTHRESHOLD).toInt());
-	spinBox_onlineStateTransmissionThreshold->setValue(cfg.value("onlineStateTransmissionThreshold", DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD).toInt());
+	spinBox_onlineStateTransmissionThreshold->setValue(Globals::readMilliseconds(cfg, "onlineStateTransmissionThresholdMs", "onlineStateTransmissionThreshold", DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD));
+	spinBox_mumbleLinkMinPollInterval->setValue(cfg.value("mumbleLinkMinPollInterval", DEFAULTCONFIG_MUMBLELINKMINPOLLINTERVAL).toInt());
+	spinBox_mumbleLinkSteadyPollInterval->setValue(cfg.value("mumbleLinkSteadyPollInterval", DEFAULTCONFIG_MUMBLELINKSTEADYPOLLINTERVAL).toInt());
+	spinBox_mumbleLinkMaxPollInterval->setValue(cfg.value("mumbleLinkMaxPollInterval", DEFAULTCONFIG_MUMBLELINKMAXPOLLINTERVAL).toInt());
+	spinBox_infoRequestTtl->setValue(cfg.value("infoRequestTtl", DEFAULTCONFIG_INFOREQUESTTTL).toInt());
+	spinBox_infoRequestsPerMinute->setValue(cfg.value("infoRequestsPerMinute", DEFAULTCONFIG_INFOREQUESTSPERMINUTE).toInt());
+	spinBox_apiConcurrency->setValue(cfg.value("apiConcurrency", DEFAULTCONFIG_APICONCURRENCY).toInt());
 }
 
 void ConfigDialog::accept() {
 	Globals::locationTransmissionThreshold = spinBox_locationTransmissionThreshold->value();
 	Globals::onlineStateTransmissionThreshold = spinBox_onlineStateTransmissionThreshold->value();
+	Globals::mumbleLinkMinPollInterval = spinBox_mumbleLinkMinPollInterval->value();
+	Globals::mumbleLinkSteadyPollInterval = spinBox_mumbleLinkSteadyPollInterval->value();
+	Globals::mumbleLinkMaxPollInterval = spinBox_mumbleLinkMaxPollInterval->value();
+	Globals::infoRequestTtl = spinBox_infoRequestTtl->value();
+	Globals::infoRequestsPerMinute = spinBox_infoRequestsPerMinute->value();
+	Globals::apiConcurrency = spinBox_apiConcurrency->value();
+	Gw2Api::Async::setMaxConcurrency(Globals::apiConcurrency);
 
 	QSettings cfg(QString::fromStdString(Globals::getConfigFilePath()), QSettings::IniFormat);
-	cfg.setValue("locationTransmissionThreshold", spinBox_locationTransmissionThreshold->value());
+	cfg.setValue("locationTransmissionThresholdMs", spinBox_locationTransmissionThreshold->value());
 	cfg.setValue("distanceTransmissionThreshold", spinBox_distanceTransmissionThreshold->value());
-	cfg.setValue("onlineStateTransmissionThreshold", spinBox_onlineStateTransmissionThreshold->value());
+	cfg.setValue("onlineStateTransmissionThresholdMs", spinBox_onlineStateTransmissionThreshold->value());
+	cfg.setValue("mumbleLinkMinPollInterval", spinBox_mumbleLinkMinPollInterval->value());
+	cfg.setValue("mumbleLinkSteadyPollInterval", spinBox_mumbleLinkSteadyPollInterval->value());
+	cfg.setValue("mumbleLinkMaxPollInterval", spinBox_mumbleLinkMaxPollInterval->value());
+	cfg.setValue("infoRequestTtl", spinBox_infoRequestTtl->value());
+	cfg.setValue("infoRequestsPerMinute", spinBox_infoRequestsPerMinute->value());
+	cfg.setValue("apiConcurrency", spinBox_apiConcurrency->value());
 	QDialog::accept();
 }
 
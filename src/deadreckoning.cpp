@@ -0,0 +1,51 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include "deadreckoning.h"
+using namespace Gw2Api;
+
+/* Samples closer together than this (in ms) are skipped */
+static const ULONGLONG minSampleInterval = 100;
+/* After a gap longer than this (in ms), e.g. a loading screen, the estimate starts over */
+static const ULONGLONG maxSampleInterval = 2000;
+/* Weight of a new sample in the estimate; smooths out the uneven frame times of the game */
+static const double smoothing = 0.5;
+/* Slower than this (in units per second) counts as standing still, so the estimate settles at exactly zero */
+static const double minSpeed = 0.5;
+
+VelocityEstimator::VelocityEstimator() : sampleTime(0), hasSample(false) { }
+
+void VelocityEstimator::reset() {
+	hasSample = false;
+	velocity = Vector2D();
+}
+
+void VelocityEstimator::addSample(const Vector2D& position, ULONGLONG time) {
+	if (!hasSample || time - sampleTime > maxSampleInterval) {
+		samplePosition = position;
+		sampleTime = time;
+		hasSample = true;
+		velocity = Vector2D();
+		return;
+	}
+
+	ULONGLONG elapsed = time - sampleTime;
+	if (elapsed < minSampleInterval)
+		return;
+
+	Vector2D current = (position - samplePosition) / (elapsed / 1000.0);
+	velocity = velocity * (1 - smoothing) + current * smoothing;
+	if (velocity.getSize() < minSpeed)
+		velocity = Vector2D();
+	samplePosition = position;
+	sampleTime = time;
+}
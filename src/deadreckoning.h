@@ -0,0 +1,56 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <Windows.h>
+#include "gw2api/math.h"
+
+/*
+ * Estimates how fast and in which direction a position moves from the samples the Mumble Link loop takes.
+ * Senders transmit the velocity along with the position, and receivers extrapolate the position in between updates.
+ */
+class VelocityEstimator {
+
+private:
+	Gw2Api::Vector2D samplePosition;
+	ULONGLONG sampleTime;
+	bool hasSample;
+	Gw2Api::Vector2D velocity;
+
+public:
+	VelocityEstimator();
+
+	/* Forgets the samples, e.g. after a map change (the position jumps) */
+	void reset();
+
+	/* Samples can be added as often as wanted, they are only taken into account every so often to keep single-frame jitter out */
+	void addSample(const Gw2Api::Vector2D& position, ULONGLONG time);
+
+	/* In units of the samples per second */
+	Gw2Api::Vector2D getVelocity() const { return velocity; }
+
+};
+
+namespace DeadReckoning {
+
+	/* Predictions don't go further than this (in seconds), in case the sender went away without telling */
+	const double maxPredictionTime = 30;
+
+	/* Where something at position, moving with velocity, is expected to be after elapsed milliseconds */
+	inline Gw2Api::Vector2D predict(const Gw2Api::Vector2D& position, const Gw2Api::Vector2D& velocity, ULONGLONG elapsed) {
+		double seconds = elapsed / 1000.0;
+		if (seconds > maxPredictionTime)
+			seconds = maxPredictionTime;
+		return position + velocity * seconds;
+	}
+
+}
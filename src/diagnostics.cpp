@@ -0,0 +1,63 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#include <Windows.h>
+#include "gw2api/cache.h"
+#include "gw2api/internedstring.h"
+#include "gw2api/jsonarena.h"
+#include "gw2api/metrics.h"
+#include "diagnostics.h"
+using namespace std;
+
+namespace Diagnostics {
+
+	string getReport() {
+		string report;
+		char line[256];
+
+		for (int i = 0; i < Gw2Api::Metrics::CounterCount; i++) {
+			Gw2Api::Metrics::Counter counter = (Gw2Api::Metrics::Counter)i;
+			sprintf_s(line, "%s: %llu\n", Gw2Api::Metrics::getName(counter), (unsigned long long)Gw2Api::Metrics::get(counter));
+			report += line;
+		}
+
+		for (int i = 0; i < Gw2Api::Metrics::TimerCount; i++) {
+			Gw2Api::Metrics::Timer timer = (Gw2Api::Metrics::Timer)i;
+			Gw2Api::Metrics::Histogram histogram = Gw2Api::Metrics::get(timer);
+			double average = histogram.count > 0 ? histogram.totalMicroseconds / 1000.0 / histogram.count : 0.0;
+			sprintf_s(line, "%s: %llu times, %.3f ms on average, p50 < %.3f ms, p95 < %.3f ms, p99 < %.3f ms, %.3f ms at most\n",
+				Gw2Api::Metrics::getName(timer), (unsigned long long)histogram.count, average,
+				histogram.getPercentileMicroseconds(0.5) / 1000.0, histogram.getPercentileMicroseconds(0.95) / 1000.0,
+				histogram.getPercentileMicroseconds(0.99) / 1000.0, histogram.maxMicroseconds / 1000.0);
+			report += line;
+		}
+
+		Gw2Api::Cache::Statistics cacheStats = Gw2Api::Cache::getStatistics();
+		sprintf_s(line, "API cache: %llu hits, %llu misses, %llu evictions, %u objects using about %u of %u bytes\n",
+			(unsigned long long)cacheStats.hits, (unsigned long long)cacheStats.misses, (unsigned long long)cacheStats.evictions,
+			(unsigned)cacheStats.objectCount, (unsigned)cacheStats.memoryUsage, (unsigned)cacheStats.memoryBudget);
+		report += line;
+
+		size_t stringPoolMemory;
+		size_t stringPoolSize = Gw2Api::InternedString::getPoolSize(&stringPoolMemory);
+		sprintf_s(line, "API name pool: %u strings using about %u bytes\n", (unsigned)stringPoolSize, (unsigned)stringPoolMemory);
+		report += line;
+
+		Gw2Api::JsonArena::Statistics arenaStats = Gw2Api::JsonArena::getStatistics();
+		sprintf_s(line, "JSON parse arenas: %u blocks allocated, %u bytes reserved\n", (unsigned)arenaStats.blockAllocations, (unsigned)arenaStats.capacity);
+		report += line;
+
+		return report;
+	}
+
+}
@@ -0,0 +1,26 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <string>
+
+/*
+ * Human readable summary of the plugin's counters (Gw2Api::Metrics, the API cache and the Mumble Link loop stages),
+ * shown by the "/gw2 stats" chat command so the cost of the plugin can be compared between setups.
+ */
+namespace Diagnostics {
+
+	/* One line per counter, separated by \n */
+	std::string getReport();
+
+}
@@ -20,20 +20,54 @@ namespace Globals {
 	int locationTransmissionThreshold = DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD;
 	int onlineStateTransmissionThreshold = DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD;
 	int distanceTransmissionThreshold = DEFAULTCONFIG_DISTANCETRANSMISSIONTHRESHOLD;
+	int mumbleLinkMinPollInterval = DEFAULTCONFIG_MUMBLELINKMINPOLLINTERVAL;
+	int mumbleLinkSteadyPollInterval = DEFAULTCONFIG_MUMBLELINKSTEADYPOLLINTERVAL;
+	int mumbleLinkMaxPollInterval = DEFAULTCONFIG_MUMBLELINKMAXPOLLINTERVAL;
+	int infoRequestTtl = DEFAULTCONFIG_INFOREQUESTTTL;
+	int infoRequestsPerMinute = DEFAULTCONFIG_INFOREQUESTSPERMINUTE;
+	int apiConcurrency = DEFAULTCONFIG_APICONCURRENCY;
 
 	void loadConfig() {
 		QSettings cfg(QString::fromStdString(getConfigFilePath()), QSettings::IniFormat);
-		locationTransmissionThreshold = cfg.value("locationTransmissionThreshold", DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD).toInt();
-		onlineStateTransmissionThreshold = cfg.value("onlineStateTransmissionThreshold", DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD).toInt();
+		locationTransmissionThreshold = readMilliseconds(cfg, "locationTransmissionThresholdMs", "locationTransmissionThreshold", DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD);
+		onlineStateTransmissionThreshold = readMilliseconds(cfg, "onlineStateTransmissionThresholdMs", "onlineStateTransmissionThreshold", DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD);
 		distanceTransmissionThreshold = cfg.value("distanceTransmissionThreshold", DEFAULTCONFIG_DISTANCETRANSMISSIONTHRESHOLD).toInt();
+		mumbleLinkMinPollInterval = cfg.value("mumbleLinkMinPollInterval", DEFAULTCONFIG_MUMBLELINKMINPOLLINTERVAL).toInt();
+		mumbleLinkSteadyPollInterval = cfg.value("mumbleLinkSteadyPollInterval", DEFAULTCONFIG_MUMBLELINKSTEADYPOLLINTERVAL).toInt();
+		mumbleLinkMaxPollInterval = cfg.value("mumbleLinkMaxPollInterval", DEFAULTCONFIG_MUMBLELINKMAXPOLLINTERVAL).toInt();
+		infoRequestTtl = cfg.value("infoRequestTtl", DEFAULTCONFIG_INFOREQUESTTTL).toInt();
+		infoRequestsPerMinute = cfg.value("infoRequestsPerMinute", DEFAULTCONFIG_INFOREQUESTSPERMINUTE).toInt();
+		apiConcurrency = cfg.value("apiConcurrency", DEFAULTCONFIG_APICONCURRENCY).toInt();
+		if (apiConcurrency < 1)
+			apiConcurrency = 1;
 	}
 
-	std::string getConfigFilePath() {
+	int readMilliseconds(const QSettings& cfg, const QString& key, const QString& secondsKey, int defaultValue) {
+		if (cfg.contains(key))
+			return cfg.value(key, defaultValue).toInt();
+		if (cfg.contains(secondsKey))
+			return cfg.value(secondsKey).toInt() * 1000;
+		return defaultValue;
+	}
+
+	std::string getConfigRelativePath(const char* fileName) {
 		char* configPath = (char*)malloc(512);
 		ts3Functions.getConfigPath(configPath, 512);
 		std::string path = configPath;
 		free(configPath);
-		path.append("GW2Plugin.ini");
+		path.append(fileName);
 		return path;
 	}
+
+	std::string getConfigFilePath() {
+		return getConfigRelativePath("GW2Plugin.ini");
+	}
+
+	std::string getCacheFilePath() {
+		return getConfigRelativePath("GW2Plugin.cache");
+	}
+
+	std::string getRecordingFilePath() {
+		return getConfigRelativePath("GW2Plugin.mumblelink");
+	}
 }
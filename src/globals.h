@@ -14,15 +14,30 @@
 #include <string>
 #include "ts3_functions.h"
 
+class QSettings;
+class QString;
+
 #define PLUGIN_NAME "Guild Wars 2 Plugin"
-#define PLUGIN_VERSION "0.1-a3"
+#define PLUGIN_VERSION "0.1-a4"
 #define PLUGIN_API_VERSION 20
 #define PLUGIN_AUTHOR "Archomeda"
 #define PLUGIN_DESCRIPTION "This plugin adds some Guild Wars 2 features to the TeamSpeak 3 client."
 
-#define DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD 3
-#define DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD 15
+/* Oldest plugin versions that understand the given protocol features */
+#define PROTOCOL_MINVERSION_IDSONLY "0.1-a4"
+#define PROTOCOL_MINVERSION_PACKED "0.1-a4"
+#define PROTOCOL_MINVERSION_VELOCITY "0.1-a4"
+
+/* Transmission thresholds are in milliseconds, older configs stored them in seconds under the key without the "Ms" suffix */
+#define DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD 3000
+#define DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD 15000
 #define DEFAULTCONFIG_DISTANCETRANSMISSIONTHRESHOLD 10
+#define DEFAULTCONFIG_MUMBLELINKMINPOLLINTERVAL 20
+#define DEFAULTCONFIG_MUMBLELINKSTEADYPOLLINTERVAL 200
+#define DEFAULTCONFIG_MUMBLELINKMAXPOLLINTERVAL 2000
+#define DEFAULTCONFIG_INFOREQUESTTTL 60
+#define DEFAULTCONFIG_INFOREQUESTSPERMINUTE 30
+#define DEFAULTCONFIG_APICONCURRENCY 4
 
 
 namespace Globals {
@@ -32,8 +47,20 @@ namespace Globals {
 	extern int locationTransmissionThreshold;
 	extern int onlineStateTransmissionThreshold;
 	extern int distanceTransmissionThreshold;
+	extern int mumbleLinkMinPollInterval;
+	extern int mumbleLinkSteadyPollInterval;
+	extern int mumbleLinkMaxPollInterval;
+	extern int infoRequestTtl;
+	extern int infoRequestsPerMinute;
+	extern int apiConcurrency;
 
 	void loadConfig();
+	/* Reads a millisecond value, falling back to the older value in seconds */
+	int readMilliseconds(const QSettings& cfg, const QString& key, const QString& secondsKey, int defaultValue);
 
+	/* A file in the configuration directory of TeamSpeak */
+	std::string getConfigRelativePath(const char* fileName);
 	std::string getConfigFilePath();
+	std::string getCacheFilePath();
+	std::string getRecordingFilePath();
 }
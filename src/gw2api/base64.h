@@ -10,6 +10,8 @@
  * GNU General Public License for more details.
 */
 
+#pragma once
+
 // Slightly modified source from http://en.wikibooks.org/wiki/Algorithm_Implementation/Miscellaneous/Base64#C.2B.2B
 
 #include <string>
@@ -19,39 +21,104 @@ namespace Gw2Api {
 
 	const static char encodeLookup[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 	const static char padCharacter = '=';
-	inline std::string base64Encode(std::vector<unsigned char> inputBuffer)
+	inline size_t base64EncodedLength(size_t length)
+	{
+		return ((length / 3) + (length % 3 > 0)) * 4;
+	}
+
+	// Writes exactly base64EncodedLength(length) characters to output, without a terminator
+	inline size_t base64Encode(const unsigned char* input, size_t length, char* output)
 	{
-		std::string encodedString;
-		encodedString.reserve(((inputBuffer.size()/3) + (inputBuffer.size() % 3 > 0)) * 4);
 		long temp;
-		std::vector<unsigned char>::iterator cursor = inputBuffer.begin();
-		for(size_t idx = 0; idx < inputBuffer.size()/3; idx++)
+		const unsigned char* cursor = input;
+		char* out = output;
+		for(size_t idx = 0; idx < length/3; idx++)
 		{
 			temp  = (*cursor++) << 16; //Convert to big endian
 			temp += (*cursor++) << 8;
 			temp += (*cursor++);
-			encodedString.append(1,encodeLookup[(temp & 0x00FC0000) >> 18]);
-			encodedString.append(1,encodeLookup[(temp & 0x0003F000) >> 12]);
-			encodedString.append(1,encodeLookup[(temp & 0x00000FC0) >> 6 ]);
-			encodedString.append(1,encodeLookup[(temp & 0x0000003F)      ]);
+			*out++ = encodeLookup[(temp & 0x00FC0000) >> 18];
+			*out++ = encodeLookup[(temp & 0x0003F000) >> 12];
+			*out++ = encodeLookup[(temp & 0x00000FC0) >> 6 ];
+			*out++ = encodeLookup[(temp & 0x0000003F)      ];
 		}
-		switch(inputBuffer.size() % 3)
+		switch(length % 3)
 		{
 		case 1:
 			temp  = (*cursor++) << 16; //Convert to big endian
-			encodedString.append(1,encodeLookup[(temp & 0x00FC0000) >> 18]);
-			encodedString.append(1,encodeLookup[(temp & 0x0003F000) >> 12]);
-			encodedString.append(2,padCharacter);
+			*out++ = encodeLookup[(temp & 0x00FC0000) >> 18];
+			*out++ = encodeLookup[(temp & 0x0003F000) >> 12];
+			*out++ = padCharacter;
+			*out++ = padCharacter;
 			break;
 		case 2:
 			temp  = (*cursor++) << 16; //Convert to big endian
 			temp += (*cursor++) << 8;
-			encodedString.append(1,encodeLookup[(temp & 0x00FC0000) >> 18]);
-			encodedString.append(1,encodeLookup[(temp & 0x0003F000) >> 12]);
-			encodedString.append(1,encodeLookup[(temp & 0x00000FC0) >> 6 ]);
-			encodedString.append(1,padCharacter);
+			*out++ = encodeLookup[(temp & 0x00FC0000) >> 18];
+			*out++ = encodeLookup[(temp & 0x0003F000) >> 12];
+			*out++ = encodeLookup[(temp & 0x00000FC0) >> 6 ];
+			*out++ = padCharacter;
 			break;
 		}
+		return out - output;
+	}
+
+	// Replaces the contents of output, so it can be reused without reallocating
+	inline void base64Encode(const unsigned char* input, size_t length, std::string& output)
+	{
+		output.resize(base64EncodedLength(length));
+		if (!output.empty())
+			base64Encode(input, length, &output[0]);
+	}
+
+	inline int base64DecodeCharacter(char c)
+	{
+		if (c >= 'A' && c <= 'Z') return c - 'A';
+		if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+		if (c >= '0' && c <= '9') return c - '0' + 52;
+		if (c == '+') return 62;
+		if (c == '/') return 63;
+		return -1;
+	}
+
+	// Replaces the contents of output; returns false if the input isn't valid base64
+	inline bool base64Decode(const char* input, size_t length, std::vector<unsigned char>& output)
+	{
+		output.clear();
+		if (length % 4 != 0)
+			return false;
+		output.reserve((length / 4) * 3);
+		for (size_t idx = 0; idx < length; idx += 4)
+		{
+			int padding = 0;
+			long temp = 0;
+			for (size_t i = 0; i < 4; i++)
+			{
+				temp <<= 6;
+				if (input[idx + i] == padCharacter && idx + 4 == length && i >= 2)
+				{
+					padding++;
+					continue;
+				}
+				int value = base64DecodeCharacter(input[idx + i]);
+				if (value < 0 || padding > 0)
+					return false;
+				temp |= value;
+			}
+			output.push_back((unsigned char)((temp >> 16) & 0xFF));
+			if (padding < 2)
+				output.push_back((unsigned char)((temp >> 8) & 0xFF));
+			if (padding < 1)
+				output.push_back((unsigned char)(temp & 0xFF));
+		}
+		return true;
+	}
+
+	inline std::string base64Encode(const std::vector<unsigned char>& inputBuffer)
+	{
+		std::string encodedString;
+		if (!inputBuffer.empty())
+			base64Encode(&inputBuffer[0], inputBuffer.size(), encodedString);
 		return encodedString;
 	}
 
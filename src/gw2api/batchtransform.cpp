@@ -0,0 +1,88 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#include <Windows.h>
+#include <xmmintrin.h>
+#include "batchtransform.h"
+
+namespace Gw2Api {
+	namespace BatchTransform {
+
+		namespace {
+
+			bool detectSse() {
+#ifdef _M_X64
+				return true;
+#else
+				return IsProcessorFeaturePresent(PF_XMMI_INSTRUCTIONS_AVAILABLE) != FALSE;
+#endif
+			}
+
+			const bool sseAvailable = detectSse();
+
+			// Four points per iteration; the remainder is left to the scalar loop
+			size_t transformSse(const AffineTransform2D& transform, const float* x, const float* y, float* outX, float* outY, size_t count) {
+				__m128 scaleX = _mm_set1_ps((float)transform.scale.x);
+				__m128 scaleY = _mm_set1_ps((float)transform.scale.y);
+				__m128 offsetX = _mm_set1_ps((float)transform.offset.x);
+				__m128 offsetY = _mm_set1_ps((float)transform.offset.y);
+				size_t i = 0;
+				for (; i + 4 <= count; i += 4) {
+					__m128 vx = _mm_loadu_ps(x + i);
+					__m128 vy = _mm_loadu_ps(y + i);
+					_mm_storeu_ps(outX + i, _mm_add_ps(_mm_mul_ps(vx, scaleX), offsetX));
+					_mm_storeu_ps(outY + i, _mm_add_ps(_mm_mul_ps(vy, scaleY), offsetY));
+				}
+				return i;
+			}
+
+			size_t scaleSse(double scale, const float* values, float* outValues, size_t count) {
+				__m128 factor = _mm_set1_ps((float)scale);
+				size_t i = 0;
+				for (; i + 4 <= count; i += 4)
+					_mm_storeu_ps(outValues + i, _mm_mul_ps(_mm_loadu_ps(values + i), factor));
+				return i;
+			}
+
+		}
+
+		bool isSseAvailable() {
+			return sseAvailable;
+		}
+
+		void transform(const AffineTransform2D& transform, const float* x, const float* y, float* outX, float* outY, size_t count) {
+			size_t done = sseAvailable ? transformSse(transform, x, y, outX, outY, count) : 0;
+			transformScalar(transform, x + done, y + done, outX + done, outY + done, count - done);
+		}
+
+		void transformScalar(const AffineTransform2D& transform, const float* x, const float* y, float* outX, float* outY, size_t count) {
+			// Rounds the coefficients the same way as the SSE path
+			float scaleX = (float)transform.scale.x;
+			float scaleY = (float)transform.scale.y;
+			float offsetX = (float)transform.offset.x;
+			float offsetY = (float)transform.offset.y;
+			for (size_t i = 0; i < count; i++) {
+				outX[i] = x[i] * scaleX + offsetX;
+				outY[i] = y[i] * scaleY + offsetY;
+			}
+		}
+
+		void scale(double scale, const float* values, float* outValues, size_t count) {
+			size_t done = sseAvailable ? scaleSse(scale, values, outValues, count) : 0;
+			float factor = (float)scale;
+			for (size_t i = done; i < count; i++)
+				outValues[i] = values[i] * factor;
+		}
+
+	}
+}
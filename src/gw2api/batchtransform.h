@@ -0,0 +1,37 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <stddef.h>
+#include "math.h"
+
+namespace Gw2Api {
+
+	// Applies one AffineTransform2D to many points at once, e.g. for unit conversions of whole trails.
+	// The points are passed as separate x and y arrays, which may be the same as the output arrays to transform in place.
+	namespace BatchTransform {
+
+		// Uses SSE when the processor supports it, otherwise the same as transformScalar
+		void transform(const AffineTransform2D& transform, const float* x, const float* y, float* outX, float* outY, size_t count);
+
+		// The reference implementation
+		void transformScalar(const AffineTransform2D& transform, const float* x, const float* y, float* outX, float* outY, size_t count);
+
+		// Only the height (y) of the points needs scaling, the 2D transform covers x and z
+		void scale(double scale, const float* values, float* outValues, size_t count);
+
+		bool isSseAvailable();
+
+	}
+
+}
@@ -0,0 +1,209 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <list>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+#include <Windows.h>
+#include "cache.h"
+
+namespace Gw2Api {
+
+	namespace Cache {
+
+		namespace {
+
+			typedef std::list<Requests::RequestKey> RecentList; // Most recently used key first
+
+			struct CacheEntry {
+				CacheEntry() : revalidationTime(0) { }
+
+				ApiResponseObjectPtr object;
+				RecentList::iterator recent;
+				time_t revalidationTime; // Last time a background refresh has been started
+			};
+
+			typedef std::unordered_map<Requests::RequestKey, CacheEntry, Requests::RequestKeyHash> EntryMap;
+
+			struct State {
+				State() : memoryUsage(0), memoryBudget(defaultMemoryBudget) {
+					InitializeCriticalSection(&lock);
+					memset(&statistics, 0, sizeof(statistics));
+				}
+				~State() { DeleteCriticalSection(&lock); }
+
+				CRITICAL_SECTION lock;
+				EntryMap cacheObjects;
+				RecentList recent;
+				size_t memoryUsage;
+				size_t memoryBudget;
+				Statistics statistics;
+			};
+
+			State state;
+
+			class Lock {
+			public:
+				Lock() { EnterCriticalSection(&state.lock); }
+				~Lock() { LeaveCriticalSection(&state.lock); }
+			};
+
+
+			/* Needs the lock; marks the object for key as most recently used, returns NULL if there is none */
+			const CacheEntry* use(Requests::RequestKey key) {
+				EntryMap::iterator it = state.cacheObjects.find(key);
+				if (it == state.cacheObjects.end())
+					return NULL;
+				state.recent.splice(state.recent.begin(), state.recent, it->second.recent);
+				return &it->second;
+			}
+
+			/* Needs the lock */
+			void count(bool hit) {
+				if (hit)
+					state.statistics.hits++;
+				else
+					state.statistics.misses++;
+			}
+
+			/* Needs the lock; the removed objects are moved to released, so they can be destroyed outside of it */
+			void erase(EntryMap::iterator it, std::vector<ApiResponseObjectPtr>& released) {
+				state.memoryUsage -= it->second.object->memoryUsage;
+				state.recent.erase(it->second.recent);
+				released.push_back(it->second.object);
+				state.cacheObjects.erase(it);
+			}
+
+			/* Needs the lock; keeps at least the most recently used object, even if that one alone exceeds the budget */
+			void enforceBudget(std::vector<ApiResponseObjectPtr>& released) {
+				while (state.memoryUsage > state.memoryBudget && state.recent.size() > 1) {
+					erase(state.cacheObjects.find(state.recent.back()), released);
+					state.statistics.evictions++;
+				}
+			}
+
+		}
+
+
+		void setMemoryBudget(size_t bytes) {
+			std::vector<ApiResponseObjectPtr> released;
+			Lock lock;
+			state.memoryBudget = bytes;
+			enforceBudget(released);
+		}
+
+		Statistics getStatistics() {
+			Lock lock;
+			Statistics statistics = state.statistics;
+			statistics.objectCount = state.cacheObjects.size();
+			statistics.memoryUsage = state.memoryUsage;
+			statistics.memoryBudget = state.memoryBudget;
+			return statistics;
+		}
+
+		bool isExpired(const ApiResponseObject& object) {
+			Lock lock;
+			return difftime(time(NULL), object.requestTime) >= getTimeToLive(object.request);
+		}
+
+		bool beginRevalidation(Requests::RequestKey key) {
+			Lock lock;
+			EntryMap::iterator it = state.cacheObjects.find(key);
+			if (it == state.cacheObjects.end())
+				return false;
+			time_t now = time(NULL);
+			if (it->second.revalidationTime != 0 && difftime(now, it->second.revalidationTime) < revalidationInterval)
+				return false;
+			it->second.revalidationTime = now;
+			return true;
+		}
+
+		void removeCacheObject(Requests::RequestKey key) {
+			std::vector<ApiResponseObjectPtr> released;
+			Lock lock;
+			EntryMap::iterator it = state.cacheObjects.find(key);
+			if (it != state.cacheObjects.end())
+				erase(it, released);
+		}
+
+		void clearCache() {
+			// Release the objects outside of the lock, they can be quite big
+			EntryMap objects;
+			{
+				Lock lock;
+				objects.swap(state.cacheObjects);
+				state.recent.clear();
+				state.memoryUsage = 0;
+			}
+		}
+
+		void setCacheObject(Requests::RequestKey key, const ApiResponseObjectPtr& object) {
+			// Declared before the lock, so replaced and evicted objects are destroyed after it has been released
+			std::vector<ApiResponseObjectPtr> released;
+			Lock lock;
+			EntryMap::iterator it = state.cacheObjects.find(key);
+			if (it != state.cacheObjects.end())
+				erase(it, released);
+
+			state.recent.push_front(key);
+			CacheEntry& entry = state.cacheObjects[key];
+			entry.object = object;
+			entry.recent = state.recent.begin();
+			state.memoryUsage += object->memoryUsage;
+			enforceBudget(released);
+		}
+
+		bool getCacheObject(Requests::RequestKey key, ApiResponseObjectPtr* object) {
+			Lock lock;
+			const CacheEntry* entry = use(key);
+			count(entry != NULL);
+			if (entry == NULL)
+				return false;
+			*object = entry->object;
+			return true;
+		}
+
+		bool getNewerCachedObject(Requests::RequestKey keyA, Requests::RequestKey keyB, ApiResponseObjectPtr* object, ApiResponseObjectPtr* older) {
+			Lock lock;
+			const CacheEntry* entryA = use(keyA);
+			const CacheEntry* entryB = use(keyB);
+			count(entryA != NULL || entryB != NULL);
+			if (entryA != NULL && entryB != NULL) {
+				if (entryA->object->requestTime > entryB->object->requestTime) {
+					*object = entryA->object;
+					if (older != NULL)
+						*older = entryB->object;
+				} else {
+					*object = entryB->object;
+					if (older != NULL)
+						*older = entryA->object;
+				}
+				return true;
+			} else if (entryA != NULL) {
+				*object = entryA->object;
+				return true;
+			} else if (entryB != NULL) {
+				*object = entryB->object;
+				return true;
+			}
+			return false;
+		}
+
+		void renew(const ApiResponseObject& object, time_t requestTime) {
+			Lock lock;
+			object.requestTime = requestTime;
+		}
+
+	}
+
+}
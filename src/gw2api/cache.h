@@ -11,7 +11,9 @@
 */
 
 #pragma once
-#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
 #include "objects.h"
 #include "requests.h"
 
@@ -19,73 +21,87 @@ namespace Gw2Api {
 	
 	namespace Cache {
 
-		static std::map<std::string, ApiResponseObject*> cacheObjects;
+		struct Statistics {
+			uint64_t hits;
+			uint64_t misses;
+			uint64_t evictions;
+			size_t objectCount;
+			size_t memoryUsage; // Sum of the estimates of the cached objects
+			size_t memoryBudget;
+		};
 
-		inline void removeCacheObject(const std::string& url) {
-			std::map<std::string, ApiResponseObject*>::iterator it = cacheObjects.find(url);
-			if (it != cacheObjects.end()) {
-				delete it->second;
-				cacheObjects.erase(it);
-			}
-		}
+		// Objects that haven't been used for the longest time are dropped once the estimated memory usage exceeds this
+		const size_t defaultMemoryBudget = 64 * 1024 * 1024;
 
-		inline void clearCache() {
-			for (std::map<std::string, ApiResponseObject*>::iterator it = cacheObjects.begin(); it != cacheObjects.end(); it++) {
-				delete it->second;
+		// How long (in seconds) responses of an endpoint are used before they are revalidated with the server
+		inline double getTimeToLive(const Requests::ApiRequest& request) {
+			switch (request.getEndpoint()) {
+				case Requests::EndpointWorldNames:
+					return 3600; // Worlds are renamed and added now and then
+				case Requests::EndpointMaps:
+				case Requests::EndpointMapFloor:
+					return 7 * 24 * 3600; // Only change with game updates
+				default:
+					return 24 * 3600;
 			}
-			cacheObjects.clear();
 		}
 
-		template<class T>
-		inline void addCacheObject(T* object) {
-			T* obj = new T(*object);
-			ApiResponseObject* cacheObject = obj;
-			T* temp = static_cast<T*>(cacheObject);
-			cacheObject->isCached = true;
-			std::string url = cacheObject->request.getFullUrl();
-			cacheObjects[url] = cacheObject;
-		}
+		bool isExpired(const ApiResponseObject& object);
 
+		// Minimum time (in seconds) between two background refreshes of the same object, so failing ones aren't retried on every access
+		const double revalidationInterval = 60;
 
-		static bool getNewerCachedObject(const std::string& urlA, const std::string& urlB, ApiResponseObject** object) {
-			std::map<std::string, ApiResponseObject*>::iterator itA = cacheObjects.find(urlA);
-			std::map<std::string, ApiResponseObject*>::iterator itB = cacheObjects.find(urlB);
-			if (itA != cacheObjects.end() && itB != cacheObjects.end()) {
-				if (itA->second->requestTime > itB->second->requestTime) {
-					*object = itA->second;
-				} else {
-					*object = itB->second;
-				}
-				return true;
-			} else if (itA != cacheObjects.end()) {
-				*object = itA->second;
-				return true;
-			} else if (itB != cacheObjects.end()) {
-				*object = itB->second;
-				return true;
-			}
-			return false;
+		// Returns true if the cached object for key should be refreshed now, and remembers that it is being refreshed
+		bool beginRevalidation(Requests::RequestKey key);
+
+		// Cached objects are immutable once they are added (apart from their request time, see renew), so a cache hit only has to hand out another reference.
+		// There is one cache for the whole plugin, shared by all threads; the storage lives in cache.cpp.
+		// Objects are stored by the key of their request (see Requests::ApiRequest), lookups don't build urls.
+		void setMemoryBudget(size_t bytes);
+		Statistics getStatistics();
+
+		void removeCacheObject(Requests::RequestKey key);
+		void clearCache();
+		void setCacheObject(Requests::RequestKey key, const ApiResponseObjectPtr& object);
+		bool getCacheObject(Requests::RequestKey key, ApiResponseObjectPtr* object);
+		// If both are cached and older isn't NULL, the other one is put there
+		bool getNewerCachedObject(Requests::RequestKey keyA, Requests::RequestKey keyB, ApiResponseObjectPtr* object, ApiResponseObjectPtr* older = NULL);
+		// The server has confirmed that the response is still the same (HTTP 304), so the object is used for another time to live
+		void renew(const ApiResponseObject& object, time_t requestTime);
+
+		template<class T>
+		inline void addCacheObject(const std::shared_ptr<T>& object) {
+			object->isCached = true;
+			setCacheObject(object->request.getKey(), object);
 		}
 
 
 		template<class T>
-		inline bool getCachedObject(const Requests::ApiRequest& request, T* response) {
-			std::map<std::string, ApiResponseObject*>::iterator it = cacheObjects.find(request.getFullUrl());
-			if (it != cacheObjects.end()) {
-				*response = T(*dynamic_cast<T*>(it->second));
-				return true;
+		inline bool getCachedObject(const Requests::ApiRequest& request, std::shared_ptr<const T>* response) {
+			ApiResponseObjectPtr object;
+			if (getCacheObject(request.getKey(), &object)) {
+				*response = std::dynamic_pointer_cast<const T>(object);
+				return *response != NULL;
 			}
 			return false;
 		}
 
+		// A single map is also in the bulk maps.json response, so whichever of both is newer is used.
+		// A newer maps.json can still lack the map (e.g. a new one, or one fetched in a batch), then the single map is used instead.
 		template<>
-		inline bool getCachedObject(const Requests::ApiRequest& request, MapEntries* response) {
-			ApiResponseObject* object = NULL;
-			if (getNewerCachedObject(request.url, request.getFullUrl(), &object)) {
-				*response = MapEntries(*dynamic_cast<MapEntries*>(object));
-				return true;
+		inline bool getCachedObject(const Requests::ApiRequest& request, std::shared_ptr<const MapsRootEntry>* response) {
+			ApiResponseObjectPtr object;
+			ApiResponseObjectPtr older;
+			if (!getNewerCachedObject(request.getEndpointKey(), request.getKey(), &object, &older))
+				return false;
+			*response = std::dynamic_pointer_cast<const MapsRootEntry>(object);
+			int map_id = request.getParameter(0);
+			if (older != NULL && map_id > 0 && (*response == NULL || (*response)->maps.find(map_id) == (*response)->maps.end())) {
+				std::shared_ptr<const MapsRootEntry> fallback = std::dynamic_pointer_cast<const MapsRootEntry>(older);
+				if (fallback != NULL && fallback->maps.find(map_id) != fallback->maps.end())
+					*response = fallback;
 			}
-			return false;
+			return *response != NULL;
 		}
 
 	}
@@ -13,23 +13,75 @@
 #pragma once
 #include <string>
 #include <stdint.h>
-#include <vector>
 #include "base64.h"
 
 namespace Gw2Api {
 
 	namespace ChatLink {
 
-		inline std::string poiToChatLink(uint32_t poi_id) {
-			std::vector<unsigned char> input;
-			input.push_back(0x04); // Map link ID
-			input.push_back((unsigned char)poi_id);
-			input.push_back((unsigned char)(poi_id >> 8));
-			input.push_back((unsigned char)(poi_id >> 16));
-			input.push_back((unsigned char)(poi_id >> 24));
-			return base64Encode(input);
+		enum LinkType {
+			Item = 0x02,
+			Map = 0x04,
+			Skill = 0x06,
+			Trait = 0x07
+		};
+
+		// Largest payload of the link types above (item links), including the type byte
+		const size_t maxPayloadLength = 6;
+
+		// Base64 part of a chat link, i.e. the text between "[&" and "]"; lives on the stack, so encoding never allocates
+		struct Code {
+			char text[((maxPayloadLength + 2) / 3) * 4 + 1];
+			size_t length;
+
+			const char* c_str() const { return text; }
+		};
+
+		inline void writeId(unsigned char* payload, uint32_t id) {
+			payload[0] = (unsigned char)id;
+			payload[1] = (unsigned char)(id >> 8);
+			payload[2] = (unsigned char)(id >> 16);
+			payload[3] = (unsigned char)(id >> 24);
+		}
+
+		inline Code encode(const unsigned char* payload, size_t length) {
+			Code code;
+			code.length = base64Encode(payload, length, code.text);
+			code.text[code.length] = '\0';
+			return code;
+		}
+
+		inline Code idToChatLink(LinkType type, uint32_t id) {
+			unsigned char payload[5] = { (unsigned char)type };
+			writeId(payload + 1, id);
+			return encode(payload, sizeof(payload));
+		}
+
+		inline Code poiToChatLink(uint32_t poi_id) {
+			return idToChatLink(Map, poi_id);
+		}
+
+		inline Code skillToChatLink(uint32_t skill_id) {
+			return idToChatLink(Skill, skill_id);
+		}
+
+		inline Code traitToChatLink(uint32_t trait_id) {
+			return idToChatLink(Trait, trait_id);
+		}
+
+		inline Code itemToChatLink(uint32_t item_id, unsigned char count) {
+			unsigned char payload[6] = { (unsigned char)Item, count };
+			writeId(payload + 2, item_id);
+			return encode(payload, sizeof(payload));
+		}
+
+		inline std::string& appendChatLink(std::string& text, const Code& code) {
+			text += "[&";
+			text.append(code.text, code.length);
+			text += "]";
+			return text;
 		}
 
 	}
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,290 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <fstream>
+#include <map>
+#include <stdint.h>
+#include <string.h>
+#include <Windows.h>
+#include "diskcache.h"
+
+/*
+ * File layout (native byte order):
+ *   char[4] magic "GW2C", uint32 version
+ *   followed by records that are only ever appended, a later record of a url replaces the earlier ones:
+ *   int64 fetchTime, uint32 url length, uint32 etag length, uint32 lastModified length, uint32 body length,
+ *   followed by the url, etag, lastModified and body bytes
+ * The fetch time comes first, so a revalidation can update it in place.
+ * Replaced records stay in the file as garbage until it is compacted on close.
+ */
+
+namespace Gw2Api {
+
+	namespace DiskCache {
+
+		namespace {
+
+			const char fileMagic[4] = { 'G', 'W', '2', 'C' };
+			const uint32_t fileVersion = 2;
+			const uint64_t headerSize = sizeof(fileMagic) + sizeof(uint32_t);
+			const uint64_t recordHeaderSize = sizeof(int64_t) + 4 * sizeof(uint32_t);
+			const uint64_t minCompactionGarbage = 1024 * 1024; // Below that rewriting the file isn't worth it
+
+			struct Record {
+				Record() : fetchTime(0), recordOffset(0), bodyOffset(0), bodyLength(0) { }
+
+				std::string etag;
+				std::string lastModified;
+				time_t fetchTime;
+				uint64_t recordOffset;
+				uint64_t bodyOffset;
+				uint32_t bodyLength;
+
+				uint64_t getSize() const { return bodyOffset + bodyLength - recordOffset; }
+			};
+
+			struct State {
+				State() : fileSize(0), garbageSize(0) { InitializeCriticalSection(&lock); }
+				~State() { DeleteCriticalSection(&lock); }
+
+				CRITICAL_SECTION lock;
+				std::string path;
+				std::map<std::string, Record> records;
+				uint64_t fileSize; // Where the next record is appended
+				uint64_t garbageSize; // Bytes of replaced records
+			};
+
+			State state;
+
+			class Lock {
+			public:
+				Lock() { EnterCriticalSection(&state.lock); }
+				~Lock() { LeaveCriticalSection(&state.lock); }
+			};
+
+
+			bool readUInt32(std::istream& in, uint32_t* value) {
+				return !!in.read((char*)value, sizeof(*value));
+			}
+
+			bool readBytes(std::istream& in, uint32_t length, std::string* value) {
+				value->resize(length);
+				return length == 0 || !!in.read(&(*value)[0], length);
+			}
+
+			void writeUInt32(std::ostream& out, uint32_t value) {
+				out.write((const char*)&value, sizeof(value));
+			}
+
+			bool readBody(std::istream& in, const Record& record, std::string* body) {
+				body->resize(record.bodyLength);
+				if (record.bodyLength == 0)
+					return true;
+				in.clear();
+				in.seekg((std::streamoff)record.bodyOffset);
+				return !!in.read(&(*body)[0], record.bodyLength);
+			}
+
+			// Writes a record at the current position of out and fills in where it went
+			void writeRecord(std::ostream& out, const std::string& url, const Entry& entry, Record* record) {
+				record->recordOffset = (uint64_t)out.tellp();
+				int64_t fetchTime = (int64_t)entry.fetchTime;
+				out.write((const char*)&fetchTime, sizeof(fetchTime));
+				writeUInt32(out, (uint32_t)url.size());
+				writeUInt32(out, (uint32_t)entry.etag.size());
+				writeUInt32(out, (uint32_t)entry.lastModified.size());
+				writeUInt32(out, (uint32_t)entry.body.size());
+				out.write(url.data(), url.size());
+				out.write(entry.etag.data(), entry.etag.size());
+				out.write(entry.lastModified.data(), entry.lastModified.size());
+				record->bodyOffset = record->recordOffset + recordHeaderSize + url.size() + entry.etag.size() + entry.lastModified.size();
+				out.write(entry.body.data(), entry.body.size());
+
+				record->etag = entry.etag;
+				record->lastModified = entry.lastModified;
+				record->fetchTime = entry.fetchTime;
+				record->bodyLength = (uint32_t)entry.body.size();
+			}
+
+			// Returns false if the file has to be written anew, because it is missing, outdated or ends with a partial record
+			bool load() {
+				state.records.clear();
+				state.fileSize = 0;
+				state.garbageSize = 0;
+				std::ifstream in(state.path.c_str(), std::ios::in | std::ios::binary);
+				if (!in)
+					return false;
+
+				char magic[4];
+				uint32_t version;
+				if (!in.read(magic, sizeof(magic)) || memcmp(magic, fileMagic, sizeof(magic)) != 0 ||
+					!readUInt32(in, &version) || version != fileVersion)
+					return false;
+
+				in.seekg(0, std::ios::end);
+				uint64_t size = (uint64_t)in.tellg();
+				uint64_t end = headerSize;
+				while (end < size) {
+					// Only a record that has been cut off in the middle doesn't end exactly at the end of the file
+					int64_t fetchTime;
+					uint32_t urlLength, etagLength, lastModifiedLength;
+					std::string url;
+					Record record;
+					record.recordOffset = end;
+					in.seekg((std::streamoff)end);
+					if (!in.read((char*)&fetchTime, sizeof(fetchTime)) || !readUInt32(in, &urlLength) || !readUInt32(in, &etagLength) ||
+						!readUInt32(in, &lastModifiedLength) || !readUInt32(in, &record.bodyLength) ||
+						end + recordHeaderSize + urlLength + etagLength + lastModifiedLength + record.bodyLength > size ||
+						!readBytes(in, urlLength, &url) || !readBytes(in, etagLength, &record.etag) || !readBytes(in, lastModifiedLength, &record.lastModified))
+						return false;
+
+					record.fetchTime = (time_t)fetchTime;
+					record.bodyOffset = (uint64_t)in.tellg();
+					end = record.bodyOffset + record.bodyLength;
+					std::map<std::string, Record>::iterator it = state.records.find(url);
+					if (it != state.records.end()) {
+						state.garbageSize += it->second.getSize();
+						it->second = record;
+					} else {
+						state.records[url] = record;
+					}
+				}
+				state.fileSize = end;
+				return true;
+			}
+
+			// Writes the live records to a new file next to the old one and swaps it in, so a crash never leaves a half-written cache behind
+			void compact() {
+				std::string tempPath = state.path + ".tmp";
+				std::ifstream in(state.path.c_str(), std::ios::in | std::ios::binary);
+				std::ofstream out(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+				if (!out)
+					return;
+
+				out.write(fileMagic, sizeof(fileMagic));
+				writeUInt32(out, fileVersion);
+
+				std::map<std::string, Record> newRecords;
+				for (std::map<std::string, Record>::const_iterator it = state.records.begin(); it != state.records.end(); it++) {
+					Entry entry;
+					if (!readBody(in, it->second, &entry.body))
+						continue;
+					entry.etag = it->second.etag;
+					entry.lastModified = it->second.lastModified;
+					entry.fetchTime = it->second.fetchTime;
+					writeRecord(out, it->first, entry, &newRecords[it->first]);
+				}
+				uint64_t newFileSize = (uint64_t)out.tellp();
+
+				out.close();
+				in.close();
+				if (out.fail() || !MoveFileExA(tempPath.c_str(), state.path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+					DeleteFileA(tempPath.c_str());
+					return;
+				}
+
+				state.records.swap(newRecords);
+				state.fileSize = newFileSize;
+				state.garbageSize = 0;
+			}
+
+		}
+
+
+		void open(const std::string& path) {
+			Lock lock;
+			state.path = path;
+			if (path.empty()) {
+				state.records.clear();
+				state.fileSize = 0;
+				state.garbageSize = 0;
+			} else if (!load()) {
+				// Keeps whatever could be read, and gives the new records a clean end to be appended to
+				compact();
+			}
+		}
+
+		void close() {
+			Lock lock;
+			if (!state.path.empty() && state.garbageSize >= minCompactionGarbage && state.garbageSize * 2 >= state.fileSize)
+				compact();
+			state.path.clear();
+			state.records.clear();
+			state.fileSize = 0;
+			state.garbageSize = 0;
+		}
+
+		bool get(const std::string& url, Entry* entry, bool withBody) {
+			Lock lock;
+			std::map<std::string, Record>::const_iterator it = state.records.find(url);
+			if (it == state.records.end())
+				return false;
+
+			const Record& record = it->second;
+			if (withBody) {
+				std::ifstream in(state.path.c_str(), std::ios::in | std::ios::binary);
+				if (!in || !readBody(in, record, &entry->body))
+					return false;
+			} else {
+				entry->body.clear();
+			}
+			entry->etag = record.etag;
+			entry->lastModified = record.lastModified;
+			entry->fetchTime = record.fetchTime;
+			return true;
+		}
+
+		void put(const std::string& url, const Entry& entry) {
+			Lock lock;
+			if (state.path.empty())
+				return;
+
+			std::fstream out(state.path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+			if (!out)
+				return;
+			out.seekp((std::streamoff)state.fileSize);
+			Record record;
+			writeRecord(out, url, entry, &record);
+			out.close();
+			if (out.fail())
+				return;
+
+			std::map<std::string, Record>::iterator it = state.records.find(url);
+			if (it != state.records.end()) {
+				state.garbageSize += it->second.getSize();
+				it->second = record;
+			} else {
+				state.records[url] = record;
+			}
+			state.fileSize = record.bodyOffset + record.bodyLength;
+		}
+
+		void touch(const std::string& url, time_t fetchTime) {
+			Lock lock;
+			std::map<std::string, Record>::iterator it = state.records.find(url);
+			if (state.path.empty() || it == state.records.end())
+				return;
+
+			std::fstream out(state.path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+			if (!out)
+				return;
+			out.seekp((std::streamoff)it->second.recordOffset);
+			int64_t fileFetchTime = (int64_t)fetchTime;
+			out.write((const char*)&fileFetchTime, sizeof(fileFetchTime));
+			out.close();
+			if (!out.fail())
+				it->second.fetchTime = fetchTime;
+		}
+
+	}
+
+}
@@ -0,0 +1,45 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <string>
+#include <time.h>
+
+namespace Gw2Api {
+
+	// Persists raw API responses between sessions, so a cold start doesn't have to download anything.
+	// Only the index is kept in memory, the response bodies are read from the file on demand.
+	namespace DiskCache {
+
+		struct Entry {
+			Entry() : fetchTime(0) { }
+
+			std::string etag;
+			std::string lastModified;
+			time_t fetchTime; // Last time the server has sent or confirmed the body
+			std::string body;
+		};
+
+		// Loads the index of the given cache file; an empty path disables the disk cache
+		void open(const std::string& path);
+		void close();
+
+		// Without withBody only the headers and the fetch time are read, the body stays empty
+		bool get(const std::string& url, Entry* entry, bool withBody = true);
+		void put(const std::string& url, const Entry& entry);
+
+		// Marks an entry as confirmed by the server (HTTP 304), by overwriting only the fetch time of its record
+		void touch(const std::string& url, time_t fetchTime);
+
+	}
+
+}
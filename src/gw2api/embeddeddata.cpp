@@ -0,0 +1,51 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#include <memory>
+#include <time.h>
+#include "cache.h"
+#include "embeddeddata.h"
+#include "objects.h"
+
+namespace Gw2Api {
+
+	namespace EmbeddedData {
+
+		namespace {
+
+			void addWorldsToCache() {
+				std::shared_ptr<WorldNamesRootEntry> object(new WorldNamesRootEntry());
+				object->world_names.reserve(worldCount);
+				for (size_t i = 0; i < worldCount; i++) {
+					WorldNameEntry& entry = object->world_names.append(worlds[i].id);
+					entry.id = worlds[i].id;
+					entry.name = &namePool[worlds[i].name];
+				}
+				object->world_names.sort(); // Already sorted, but the dictionary doesn't know
+				object->request = Requests::WorldNamesRequest();
+				object->requestTime = generatedTime;
+				object->memoryUsage = sizeof(WorldNamesRootEntry) + worldCount * sizeof(WorldNameEntry);
+				Cache::addCacheObject(object);
+			}
+
+		}
+
+
+		void addToCache() {
+			if (worldCount > 0)
+				addWorldsToCache();
+		}
+
+	}
+
+}
@@ -0,0 +1,42 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <stddef.h>
+#include <time.h>
+
+namespace Gw2Api {
+
+	// World names that are compiled into the plugin, so they are there before anything has been downloaded.
+	// The table in embeddedtables.cpp is generated by tools/generate_embedded_data.py from world_names.json;
+	// names are offsets into one pool of zero-terminated strings and the records are sorted by id.
+	namespace EmbeddedData {
+
+		struct WorldRecord {
+			int id;
+			unsigned int name;
+		};
+
+		extern const char* const generatedFrom; // When and from what the table has been generated, empty if it is empty
+		extern const time_t generatedTime; // The same as a timestamp, 0 if the table is empty
+		extern const char namePool[];
+		extern const WorldRecord worlds[];
+		extern const size_t worldCount;
+
+		// Puts the table into the memory cache as if it had been downloaded when it was generated, so it's used right away
+		// and replaced by newer disk cache or API data once they are older than their time to live; call it once at startup
+		void addToCache();
+
+	}
+
+}
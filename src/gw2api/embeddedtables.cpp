@@ -0,0 +1,136 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+// Generated by tools/generate_embedded_data.py, don't edit
+
+#include "embeddeddata.h"
+
+namespace Gw2Api {
+
+	namespace EmbeddedData {
+
+		const char* const generatedFrom = "world_names.json of 2026-10-14";
+		const time_t generatedTime = 1791960816;
+
+		const char namePool[] =
+			"" "\0"
+			"Anvil Rock" "\0"
+			"Borlis Pass" "\0"
+			"Yak's Bend" "\0"
+			"Henge of Denravi" "\0"
+			"Maguuma" "\0"
+			"Sorrow's Furnace" "\0"
+			"Gate of Madness" "\0"
+			"Jade Quarry" "\0"
+			"Fort Aspenwood" "\0"
+			"Ehmry Bay" "\0"
+			"Stormbluff Isle" "\0"
+			"Darkhaven" "\0"
+			"Sanctum of Rall" "\0"
+			"Crystal Desert" "\0"
+			"Isle of Janthir" "\0"
+			"Sea of Sorrows" "\0"
+			"Tarnished Coast" "\0"
+			"Northern Shiverpeaks" "\0"
+			"Blackgate" "\0"
+			"Ferguson's Crossing" "\0"
+			"Dragonbrand" "\0"
+			"Kaineng" "\0"
+			"Devona's Rest" "\0"
+			"Eredon Terrace" "\0"
+			"Fissure of Woe" "\0"
+			"Desolation" "\0"
+			"Gandara" "\0"
+			"Blacktide" "\0"
+			"Ring of Fire" "\0"
+			"Underworld" "\0"
+			"Far Shiverpeaks" "\0"
+			"Whiteside Ridge" "\0"
+			"Ruins of Surmia" "\0"
+			"Seafarer's Rest" "\0"
+			"Vabbi" "\0"
+			"Piken Square" "\0"
+			"Aurora Glade" "\0"
+			"Gunnar's Hold" "\0"
+			"Jade Sea [FR]" "\0"
+			"Fort Ranik [FR]" "\0"
+			"Augury Rock [FR]" "\0"
+			"Vizunah Square [FR]" "\0"
+			"Arborstone [FR]" "\0"
+			"Kodash [DE]" "\0"
+			"Riverside [DE]" "\0"
+			"Elona Reach [DE]" "\0"
+			"Abaddon's Mouth [DE]" "\0"
+			"Drakkar Lake [DE]" "\0"
+			"Miller's Sound [DE]" "\0"
+			"Dzagonur [DE]" "\0"
+			"Baruch Bay [SP]" "\0"
+			;
+
+		const WorldRecord worlds[] = {
+			{ 1001, 1 },
+			{ 1002, 12 },
+			{ 1003, 24 },
+			{ 1004, 35 },
+			{ 1005, 52 },
+			{ 1006, 60 },
+			{ 1007, 77 },
+			{ 1008, 93 },
+			{ 1009, 105 },
+			{ 1010, 120 },
+			{ 1011, 130 },
+			{ 1012, 146 },
+			{ 1013, 156 },
+			{ 1014, 172 },
+			{ 1015, 187 },
+			{ 1016, 203 },
+			{ 1017, 218 },
+			{ 1018, 234 },
+			{ 1019, 255 },
+			{ 1020, 265 },
+			{ 1021, 285 },
+			{ 1022, 297 },
+			{ 1023, 305 },
+			{ 1024, 319 },
+			{ 2001, 334 },
+			{ 2002, 349 },
+			{ 2003, 360 },
+			{ 2004, 368 },
+			{ 2005, 378 },
+			{ 2006, 391 },
+			{ 2007, 402 },
+			{ 2008, 418 },
+			{ 2009, 434 },
+			{ 2010, 450 },
+			{ 2011, 466 },
+			{ 2012, 472 },
+			{ 2013, 485 },
+			{ 2014, 498 },
+			{ 2101, 512 },
+			{ 2102, 526 },
+			{ 2103, 542 },
+			{ 2104, 559 },
+			{ 2105, 579 },
+			{ 2201, 595 },
+			{ 2202, 607 },
+			{ 2203, 622 },
+			{ 2204, 639 },
+			{ 2205, 660 },
+			{ 2206, 678 },
+			{ 2207, 698 },
+			{ 2301, 712 },
+		};
+		const size_t worldCount = 51;
+
+	}
+
+}
@@ -0,0 +1,328 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <Windows.h>
+#include "gw2api.h"
+#include "jsonarena.h"
+
+namespace Gw2Api {
+
+	namespace Async {
+
+		namespace {
+
+			struct Job {
+				std::function<bool ()> fetch;
+				std::vector<Callback> callbacks;
+			};
+
+			// Maps that have been asked for with fetchMap, but haven't been taken by a batch yet
+			typedef std::vector<std::pair<int, Callback>> PendingMaps;
+
+			struct State {
+				State() : running(0), maxConcurrency(0), stopping(false), firstPendingMapTime(0), mapBatchQueued(false), batchCount(0), hTimerQueue(NULL), hBatchTimer(NULL) {
+					InitializeCriticalSection(&lock);
+					InitializeConditionVariable(&queueChanged);
+				}
+				~State() { DeleteCriticalSection(&lock); }
+
+				CRITICAL_SECTION lock;
+				CONDITION_VARIABLE queueChanged;
+				std::deque<std::string> queue;
+				std::map<std::string, Job> jobs; // Queued and running jobs by url
+				std::vector<HANDLE> workers;
+				int running; // Jobs that are being fetched right now
+				int maxConcurrency;
+				bool stopping;
+				PendingMaps pendingMaps;
+				ULONGLONG firstPendingMapTime;
+				bool mapBatchQueued; // A batch is waiting for its timer or has been queued as a job
+				unsigned int batchCount; // Gives every batch job a key of its own, a running one doesn't take new maps anymore
+				HANDLE hTimerQueue;
+				HANDLE hBatchTimer; // Queues the batch job once the batch window is over, so no worker waits for it
+			};
+
+			// How long (in ms) the first map of a batch waits for others, e.g. when several clients report their maps at about the same time
+			const DWORD batchWindow = 50;
+
+			State state;
+
+			class Lock {
+			public:
+				Lock() { EnterCriticalSection(&state.lock); }
+				~Lock() { LeaveCriticalSection(&state.lock); }
+			};
+
+
+			DWORD WINAPI workerLoop(LPVOID lpParam) {
+				while (true) {
+					std::string url;
+					std::function<bool ()> fetch;
+					{
+						Lock lock;
+						while (!state.stopping && (state.queue.empty() || state.running >= state.maxConcurrency))
+							SleepConditionVariableCS(&state.queueChanged, &state.lock, INFINITE);
+						if (state.stopping)
+							break;
+
+						url = state.queue.front();
+						state.queue.pop_front();
+						fetch = state.jobs[url].fetch;
+						state.running++;
+					}
+
+					bool success = false;
+					try {
+						success = fetch();
+					} catch (...) {
+						success = false;
+					}
+
+					std::vector<Callback> callbacks;
+					{
+						Lock lock;
+						std::map<std::string, Job>::iterator it = state.jobs.find(url);
+						if (it != state.jobs.end()) {
+							callbacks.swap(it->second.callbacks);
+							state.jobs.erase(it);
+						}
+						state.running--;
+						// Another worker may have been waiting for a free slot
+						if (!state.queue.empty())
+							WakeConditionVariable(&state.queueChanged);
+					}
+					for (size_t i = 0; i < callbacks.size(); i++) {
+						if (callbacks[i])
+							callbacks[i](success);
+					}
+				}
+				JsonArena::releaseThread();
+				return 0;
+			}
+
+			// Needs the lock
+			void addWorkers(int workerCount) {
+				for (int i = (int)state.workers.size(); i < workerCount; i++) {
+					HANDLE hWorker = CreateThread(NULL, 0, workerLoop, NULL, 0, NULL);
+					if (hWorker != NULL)
+						state.workers.push_back(hWorker);
+				}
+			}
+
+		}
+
+
+		void start(int workerCount) {
+			Lock lock;
+			state.stopping = false;
+			state.maxConcurrency = workerCount;
+			addWorkers(workerCount);
+			if (state.hTimerQueue == NULL)
+				state.hTimerQueue = CreateTimerQueue();
+		}
+
+		void setMaxConcurrency(int maxConcurrency) {
+			Lock lock;
+			state.maxConcurrency = maxConcurrency;
+			// Workers are only ever added; the surplus ones just wait once the limit has been lowered
+			if (!state.stopping && !state.workers.empty())
+				addWorkers(maxConcurrency);
+			WakeAllConditionVariable(&state.queueChanged);
+		}
+
+		void stop() {
+			std::vector<HANDLE> workers;
+			HANDLE hTimerQueue;
+			{
+				Lock lock;
+				state.stopping = true;
+				state.queue.clear();
+				workers.swap(state.workers);
+				hTimerQueue = state.hTimerQueue;
+				state.hTimerQueue = NULL;
+				state.hBatchTimer = NULL;
+				WakeAllConditionVariable(&state.queueChanged);
+			}
+
+			// Waits for a running timer callback (it takes the lock) and deletes the pending one
+			if (hTimerQueue != NULL)
+				DeleteTimerQueueEx(hTimerQueue, INVALID_HANDLE_VALUE);
+
+			if (!workers.empty())
+				WaitForMultipleObjects((DWORD)workers.size(), &workers[0], TRUE, INFINITE);
+			for (size_t i = 0; i < workers.size(); i++)
+				CloseHandle(workers[i]);
+
+			Lock lock;
+			state.jobs.clear();
+			state.pendingMaps.clear();
+			state.mapBatchQueued = false;
+		}
+
+		bool enqueue(const std::string& key, const std::function<bool ()>& fetch, const Callback& callback) {
+			Lock lock;
+			if (state.stopping || state.workers.empty())
+				return false;
+
+			std::map<std::string, Job>::iterator it = state.jobs.find(key);
+			if (it != state.jobs.end()) {
+				// Already queued or running, piggyback on that one
+				it->second.callbacks.push_back(callback);
+				return true;
+			}
+
+			Job& job = state.jobs[key];
+			job.fetch = fetch;
+			job.callbacks.push_back(callback);
+			state.queue.push_back(key);
+			WakeConditionVariable(&state.queueChanged);
+			return true;
+		}
+
+
+		namespace {
+
+			// Fetches the maps with a single request and caches each one as if it had been requested on its own; adds the ones it found to found
+			void fetchMapBatch(const std::vector<int>& ids, std::set<int>& found) {
+				Requests::BatchRequest request(Requests::EndpointMaps, ids);
+				Http::Response response;
+				long unsigned lastError = 0;
+				time_t now = time(NULL);
+				// Unknown ids are left out of the response; if none are known, it's an error (404) without any maps
+				if (!Http::get(request.getFullUrl(), std::string(), &response, &lastError) || (response.statusCode != 200 && response.statusCode != 206))
+					return;
+
+				MapsRootEntry batch;
+				bool parsed;
+				{
+					Metrics::ScopedTimer timer(Metrics::Parse);
+					parsed = Parsers::MapsV2Parser().parse(response.body, &batch);
+				}
+				if (!parsed) {
+					Metrics::add(Metrics::ParseFailures);
+					return;
+				}
+
+				for (MapEntries::const_iterator it = batch.maps.begin(); it != batch.maps.end(); it++) {
+					std::shared_ptr<MapsRootEntry> object(new MapsRootEntry());
+					object->maps.append(it->first) = it->second;
+					object->request = Requests::MapsRequest(it->first);
+					object->requestTime = now;
+					object->memoryUsage = sizeof(MapsRootEntry) + response.body.size() / batch.maps.size();
+					Cache::addCacheObject(object);
+					found.insert(it->first);
+				}
+			}
+
+			bool runMapBatch();
+
+			// Needs the lock
+			void enqueueMapBatch() {
+				if (!enqueue("batch:" + Requests::url_v2_maps + "#" + std::to_string((long long)++state.batchCount), runMapBatch, Callback()))
+					state.mapBatchQueued = false;
+			}
+
+			VOID CALLBACK batchWindowOver(PVOID lpParameter, BOOLEAN timerOrWaitFired) {
+				Lock lock;
+				HANDLE hBatchTimer = state.hBatchTimer;
+				state.hBatchTimer = NULL;
+				if (hBatchTimer != NULL && state.hTimerQueue != NULL)
+					DeleteTimerQueueTimer(state.hTimerQueue, hBatchTimer, NULL); // Doesn't wait, so it's safe from within the callback
+				if (!state.stopping)
+					enqueueMapBatch();
+			}
+
+			// Needs the lock
+			void queueMapBatch() {
+				if (state.mapBatchQueued || state.pendingMaps.empty())
+					return;
+				state.mapBatchQueued = true;
+
+				ULONGLONG dueTime = state.firstPendingMapTime + batchWindow;
+				ULONGLONG now = GetTickCount64();
+				if (now < dueTime && state.hTimerQueue != NULL) {
+					if (CreateTimerQueueTimer(&state.hBatchTimer, state.hTimerQueue, batchWindowOver, NULL, (DWORD)(dueTime - now), 0, WT_EXECUTEONLYONCE))
+						return;
+					state.hBatchTimer = NULL;
+				}
+				enqueueMapBatch();
+			}
+
+			bool runMapBatch() {
+				// Takes the first maxBatchSize distinct maps, the rest are left for the next batch
+				PendingMaps batch;
+				std::vector<int> ids;
+				{
+					Lock lock;
+					PendingMaps remaining;
+					std::set<int> taken;
+					for (size_t i = 0; i < state.pendingMaps.size(); i++) {
+						int map_id = state.pendingMaps[i].first;
+						if (taken.count(map_id) > 0 || taken.size() < Requests::maxBatchSize) {
+							taken.insert(map_id);
+							batch.push_back(state.pendingMaps[i]);
+						} else {
+							remaining.push_back(state.pendingMaps[i]);
+						}
+					}
+					state.pendingMaps.swap(remaining);
+					state.mapBatchQueued = false;
+					state.firstPendingMapTime = GetTickCount64();
+					queueMapBatch();
+					ids.assign(taken.begin(), taken.end());
+				}
+
+				// The bulk maps.json knows nearly every map, only the others (e.g. new ones) need the batch request
+				std::set<int> found;
+				std::vector<int> missing;
+				MapsRootEntryPtr mapsRootEntry;
+				bool hasMaps = getMaps(&mapsRootEntry);
+				for (size_t i = 0; i < ids.size(); i++) {
+					ApiInnerResponseObject<MapsRootEntry, MapEntry> mapEntry;
+					if ((hasMaps && mapsRootEntry->maps.find(ids[i]) != mapsRootEntry->maps.end()) || getCachedMap(ids[i], &mapEntry))
+						found.insert(ids[i]);
+					else
+						missing.push_back(ids[i]);
+				}
+				if (!missing.empty())
+					fetchMapBatch(missing, found);
+
+				for (size_t i = 0; i < batch.size(); i++) {
+					if (batch[i].second)
+						batch[i].second(found.count(batch[i].first) > 0);
+				}
+				return true;
+			}
+
+		}
+
+
+		bool fetchMap(const int map_id, const Callback& callback) {
+			Lock lock;
+			if (state.stopping || state.workers.empty())
+				return false;
+
+			if (state.pendingMaps.empty())
+				state.firstPendingMapTime = GetTickCount64();
+			state.pendingMaps.push_back(std::make_pair(map_id, callback));
+			queueMapBatch();
+			return true;
+		}
+
+	}
+
+}
@@ -11,69 +11,144 @@
 */
 
 #pragma once
+#include <functional>
 #include <string>
-#include <Windows.h>
-#include <WinInet.h>
 #include "cache.h"
+#include "diskcache.h"
+#include "http.h"
+#include "metrics.h"
 #include "parsers.h"
 #include "requests.h"
 
 
 namespace Gw2Api {
 
+	// Runs the blocking getters on a small pool of worker threads (see gw2api.cpp).
+	// Requests for the same key (usually the url) that are queued or running at the same time are fetched only once.
+	// When a fetch has finished, every callback is called on the worker thread with whether it succeeded;
+	// the result itself is picked up from the cache afterwards with the non-blocking getters.
+	namespace Async {
+
+		typedef std::function<void (bool success)> Callback;
+
+		// The worker count is also the number of requests that run at the same time
+		void start(int workerCount);
+
+		// Changes the number of requests that run at the same time, adding workers if needed
+		void setMaxConcurrency(int maxConcurrency);
+
+		// Drops the queued requests and waits for the running ones to finish
+		void stop();
+
+		bool enqueue(const std::string& key, const std::function<bool ()>& fetch, const Callback& callback);
+
+	}
+
+
 	static bool getFromHttpUrl(const std::string& url, std::string* result, long unsigned* lastError) {
-		HINTERNET hSession = InternetOpenA("Guild Wars 2 C++ API Wrapper", 0, NULL, NULL, 0);
-		if (hSession == NULL) {
-			*lastError = GetLastError();
+		Http::Response response;
+		if (!Http::get(url, std::string(), &response, lastError))
 			return false;
-		}
+		*result += response.body;
+		return true;
+	}
 
-		HINTERNET hOpenUrl = InternetOpenUrlA(hSession, url.c_str(), NULL, 0, 1, 1);
-		if (hOpenUrl == NULL) {
-			*lastError = GetLastError();
-			InternetCloseHandle(hOpenUrl);
+	template<class T>
+	static bool parseResponse(const Requests::ApiRequest& request, const Parsers::ApiResponseParser<T>& parser, const std::string& body, time_t requestTime, std::shared_ptr<const T>* response) {
+		std::shared_ptr<T> object(new T());
+		bool parsed;
+		{
+			Metrics::ScopedTimer timer(Metrics::Parse);
+			parsed = parser.parse(body, object.get());
+		}
+		if (!parsed) {
+			Metrics::add(Metrics::ParseFailures);
 			return false;
 		}
+		object->request = request;
+		object->requestTime = requestTime;
+		object->memoryUsage = sizeof(T) + body.size();
+		Cache::addCacheObject(object);
+		*response = object;
+		return true;
+	}
 
-		char* buffer = new char[1025];
-		DWORD bytesRead = 0;
-		while (true) {
-			if (InternetReadFile(hOpenUrl, buffer, 1024, &bytesRead)) {
-				if (bytesRead == 0)
-					break;
-				buffer[bytesRead] = 0;
-				*result += buffer;
-			} else {
-				*lastError = GetLastError();
-				delete[] buffer;
-				InternetCloseHandle(hOpenUrl);
-				InternetCloseHandle(hSession);
-				return false;
-			}
-		}
-		delete[] buffer;
+	template<class T, class P>
+	static bool handleRequest(const Requests::ApiRequest& request, const P& parser, bool ignoreCache, std::shared_ptr<const T>* response);
+
+	// Looks in the memory cache only. Expired objects are still handed out (stale-while-revalidate),
+	// but they are refreshed in the background, at most once per Cache::revalidationInterval.
+	template<class T, class P>
+	static bool getCachedObject(const Requests::ApiRequest& request, std::shared_ptr<const T>* response) {
+		if (!Cache::getCachedObject(request, response))
+			return false;
 
-		InternetCloseHandle(hOpenUrl);
-		InternetCloseHandle(hSession);
+		// Use the request of the object itself, the cache may have given us a response for a more general request
+		Requests::ApiRequest objectRequest = (*response)->request;
+		if (Cache::isExpired(**response) && Cache::beginRevalidation(objectRequest.getKey())) {
+			Async::enqueue("revalidate:" + objectRequest.getFullUrl(), [=]() -> bool {
+				std::shared_ptr<const T> refreshed;
+				return handleRequest(objectRequest, P(), true, &refreshed);
+			}, Async::Callback());
+		}
 		return true;
 	}
 
-	template<class T>
-	static bool handleRequest(const Requests::ApiRequest& request, const Parsers::ApiResponseParser<T>& parser, bool ignoreCache, T* response) {
-		if (ignoreCache || !Cache::getCachedObject(request, response)) {
-			std::string result;
-			std::string url = request.getFullUrl();
-			if (getFromHttpUrl(url, &result, NULL)) {
-				if (parser.parse(result, response)) {
-					response->request = request;
-					response->requestTime = time(NULL);
-					Cache::addCacheObject(response);
+	// Looks in the memory cache first, then in the disk cache and finally asks the server.
+	// Disk cache entries older than the time to live of their endpoint are revalidated with a conditional request,
+	// and used as-is if the server can't be reached.
+	template<class T, class P>
+	static bool handleRequest(const Requests::ApiRequest& request, const P& parser, bool ignoreCache, std::shared_ptr<const T>* response) {
+		if (!ignoreCache && getCachedObject<T, P>(request, response))
+			return true;
+
+		// The body is only read once it's known to be needed, a revalidation usually gets by with the object in memory
+		std::string url = request.getFullUrl();
+		DiskCache::Entry diskEntry;
+		bool isOnDisk = DiskCache::get(url, &diskEntry, false);
+		if (isOnDisk && !ignoreCache && difftime(time(NULL), diskEntry.fetchTime) < Cache::getTimeToLive(request)) {
+			if (DiskCache::get(url, &diskEntry) && parseResponse(request, parser, diskEntry.body, diskEntry.fetchTime, response))
+				return true;
+			isOnDisk = false;
+		}
+
+		std::string headers;
+		if (isOnDisk && !diskEntry.etag.empty())
+			headers += "If-None-Match: " + diskEntry.etag + "\r\n";
+		if (isOnDisk && !diskEntry.lastModified.empty())
+			headers += "If-Modified-Since: " + diskEntry.lastModified + "\r\n";
+
+		Http::Response httpResponse;
+		long unsigned lastError = 0;
+		time_t now = time(NULL);
+		if (Http::get(url, headers, &httpResponse, &lastError)) {
+			if (httpResponse.statusCode == 304 && isOnDisk) {
+				DiskCache::touch(url, now);
+				// The cache may hand out a response of a more general request, that one hasn't been confirmed
+				std::shared_ptr<const T> cached;
+				if (Cache::getCachedObject(request, &cached) && cached->request.getKey() == request.getKey()) {
+					Cache::renew(*cached, now);
+					*response = cached;
 					return true;
 				}
+				return DiskCache::get(url, &diskEntry) && parseResponse(request, parser, diskEntry.body, now, response);
+			}
+			if (parseResponse(request, parser, httpResponse.body, now, response)) {
+				if (httpResponse.statusCode == 200) {
+					DiskCache::Entry newEntry;
+					newEntry.etag = httpResponse.etag;
+					newEntry.lastModified = httpResponse.lastModified;
+					newEntry.fetchTime = now;
+					newEntry.body.swap(httpResponse.body);
+					DiskCache::put(url, newEntry);
+				}
+				return true;
 			}
-			return false;
 		}
-		return true;
+
+		if (isOnDisk && DiskCache::get(url, &diskEntry))
+			return parseResponse(request, parser, diskEntry.body, diskEntry.fetchTime, response);
+		return false;
 	}
 
 
@@ -82,37 +157,105 @@ namespace Gw2Api {
 	}
 
 
-	inline bool getMapFloor(const int continent_id, const int floor, MapFloorRootEntry* mapFloorGlobalEntry) { 
+	inline bool getMapFloor(const int continent_id, const int floor, MapFloorRootEntryPtr* mapFloorRootEntry) { 
 		Requests::MapFloorRequest request = Requests::MapFloorRequest(continent_id, floor);
 		Parsers::MapFloorRootParser parser;
-		return handleRequest(request, parser, false, mapFloorGlobalEntry);
+		return handleRequest(request, parser, false, mapFloorRootEntry);
 	}
 
+	inline bool getMaps(MapsRootEntryPtr* mapsRootEntry);
+
+	// Uses the bulk maps.json, so every map after the first one comes from the cache;
+	// only maps the bulk response doesn't know about (yet) are requested on their own
 	inline bool getMap(const int map_id, ApiInnerResponseObject<MapsRootEntry, MapEntry>* mapEntry) {
+		MapsRootEntryPtr mapsRootEntry;
+		if (getMaps(&mapsRootEntry)) {
+			MapEntries::const_iterator it = mapsRootEntry->maps.find(map_id);
+			if (it != mapsRootEntry->maps.end()) {
+				*mapEntry = ApiInnerResponseObject<MapsRootEntry, MapEntry>(mapsRootEntry, &it->second);
+				return true;
+			}
+		}
+
 		Requests::MapsRequest request = Requests::MapsRequest(map_id);
 		Parsers::MapsRootParser parser;
-		if (handleRequest(request, parser, false, &mapEntry->root)) {
-			MapEntries::iterator it = mapEntry->root.maps.find(map_id);
-			if (it != mapEntry->root.maps.end()) {
-				mapEntry->value = it->second;
+		if (handleRequest(request, parser, false, &mapsRootEntry)) {
+			MapEntries::const_iterator it = mapsRootEntry->maps.find(map_id);
+			if (it != mapsRootEntry->maps.end()) {
+				*mapEntry = ApiInnerResponseObject<MapsRootEntry, MapEntry>(mapsRootEntry, &it->second);
 				return true;
-			} else {
-				return false;
 			}
 		}
 		return false;
 	}
 
-	inline bool getMaps(MapsRootEntry* mapsRootEntry) {
+	inline bool getMaps(MapsRootEntryPtr* mapsRootEntry) {
 		Requests::MapsRequest request;
 		Parsers::MapsRootParser parser;
 		return handleRequest(request, parser, false, mapsRootEntry);
 	}
 
-	inline bool getWorldNames(WorldNamesRootEntry* worldNamesRootEntry) {
+	inline bool getWorldNames(WorldNamesRootEntryPtr* worldNamesRootEntry) {
 		Requests::WorldNamesRequest request;
 		Parsers::WorldNamesRootParser parser;
 		return handleRequest(request, parser, false, worldNamesRootEntry);
 	}
 
+
+	// Non-blocking variants of the getters above: these only look in the memory cache
+
+	inline bool getCachedMapFloor(const int continent_id, const int floor, MapFloorRootEntryPtr* mapFloorRootEntry) {
+		return getCachedObject<MapFloorRootEntry, Parsers::MapFloorRootParser>(Requests::MapFloorRequest(continent_id, floor), mapFloorRootEntry);
+	}
+
+	inline bool getCachedMap(const int map_id, ApiInnerResponseObject<MapsRootEntry, MapEntry>* mapEntry) {
+		MapsRootEntryPtr mapsRootEntry;
+		if (getCachedObject<MapsRootEntry, Parsers::MapsRootParser>(Requests::MapsRequest(map_id), &mapsRootEntry)) {
+			MapEntries::const_iterator it = mapsRootEntry->maps.find(map_id);
+			if (it != mapsRootEntry->maps.end()) {
+				*mapEntry = ApiInnerResponseObject<MapsRootEntry, MapEntry>(mapsRootEntry, &it->second);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline bool getCachedMaps(MapsRootEntryPtr* mapsRootEntry) {
+		return getCachedObject<MapsRootEntry, Parsers::MapsRootParser>(Requests::MapsRequest(), mapsRootEntry);
+	}
+
+	inline bool getCachedWorldNames(WorldNamesRootEntryPtr* worldNamesRootEntry) {
+		return getCachedObject<WorldNamesRootEntry, Parsers::WorldNamesRootParser>(Requests::WorldNamesRequest(), worldNamesRootEntry);
+	}
+
+
+	namespace Async {
+
+		inline bool fetchMapFloor(const int continent_id, const int floor, const Callback& callback) {
+			return enqueue(Requests::MapFloorRequest(continent_id, floor).getFullUrl(), [=]() -> bool {
+				MapFloorRootEntryPtr mapFloorRootEntry;
+				return getMapFloor(continent_id, floor, &mapFloorRootEntry);
+			}, callback);
+		}
+
+		// Maps are fetched in batches (see gw2api.cpp): the ones asked for within batchWindow ms are looked up in the bulk maps.json,
+		// and those it doesn't know are fetched with one BatchRequest. The callback gets whether this map has been found.
+		bool fetchMap(const int map_id, const Callback& callback);
+
+		inline bool fetchMaps(const Callback& callback) {
+			return enqueue(Requests::MapsRequest().getFullUrl(), []() -> bool {
+				MapsRootEntryPtr mapsRootEntry;
+				return getMaps(&mapsRootEntry);
+			}, callback);
+		}
+
+		inline bool fetchWorldNames(const Callback& callback) {
+			return enqueue(Requests::WorldNamesRequest().getFullUrl(), []() -> bool {
+				WorldNamesRootEntryPtr worldNamesRootEntry;
+				return getWorldNames(&worldNamesRootEntry);
+			}, callback);
+		}
+
+	}
+
 }
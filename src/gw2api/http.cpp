@@ -0,0 +1,186 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <map>
+#include <string.h>
+#include <Windows.h>
+#include <WinInet.h>
+#include "http.h"
+#include "metrics.h"
+
+namespace Gw2Api {
+
+	namespace Http {
+
+		namespace {
+
+			const DWORD readChunkSize = 64 * 1024;
+
+			struct State {
+				State() : hSession(NULL), isDecodingSupported(false) { InitializeCriticalSection(&lock); }
+				~State() { DeleteCriticalSection(&lock); }
+
+				CRITICAL_SECTION lock;
+				HINTERNET hSession;
+				bool isDecodingSupported;
+				std::map<std::string, HINTERNET> connections; // By scheme, host and port
+			};
+
+			State state;
+
+			class Lock {
+			public:
+				Lock() { EnterCriticalSection(&state.lock); }
+				~Lock() { LeaveCriticalSection(&state.lock); }
+			};
+
+
+			HINTERNET getConnection(const std::string& host, INTERNET_PORT port, bool isSecure, DWORD* lastError) {
+				Lock lock;
+				if (state.hSession == NULL) {
+					state.hSession = InternetOpenA("TS3-GW2-plugin", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+					if (state.hSession == NULL) {
+						*lastError = GetLastError();
+						return NULL;
+					}
+					// Available since Internet Explorer 8
+					BOOL decoding = TRUE;
+					state.isDecodingSupported = InternetSetOptionA(state.hSession, INTERNET_OPTION_HTTP_DECODING, &decoding, sizeof(decoding)) == TRUE;
+				}
+
+				std::string key = (isSecure ? "https://" : "http://") + host + ":" + std::to_string((long long)port);
+				std::map<std::string, HINTERNET>::iterator it = state.connections.find(key);
+				if (it != state.connections.end())
+					return it->second;
+
+				HINTERNET hConnect = InternetConnectA(state.hSession, host.c_str(), port, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
+				if (hConnect == NULL) {
+					*lastError = GetLastError();
+					return NULL;
+				}
+				state.connections[key] = hConnect;
+				return hConnect;
+			}
+
+			std::string queryHeader(HINTERNET hRequest, DWORD header) {
+				char buffer[256];
+				DWORD bufferLength = sizeof(buffer);
+				if (HttpQueryInfoA(hRequest, header, buffer, &bufferLength, NULL))
+					return std::string(buffer, bufferLength);
+				return std::string();
+			}
+
+		}
+
+
+		static bool fetch(const std::string& url, const std::string& headers, Response* response, DWORD* lastError) {
+			char host[256];
+			char path[2048];
+			URL_COMPONENTSA urlComponents;
+			memset(&urlComponents, 0, sizeof(urlComponents));
+			urlComponents.dwStructSize = sizeof(urlComponents);
+			urlComponents.lpszHostName = host;
+			urlComponents.dwHostNameLength = sizeof(host);
+			urlComponents.lpszUrlPath = path;
+			urlComponents.dwUrlPathLength = sizeof(path); // Includes the query string as well, since lpszExtraInfo isn't requested
+			if (!InternetCrackUrlA(url.c_str(), (DWORD)url.size(), 0, &urlComponents)) {
+				*lastError = GetLastError();
+				return false;
+			}
+			bool isSecure = urlComponents.nScheme == INTERNET_SCHEME_HTTPS;
+
+			HINTERNET hConnect = getConnection(host, urlComponents.nPort, isSecure, lastError);
+			if (hConnect == NULL)
+				return false;
+
+			DWORD flags = INTERNET_FLAG_KEEP_CONNECTION | INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE;
+			if (isSecure)
+				flags |= INTERNET_FLAG_SECURE;
+			HINTERNET hRequest = HttpOpenRequestA(hConnect, "GET", path, NULL, NULL, NULL, flags, 0);
+			if (hRequest == NULL) {
+				*lastError = GetLastError();
+				return false;
+			}
+
+			std::string requestHeaders = headers;
+			if (state.isDecodingSupported)
+				requestHeaders += "Accept-Encoding: gzip, deflate\r\n";
+			if (!HttpSendRequestA(hRequest, requestHeaders.empty() ? NULL : requestHeaders.c_str(), (DWORD)requestHeaders.size(), NULL, 0)) {
+				*lastError = GetLastError();
+				InternetCloseHandle(hRequest);
+				return false;
+			}
+
+			DWORD numberLength = sizeof(response->statusCode);
+			if (!HttpQueryInfoA(hRequest, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &response->statusCode, &numberLength, NULL))
+				response->statusCode = 0;
+			response->etag = queryHeader(hRequest, HTTP_QUERY_ETAG);
+			response->lastModified = queryHeader(hRequest, HTTP_QUERY_LAST_MODIFIED);
+
+			// With compression this is the compressed size, so it's only a lower bound for the decoded body
+			DWORD contentLength = 0;
+			numberLength = sizeof(contentLength);
+			if (HttpQueryInfoA(hRequest, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER, &contentLength, &numberLength, NULL))
+				response->body.reserve(contentLength);
+
+			size_t size = response->body.size();
+			while (true) {
+				if (response->body.size() < size + readChunkSize)
+					response->body.resize(size + readChunkSize);
+
+				DWORD bytesRead = 0;
+				if (!InternetReadFile(hRequest, &response->body[size], readChunkSize, &bytesRead)) {
+					*lastError = GetLastError();
+					response->body.resize(size);
+					InternetCloseHandle(hRequest);
+					return false;
+				}
+				if (bytesRead == 0)
+					break;
+				size += bytesRead;
+			}
+			response->body.resize(size);
+
+			InternetCloseHandle(hRequest);
+			return true;
+		}
+
+		bool get(const std::string& url, const std::string& headers, Response* response, DWORD* lastError) {
+			DWORD ignoredError;
+			if (lastError == NULL)
+				lastError = &ignoredError;
+
+			Metrics::ScopedTimer timer(Metrics::HttpFetch);
+			size_t bodySize = response->body.size();
+			bool success = fetch(url, headers, response, lastError);
+			Metrics::add(Metrics::HttpRequests);
+			if (success)
+				Metrics::add(Metrics::HttpBytesReceived, response->body.size() - bodySize);
+			else
+				Metrics::add(Metrics::HttpFailures);
+			return success;
+		}
+
+		void close() {
+			Lock lock;
+			for (std::map<std::string, HINTERNET>::iterator it = state.connections.begin(); it != state.connections.end(); it++)
+				InternetCloseHandle(it->second);
+			state.connections.clear();
+			if (state.hSession != NULL) {
+				InternetCloseHandle(state.hSession);
+				state.hSession = NULL;
+			}
+		}
+
+	}
+
+}
@@ -0,0 +1,42 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <string>
+#include <Windows.h>
+
+namespace Gw2Api {
+
+	// Shared HTTP client: one WinINet session for the whole plugin with a kept-alive connection per host,
+	// so consecutive requests to the same server skip the TCP and TLS handshakes.
+	// Responses are requested gzip-compressed and decoded by WinINet where it supports that.
+	namespace Http {
+
+		struct Response {
+			Response() : statusCode(0) { }
+
+			DWORD statusCode;
+			std::string etag;
+			std::string lastModified;
+			std::string body;
+		};
+
+		// Sends a GET request with extra request headers (each terminated by \r\n), e.g. for conditional requests.
+		// WinINet's own cache is bypassed, because it would answer our conditional requests itself.
+		bool get(const std::string& url, const std::string& headers, Response* response, DWORD* lastError);
+
+		// Closes the session and all pooled connections; the next request opens a new session
+		void close();
+
+	}
+
+}
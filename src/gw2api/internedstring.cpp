@@ -0,0 +1,69 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <unordered_set>
+#include <Windows.h>
+#include "internedstring.h"
+
+namespace Gw2Api {
+
+	namespace {
+
+		struct State {
+			State() : memoryUsage(0) {
+				InitializeCriticalSection(&lock);
+			}
+
+			~State() {
+				DeleteCriticalSection(&lock);
+			}
+
+			CRITICAL_SECTION lock;
+			std::unordered_set<std::string> pool; // Nodes never move, so pointers to the strings stay valid
+			const std::string empty;
+			size_t memoryUsage;
+		};
+
+		State state;
+
+		class Lock {
+		public:
+			Lock() { EnterCriticalSection(&state.lock); }
+			~Lock() { LeaveCriticalSection(&state.lock); }
+		};
+
+	}
+
+
+	const std::string& InternedString::emptyString() {
+		return state.empty;
+	}
+
+	const std::string& InternedString::intern(const char* str, size_t length) {
+		if (length == 0)
+			return emptyString();
+
+		Lock lock;
+		std::pair<std::unordered_set<std::string>::iterator, bool> result = state.pool.insert(std::string(str, length));
+		if (result.second)
+			state.memoryUsage += sizeof(std::string) + length + 1;
+		return *result.first;
+	}
+
+	size_t InternedString::getPoolSize(size_t* memoryUsage) {
+		Lock lock;
+		if (memoryUsage != NULL)
+			*memoryUsage = state.memoryUsage;
+		return state.pool.size();
+	}
+
+}
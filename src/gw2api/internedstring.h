@@ -0,0 +1,52 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <string.h>
+#include <string>
+
+namespace Gw2Api {
+
+	// A string that is stored once in a process wide pool, so the thousands of parsed entries that share
+	// a name (or are copied out of a response) don't each own a copy. The pool is never emptied:
+	// it only holds names from the API, which are a bounded set.
+	class InternedString {
+	public:
+		InternedString() : value(&emptyString()) { }
+		InternedString(const std::string& str) : value(&intern(str.c_str(), str.size())) { }
+		InternedString(const char* str) : value(&intern(str, strlen(str))) { }
+
+		InternedString& operator=(const std::string& str) { value = &intern(str.c_str(), str.size()); return *this; }
+		InternedString& operator=(const char* str) { value = &intern(str, strlen(str)); return *this; }
+		void assign(const char* str, size_t length) { value = &intern(str, length); }
+
+		const std::string& str() const { return *value; }
+		operator const std::string&() const { return *value; }
+		const char* c_str() const { return value->c_str(); }
+		size_t size() const { return value->size(); }
+		bool empty() const { return value->empty(); }
+
+		// Equal strings share the same pool entry
+		bool operator==(const InternedString& other) const { return value == other.value; }
+		bool operator!=(const InternedString& other) const { return value != other.value; }
+
+		// Number of distinct strings and their total size in the pool
+		static size_t getPoolSize(size_t* memoryUsage);
+
+	private:
+		static const std::string& emptyString();
+		static const std::string& intern(const char* str, size_t length);
+
+		const std::string* value;
+	};
+
+}
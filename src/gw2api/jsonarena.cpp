@@ -0,0 +1,179 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <Windows.h>
+#include "jsonarena.h"
+
+namespace Gw2Api {
+
+	namespace JsonArena {
+
+		namespace {
+
+			const size_t blockSize = 64 * 1024;
+
+			struct Block {
+				Block* next;
+				size_t capacity;
+				size_t used;
+
+				char* data() { return (char*)(this + 1); }
+			};
+
+			struct Arena {
+				Arena() : first(NULL), current(NULL), last(NULL), depth(0) { }
+
+				Block* first;
+				Block* current;
+				char* last; // The most recent allocation, which can grow in place
+				int depth;
+			};
+
+			class ThreadArenas {
+			public:
+				ThreadArenas() : index(TlsAlloc()), blockAllocations(0), capacity(0) { }
+				~ThreadArenas() {
+					if (index != TLS_OUT_OF_INDEXES)
+						TlsFree(index);
+				}
+
+				DWORD index;
+				volatile LONG blockAllocations;
+				volatile LONG capacity;
+			};
+
+			ThreadArenas threadArenas;
+
+			Arena* getArena() {
+				Arena* arena = (Arena*)TlsGetValue(threadArenas.index);
+				if (arena == NULL) {
+					arena = new Arena();
+					TlsSetValue(threadArenas.index, arena);
+				}
+				return arena;
+			}
+
+			// Blocks are allocated once and stay in the arena's list until the thread releases it
+			Block* newBlock(size_t capacity) {
+				Block* block = (Block*)malloc(sizeof(Block) + capacity);
+				if (block == NULL)
+					throw std::bad_alloc();
+				block->next = NULL;
+				block->capacity = capacity;
+				block->used = 0;
+				InterlockedIncrement(&threadArenas.blockAllocations);
+				InterlockedExchangeAdd(&threadArenas.capacity, (LONG)capacity);
+				return block;
+			}
+
+			size_t align(size_t size) {
+				return (size + 7) & ~(size_t)7;
+			}
+
+		}
+
+
+		Scope::Scope() {
+			getArena()->depth++;
+		}
+
+		Scope::~Scope() {
+			Arena* arena = getArena();
+			if (--arena->depth == 0 && arena->first != NULL) {
+				arena->current = arena->first;
+				arena->current->used = 0;
+				arena->last = NULL;
+			}
+		}
+
+		void* allocate(size_t size) {
+			Arena* arena = getArena();
+			size = align(size);
+			if (arena->current == NULL) {
+				arena->first = arena->current = newBlock(size > blockSize ? size : blockSize);
+			}
+			while (arena->current->used + size > arena->current->capacity) {
+				// Move on to the next block, or add one at the end if there is no block left that fits
+				Block* next = arena->current->next;
+				if (next == NULL) {
+					next = newBlock(size > blockSize ? size : blockSize);
+					arena->current->next = next;
+				}
+				arena->current = next;
+				arena->current->used = 0;
+			}
+
+			char* memory = arena->current->data() + arena->current->used;
+			arena->current->used += size;
+			arena->last = memory;
+			return memory;
+		}
+
+		void* reallocate(void* original, size_t originalSize, size_t newSize) {
+			if (original == NULL)
+				return allocate(newSize);
+			if (newSize <= originalSize)
+				return original;
+
+			Arena* arena = getArena();
+			if (original == arena->last) {
+				size_t used = (arena->last - arena->current->data()) + align(newSize);
+				if (used <= arena->current->capacity) {
+					arena->current->used = used;
+					return original;
+				}
+			}
+			void* memory = allocate(newSize);
+			memcpy(memory, original, originalSize);
+			return memory;
+		}
+
+		char* copyString(const std::string& text) {
+			return copyString(text.c_str(), text.size());
+		}
+
+		char* copyString(const char* text, size_t length) {
+			char* copy = (char*)allocate(length + 1);
+			memcpy(copy, text, length);
+			copy[length] = '\0';
+			return copy;
+		}
+
+		void releaseThread() {
+			Arena* arena = (Arena*)TlsGetValue(threadArenas.index);
+			if (arena == NULL)
+				return;
+			Block* block = arena->first;
+			while (block != NULL) {
+				Block* next = block->next;
+				InterlockedExchangeAdd(&threadArenas.capacity, -(LONG)block->capacity);
+				free(block);
+				block = next;
+			}
+			delete arena;
+			TlsSetValue(threadArenas.index, NULL);
+		}
+
+		Statistics getStatistics() {
+			Statistics statistics;
+			statistics.blockAllocations = (size_t)threadArenas.blockAllocations;
+			statistics.capacity = (size_t)threadArenas.capacity;
+			return statistics;
+		}
+
+	}
+
+}
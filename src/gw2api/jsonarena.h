@@ -0,0 +1,70 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <stddef.h>
+#include <string>
+#include "rapidjson/document.h"
+
+namespace Gw2Api {
+
+	// Per-thread scratch memory for parsing JSON. Everything allocated within a Scope is released at once
+	// when the outermost Scope of the thread ends, and the memory blocks are kept for the next parse.
+	// So once the blocks have grown to the largest document a thread parses, parsing doesn't touch the heap anymore.
+	namespace JsonArena {
+
+		struct Statistics {
+			size_t blockAllocations; // Only grows while the arenas are still warming up
+			size_t capacity; // Sum of the blocks of all threads
+		};
+
+		class Scope {
+		public:
+			Scope();
+			~Scope();
+		};
+
+		// Only valid within a Scope; the memory is 8-byte aligned
+		void* allocate(size_t size);
+		void* reallocate(void* original, size_t originalSize, size_t newSize);
+
+		// A mutable zero-terminated copy of the text, for in-situ parsing
+		char* copyString(const std::string& text);
+		char* copyString(const char* text, size_t length);
+
+		// Frees the blocks of the calling thread; threads call this before they exit
+		void releaseThread();
+
+		Statistics getStatistics();
+
+	}
+
+	// rapidjson allocator on top of the arena of the calling thread
+	class JsonArenaAllocator {
+	public:
+		static const bool kNeedFree = false;
+
+		void* Malloc(size_t size) { return JsonArena::allocate(size); }
+		void* Realloc(void* originalPtr, size_t originalSize, size_t newSize) { return JsonArena::reallocate(originalPtr, originalSize, newSize); }
+		static void Free(void*) { }
+
+		// rapidjson creates the allocators of its parse stacks with new, so those come from the arena as well
+		static void* operator new(size_t size) { return JsonArena::allocate(size); }
+		static void operator delete(void*) { }
+	};
+
+	typedef rapidjson::GenericDocument<rapidjson::UTF8<>, JsonArenaAllocator> ArenaDocument;
+	typedef ArenaDocument::ValueType ArenaValue;
+	typedef rapidjson::GenericReader<rapidjson::UTF8<>, JsonArenaAllocator> ArenaReader;
+
+}
@@ -272,6 +272,48 @@ namespace Gw2Api {
 		}
 	};
 
+	// Maps a point with a separate scale and offset per axis: x' = x * scale.x + offset.x, and likewise for y.
+	// That's all the conversions between the Mumble, map and continent units need, so a whole chain of them folds into one.
+	struct AffineTransform2D {
+		Vector2D scale;
+		Vector2D offset;
+
+		AffineTransform2D() : scale(1, 1) { }
+
+		AffineTransform2D(const Vector2D& scale, const Vector2D& offset) {
+			this->scale = scale;
+			this->offset = offset;
+		}
+
+		// Meters to inches
+		static AffineTransform2D mumbleToMap() {
+			return AffineTransform2D(Vector2D(1 / INCH_TO_METER, 1 / INCH_TO_METER), Vector2D());
+		}
+
+		// Map inches to continent coordinates, which have an inverted y-axis
+		static AffineTransform2D mapToContinent(Rect mapRectangle, Rect continentRectangle) {
+			Vector2D scale = continentRectangle.getSize() / mapRectangle.getSize();
+			scale.y = -scale.y;
+			Vector2D offset = continentRectangle.upperLeft - mapRectangle.upperLeft * scale;
+			offset.y += continentRectangle.getHeight();
+			return AffineTransform2D(scale, offset);
+		}
+
+		Vector2D apply(const Vector2D& v) const {
+			return v * scale + offset;
+		}
+
+		// The transform that applies this one first and next afterwards
+		AffineTransform2D then(const AffineTransform2D& next) const {
+			return AffineTransform2D(scale * next.scale, offset * next.scale + next.offset);
+		}
+
+		AffineTransform2D inverse() const {
+			Vector2D inverseScale = Vector2D(1 / scale.x, 1 / scale.y);
+			return AffineTransform2D(inverseScale, Vector2D(-offset.x, -offset.y) * inverseScale);
+		}
+	};
+
 	struct Gw2Position {
 		enum Unit {
 			Mumble, // Uses meters and inverted z-axis
@@ -324,6 +366,17 @@ namespace Gw2Api {
 			return newPos;
 		}
 
+		// The horizontal (x and z) part of the conversion between two units, for converting many points at once.
+		// The functions below are the reference implementation of the same conversions.
+		AffineTransform2D getTransform(Unit fromUnit, Unit toUnit) {
+			return getTransformToContinent(fromUnit).then(getTransformToContinent(toUnit).inverse());
+		}
+
+		// The height (y) part of the conversion between two units
+		static double getHeightScale(Unit fromUnit, Unit toUnit) {
+			return getHeightScaleToMap(fromUnit) / getHeightScaleToMap(toUnit);
+		}
+
 		Vector3D toMumblePosition(Vector3D position, Unit oldUnit) {
 			Vector3D newPos = position;
 			switch (oldUnit) {
@@ -373,6 +426,22 @@ namespace Gw2Api {
 			}
 			return newPos;
 		}
+
+	private:
+		AffineTransform2D getTransformToContinent(Unit unit) {
+			AffineTransform2D mapToContinent = AffineTransform2D::mapToContinent(mapRectangle, continentRectangle);
+			switch (unit) {
+				case Mumble:
+					return AffineTransform2D::mumbleToMap().then(mapToContinent);
+				case Map:
+					return mapToContinent;
+			}
+			return AffineTransform2D();
+		}
+
+		static double getHeightScaleToMap(Unit unit) {
+			return unit == Mumble ? 1 / INCH_TO_METER : 1;
+		}
 	};
 
 	inline Vector3D Vector2D::toVector3D(int y) const {
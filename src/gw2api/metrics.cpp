@@ -0,0 +1,169 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#include <string.h>
+#include "metrics.h"
+
+namespace Gw2Api {
+
+	namespace Metrics {
+
+		namespace {
+
+			struct TimerState {
+				volatile LONGLONG count;
+				volatile LONGLONG totalMicroseconds;
+				volatile LONGLONG maxMicroseconds;
+				volatile LONGLONG buckets[histogramBucketCount];
+			};
+
+			struct State {
+				State() {
+					memset((void*)counters, 0, sizeof(counters));
+					memset((void*)timers, 0, sizeof(timers));
+					LARGE_INTEGER f;
+					frequency = QueryPerformanceFrequency(&f) && f.QuadPart > 0 ? f.QuadPart : 1000;
+				}
+
+				volatile LONGLONG counters[CounterCount];
+				TimerState timers[TimerCount];
+				LONGLONG frequency;
+			};
+
+			State state;
+
+			// Plain 64-bit reads aren't atomic in 32-bit builds
+			LONGLONG load(volatile LONGLONG* value) {
+				return InterlockedCompareExchange64(value, 0, 0);
+			}
+
+			int getBucket(uint64_t microseconds) {
+				int bucket = 0;
+				while (bucket < histogramBucketCount - 1 && microseconds >= ((uint64_t)1 << bucket))
+					bucket++;
+				return bucket;
+			}
+
+		}
+
+
+		uint64_t Histogram::getPercentileMicroseconds(double percentile) const {
+			if (count == 0)
+				return 0;
+			uint64_t rank = (uint64_t)(percentile * count);
+			if (rank >= count)
+				rank = count - 1;
+			uint64_t seen = 0;
+			for (int i = 0; i < histogramBucketCount - 1; i++) {
+				seen += buckets[i];
+				if (seen > rank)
+					return (uint64_t)1 << i;
+			}
+			return maxMicroseconds;
+		}
+
+		void add(Counter counter, uint64_t amount) {
+			if (counter < 0 || counter >= CounterCount)
+				return;
+			InterlockedExchangeAdd64(&state.counters[counter], (LONGLONG)amount);
+		}
+
+		void record(Timer timer, uint64_t microseconds) {
+			if (timer < 0 || timer >= TimerCount)
+				return;
+			TimerState& t = state.timers[timer];
+			InterlockedIncrement64(&t.count);
+			InterlockedExchangeAdd64(&t.totalMicroseconds, (LONGLONG)microseconds);
+			InterlockedIncrement64(&t.buckets[getBucket(microseconds)]);
+
+			LONGLONG max = load(&t.maxMicroseconds);
+			while ((LONGLONG)microseconds > max) {
+				LONGLONG previous = InterlockedCompareExchange64(&t.maxMicroseconds, (LONGLONG)microseconds, max);
+				if (previous == max)
+					break;
+				max = previous;
+			}
+		}
+
+		uint64_t get(Counter counter) {
+			if (counter < 0 || counter >= CounterCount)
+				return 0;
+			return (uint64_t)load(&state.counters[counter]);
+		}
+
+		Histogram get(Timer timer) {
+			Histogram result;
+			memset(&result, 0, sizeof(result));
+			if (timer < 0 || timer >= TimerCount)
+				return result;
+			// The fields are read one by one, so they can be off by the few recordings that happen in between
+			TimerState& t = state.timers[timer];
+			result.count = (uint64_t)load(&t.count);
+			result.totalMicroseconds = (uint64_t)load(&t.totalMicroseconds);
+			result.maxMicroseconds = (uint64_t)load(&t.maxMicroseconds);
+			for (int i = 0; i < histogramBucketCount; i++)
+				result.buckets[i] = (uint64_t)load(&t.buckets[i]);
+			return result;
+		}
+
+		const char* getName(Counter counter) {
+			switch (counter) {
+				case HttpRequests: return "HTTP requests";
+				case HttpFailures: return "HTTP failures";
+				case HttpBytesReceived: return "HTTP bytes received";
+				case ParseFailures: return "parse failures";
+				case CommandsSent: return "commands sent";
+				case CommandBytesSent: return "command bytes sent";
+				case CommandsReceived: return "commands received";
+				case CommandBytesReceived: return "command bytes received";
+				case MumbleLinkIterations: return "Mumble Link iterations";
+				case InfoPanelRefreshes: return "info panel refreshes";
+				case InfoPanelRefreshesAvoided: return "info panel refreshes avoided";
+				default: return "unknown";
+			}
+		}
+
+		const char* getName(Timer timer) {
+			switch (timer) {
+				case HttpFetch: return "HTTP fetch";
+				case Parse: return "parse";
+				case MumbleRead: return "Mumble Link read";
+				case IdentityDecode: return "Mumble Link identity decode";
+				case MapLookup: return "Mumble Link map lookup";
+				case WaypointSearch: return "Mumble Link waypoint search";
+				case Serialize: return "Mumble Link serialize";
+				case Send: return "Mumble Link send";
+				default: return "unknown";
+			}
+		}
+
+		LONGLONG now() {
+			LARGE_INTEGER counter;
+			if (!QueryPerformanceCounter(&counter))
+				return (LONGLONG)GetTickCount64() * state.frequency / 1000;
+			return counter.QuadPart;
+		}
+
+		uint64_t elapsedMicroseconds(LONGLONG from, LONGLONG to) {
+			if (to <= from)
+				return 0;
+			return (uint64_t)((to - from) * 1000000.0 / state.frequency);
+		}
+
+		double elapsedMilliseconds(LONGLONG from, LONGLONG to) {
+			return (to - from) * 1000.0 / state.frequency;
+		}
+
+	}
+
+}
@@ -0,0 +1,92 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <stdint.h>
+#include <Windows.h>
+
+namespace Gw2Api {
+
+	// Always-on counters and latency histograms, so the cost of the plugin can be seen in release builds as well.
+	// Everything is updated with interlocked operations, recording never takes a lock.
+	namespace Metrics {
+
+		enum Counter {
+			HttpRequests,
+			HttpFailures,
+			HttpBytesReceived,
+			ParseFailures,
+			CommandsSent,
+			CommandBytesSent,
+			CommandsReceived,
+			CommandBytesReceived,
+			MumbleLinkIterations,
+			InfoPanelRefreshes,
+			InfoPanelRefreshesAvoided,
+			CounterCount
+		};
+
+		enum Timer {
+			HttpFetch,
+			Parse,
+			// Stages of an iteration of the Mumble Link loop
+			MumbleRead, // Reading the shared Mumble Link memory
+			IdentityDecode, // Parsing the identity JSON from Mumble Link
+			MapLookup, // Looking up the map info and converting the position to continent coordinates
+			WaypointSearch, // Finding the closest waypoint
+			Serialize, // Encoding the messages that get published
+			Send, // Handing the messages over to TeamSpeak
+			TimerCount
+		};
+
+		// Bucket i counts the durations below 2^i microseconds (and at least 2^(i-1)), the last one everything longer
+		const int histogramBucketCount = 26;
+
+		struct Histogram {
+			uint64_t count;
+			uint64_t totalMicroseconds;
+			uint64_t maxMicroseconds;
+			uint64_t buckets[histogramBucketCount];
+
+			// Upper bound of the bucket the percentile (0 to 1) falls in
+			uint64_t getPercentileMicroseconds(double percentile) const;
+		};
+
+		void add(Counter counter, uint64_t amount = 1);
+		void record(Timer timer, uint64_t microseconds);
+
+		uint64_t get(Counter counter);
+		Histogram get(Timer timer);
+
+		const char* getName(Counter counter);
+		const char* getName(Timer timer);
+
+		// Current performance counter value (monotonic and well below a millisecond), and the time between two of them
+		LONGLONG now();
+		uint64_t elapsedMicroseconds(LONGLONG from, LONGLONG to);
+		double elapsedMilliseconds(LONGLONG from, LONGLONG to);
+
+		// Records the time between its construction and destruction
+		class ScopedTimer {
+		public:
+			ScopedTimer(Timer timer) : timer(timer), start(now()) { }
+			~ScopedTimer() { record(timer, elapsedMicroseconds(start, now())); }
+
+		private:
+			Timer timer;
+			LONGLONG start;
+		};
+
+	}
+
+}
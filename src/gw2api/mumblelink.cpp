@@ -0,0 +1,179 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <codecvt>
+#include <locale>
+#include <string.h>
+#include "rapidjson/document.h"
+#include "mumblelink.h"
+#include "mumblelinkrecorder.h"
+#include "parsers.h"
+
+namespace Gw2Api {
+
+	namespace MumbleLink {
+
+		namespace {
+
+			LinkedMem* lm = NULL;
+			// The shared Mumble Link memory is only mapped once, switching to replayed memory and back just changes lm
+			HANDLE hLiveMapping = NULL;
+			LinkedMem* liveMemory = NULL;
+			uint32_t lastTick = 0;
+			Recorder* recorder = NULL;
+			std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+			DecodeStatistics decodeStatistics;
+
+			// Raw snapshots of the last decoded buffers; identity and game name only change on map changes or character swaps,
+			// so comparing the raw bytes is a lot cheaper than converting and parsing them on every tick
+			wchar_t lastIdentityBuffer[256];
+			MumbleIdentity lastIdentity;
+			bool lastIdentityValid = false;
+			wchar_t lastNameBuffer[256];
+			bool lastIsGW2 = false;
+			bool lastNameValid = false;
+
+		}
+
+
+		bool initLink(LinkedMem* memory) {
+			lm = memory;
+			lastTick = 0;
+			lastIdentityValid = false;
+			lastNameValid = false;
+			memset(&decodeStatistics, 0, sizeof(decodeStatistics));
+			return lm != NULL;
+		}
+
+		bool initLink() {
+			initLink(NULL);
+
+			if (liveMemory == NULL) {
+				hLiveMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(LinkedMem), L"MumbleLink");
+				if (hLiveMapping == NULL) {
+					return false;
+				}
+
+				liveMemory = (LinkedMem*)MapViewOfFile(hLiveMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LinkedMem));
+				if (liveMemory == NULL) {
+					CloseHandle(hLiveMapping);
+					hLiveMapping = NULL;
+					return false;
+				}
+			}
+
+			return initLink(liveMemory);
+		}
+
+		void closeLink() {
+			initLink(NULL);
+			if (liveMemory != NULL) {
+				UnmapViewOfFile(liveMemory);
+				liveMemory = NULL;
+			}
+			if (hLiveMapping != NULL) {
+				CloseHandle(hLiveMapping);
+				hLiveMapping = NULL;
+			}
+		}
+
+		bool isActive() {
+			if (lm->uiTick != lastTick) {
+				lastTick = lm->uiTick;
+				if (recorder != NULL)
+					recorder->write(*lm, GetTickCount64());
+				return true;
+			}
+			return false;
+		}
+
+		std::string getGame() {
+			return converter.to_bytes(lm->name);
+		}
+
+		bool isGW2() {
+			wchar_t name[256];
+			memcpy(name, lm->name, sizeof(name));
+			if (lastNameValid && memcmp(name, lastNameBuffer, sizeof(name)) == 0) {
+				decodeStatistics.nameHits++;
+				return lastIsGW2;
+			}
+			decodeStatistics.nameMisses++;
+
+			memcpy(lastNameBuffer, name, sizeof(lastNameBuffer));
+			name[255] = 0;
+			lastIsGW2 = converter.to_bytes(name) == "Guild Wars 2";
+			lastNameValid = true;
+			return lastIsGW2;
+		}
+
+		MumbleIdentity getIdentity() {
+			// Take a snapshot first, Guild Wars 2 may write to the shared memory while we are reading it
+			wchar_t identityBuffer[256];
+			memcpy(identityBuffer, lm->identity, sizeof(identityBuffer));
+			if (lastIdentityValid && memcmp(identityBuffer, lastIdentityBuffer, sizeof(identityBuffer)) == 0) {
+				decodeStatistics.identityHits++;
+				return lastIdentity;
+			}
+			decodeStatistics.identityMisses++;
+
+			MumbleIdentity mumbleIdentity;
+			memcpy(lastIdentityBuffer, identityBuffer, sizeof(lastIdentityBuffer));
+			identityBuffer[255] = 0;
+
+			std::string identity = converter.to_bytes(identityBuffer);
+			JsonArena::Scope scope;
+			Parsers::RJDoc json;
+			json.ParseInsitu<0>(JsonArena::copyString(identity));
+
+			const Parsers::RJValue& rj_name = json["name"];
+			const Parsers::RJValue& rj_profession = json["profession"];
+			const Parsers::RJValue& rj_map_id = json["map_id"];
+			const Parsers::RJValue& rj_world_id = json["world_id"];
+			const Parsers::RJValue& rj_team_color_id = json["team_color_id"];
+			const Parsers::RJValue& rj_commander = json["commander"];
+
+			if (!rj_name.IsNull() && rj_name.IsString())				mumbleIdentity.name = rj_name.GetString();
+			if (!rj_profession.IsNull() && rj_profession.IsInt())		mumbleIdentity.profession = (Profession)rj_profession.GetInt();
+			if (!rj_map_id.IsNull() && rj_map_id.IsUint())				mumbleIdentity.map_id = rj_map_id.GetUint();
+			if (!rj_world_id.IsNull() && rj_world_id.IsUint())			mumbleIdentity.world_id = rj_world_id.GetUint();
+			if (!rj_team_color_id.IsNull() && rj_team_color_id.IsUint())	mumbleIdentity.team_color_id = rj_team_color_id.GetUint();
+			if (!rj_commander.IsNull() && rj_commander.IsBool())		mumbleIdentity.commander = rj_commander.GetBool();
+
+			lastIdentity = mumbleIdentity;
+			lastIdentityValid = true;
+			return mumbleIdentity;
+		}
+
+		void setRecorder(Recorder* newRecorder) {
+			recorder = newRecorder;
+		}
+
+		DecodeStatistics getDecodeStatistics() {
+			return decodeStatistics;
+		}
+
+		Vector3D getAvatarPosition() {
+			return Vector3D(lm->fAvatarPosition[0], lm->fAvatarPosition[1], lm->fAvatarPosition[2]);
+		}
+
+		MumbleContext* getContext() {
+			return (MumbleContext*)lm->context;
+		}
+
+		DWORD getProcessId() {
+			return getContext()->processId;
+		}
+
+	}
+
+}
@@ -11,14 +11,10 @@
 */
 
 #pragma once
-#include <codecvt>
-#include <locale>
 #include <stdint.h>
 #include <string>
 #include <Windows.h>
-#include "rapidjson/document.h"
 #include "math.h"
-#include "parsers.h"
 
 namespace Gw2Api {
 
@@ -40,9 +36,12 @@ namespace Gw2Api {
 			wchar_t description[2048];
 		};
 
-		static LinkedMem* lm;
-		static uint32_t lastTick;
-		static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+		struct DecodeStatistics {
+			uint64_t identityHits;
+			uint64_t identityMisses;
+			uint64_t nameHits;
+			uint64_t nameMisses;
+		};
 
 		enum Profession {
 			Guardian = 1,
@@ -104,74 +103,37 @@ namespace Gw2Api {
 			unsigned shardId;
 			unsigned instance;
 			unsigned buildId;
+			// Guild Wars 2 writes more than the part Mumble uses for identification (which is what context_len covers)
+			unsigned uiState;
+			unsigned short compassWidth;
+			unsigned short compassHeight;
+			float compassRotation;
+			float playerX;
+			float playerY;
+			float mapCenterX;
+			float mapCenterY;
+			float mapScale;
+			unsigned processId;
+			byte mountIndex;
 		};
 
-		inline bool initLink() {
-			lm = NULL;
-			lastTick = 0;
-
-			HANDLE hMapObject = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(LinkedMem), L"MumbleLink");
-			if (hMapObject == NULL) {
-				return false;
-			}
-
-			lm = (LinkedMem*)MapViewOfFile(hMapObject, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LinkedMem));
-			if (lm == NULL) {
-				CloseHandle(hMapObject);
-				hMapObject = NULL;
-				return false;
-			}
-
-			return true;
-		}
-
-		inline bool isActive() {
-			if (lm->uiTick > lastTick) {
-				lastTick = lm->uiTick;
-				return true;
-			}
-			return false;
-		}
-
-		inline std::string getGame() {
-			return converter.to_bytes(lm->name);
-		}
-
-		inline bool isGW2() {
-			return getGame() == "Guild Wars 2";
-		}
-
-		inline MumbleIdentity getIdentity() {
-			MumbleIdentity mumbleIdentity;
-
-			std::string identity = converter.to_bytes(lm->identity);
-			Parsers::RJDoc json;
-			json.Parse<0>(identity.c_str());
-
-			const Parsers::RJValue& rj_name = json["name"];
-			const Parsers::RJValue& rj_profession = json["profession"];
-			const Parsers::RJValue& rj_map_id = json["map_id"];
-			const Parsers::RJValue& rj_world_id = json["world_id"];
-			const Parsers::RJValue& rj_team_color_id = json["team_color_id"];
-			const Parsers::RJValue& rj_commander = json["commander"];
-
-			if (!rj_name.IsNull() && rj_name.IsString())				mumbleIdentity.name = rj_name.GetString();
-			if (!rj_profession.IsNull() && rj_profession.IsInt())		mumbleIdentity.profession = (Profession)rj_profession.GetInt();
-			if (!rj_map_id.IsNull() && rj_map_id.IsUint())				mumbleIdentity.map_id = rj_map_id.GetUint();
-			if (!rj_world_id.IsNull() && rj_world_id.IsUint())			mumbleIdentity.world_id = rj_world_id.GetUint();
-			if (!rj_team_color_id.IsNull() && rj_team_color_id.IsUint())	mumbleIdentity.team_color_id = rj_team_color_id.GetUint();
-			if (!rj_commander.IsNull() && rj_commander.IsBool())		mumbleIdentity.commander = rj_commander.GetBool();
-
-			return mumbleIdentity;
-		}
-
-		inline Vector3D getAvatarPosition() {
-			return Vector3D(lm->fAvatarPosition[0], lm->fAvatarPosition[1], lm->fAvatarPosition[2]);
-		}
-
-		inline MumbleContext* getContext() {
-			return (MumbleContext*)lm->context;
-		}
+		// The link state lives in mumblelink.cpp, so every translation unit sees the same one.
+		// Only the thread that polls Mumble Link may call these.
+		bool initLink();
+		// Reads from the given memory instead of the shared Mumble Link mapping, e.g. to replay captured data offline
+		bool initLink(LinkedMem* memory);
+		// Unmaps the shared Mumble Link memory, which initLink() maps only once
+		void closeLink();
+		// True if uiTick has changed since the last call; any change counts, since a restarted Guild Wars 2 counts from zero again
+		bool isActive();
+		std::string getGame();
+		bool isGW2();
+		MumbleIdentity getIdentity();
+		DecodeStatistics getDecodeStatistics();
+		Vector3D getAvatarPosition();
+		MumbleContext* getContext();
+		// The id of the Guild Wars 2 process that last wrote the link, 0 if it's unknown
+		DWORD getProcessId();
 	}
 
 }
\ No newline at end of file
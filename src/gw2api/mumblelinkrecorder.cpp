@@ -0,0 +1,376 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#include <string.h>
+#include "mumblelinkrecorder.h"
+
+namespace Gw2Api {
+
+	namespace MumbleLink {
+
+		namespace {
+
+			const char recordingMagic[4] = { 'G', 'W', 'M', 'L' };
+			const size_t headerSize = sizeof(recordingMagic) + 1;
+			const size_t flushSize = 64 * 1024;
+			const int floatCount = 18;
+
+			const unsigned char FLAG_KEYFRAME = 1;
+			const unsigned char FLAG_IDENTITY = 2;
+			const unsigned char FLAG_NAME = 4;
+			const unsigned char FLAG_CONTEXT = 8;
+
+			void getFloats(const LinkedMem& frame, uint32_t* bits) {
+				memcpy(bits, frame.fAvatarPosition, sizeof(frame.fAvatarPosition));
+				memcpy(bits + 3, frame.fAvatarFront, sizeof(frame.fAvatarFront));
+				memcpy(bits + 6, frame.fAvatarTop, sizeof(frame.fAvatarTop));
+				memcpy(bits + 9, frame.fCameraPosition, sizeof(frame.fCameraPosition));
+				memcpy(bits + 12, frame.fCameraFront, sizeof(frame.fCameraFront));
+				memcpy(bits + 15, frame.fCameraTop, sizeof(frame.fCameraTop));
+			}
+
+			void setFloats(LinkedMem& frame, const uint32_t* bits) {
+				memcpy(frame.fAvatarPosition, bits, sizeof(frame.fAvatarPosition));
+				memcpy(frame.fAvatarFront, bits + 3, sizeof(frame.fAvatarFront));
+				memcpy(frame.fAvatarTop, bits + 6, sizeof(frame.fAvatarTop));
+				memcpy(frame.fCameraPosition, bits + 9, sizeof(frame.fCameraPosition));
+				memcpy(frame.fCameraFront, bits + 12, sizeof(frame.fCameraFront));
+				memcpy(frame.fCameraTop, bits + 15, sizeof(frame.fCameraTop));
+			}
+
+			void writeVarint(std::vector<unsigned char>& bytes, uint64_t value) {
+				while (value >= 0x80) {
+					bytes.push_back((unsigned char)(value | 0x80));
+					value >>= 7;
+				}
+				bytes.push_back((unsigned char)value);
+			}
+
+			// Stored as UTF-16 code units up to the terminator, independent of the size of wchar_t
+			void writeWideString(std::vector<unsigned char>& bytes, const wchar_t* value, size_t maxLength) {
+				size_t length = 0;
+				while (length < maxLength && value[length] != 0)
+					length++;
+				writeVarint(bytes, length);
+				for (size_t i = 0; i < length; i++) {
+					bytes.push_back((unsigned char)(value[i] & 0xFF));
+					bytes.push_back((unsigned char)((value[i] >> 8) & 0xFF));
+				}
+			}
+
+			class Reader {
+			public:
+				Reader(const unsigned char* position, const unsigned char* end) : position(position), end(end) { }
+
+				bool readByte(unsigned char* value) {
+					if (position >= end)
+						return false;
+					*value = *position++;
+					return true;
+				}
+
+				bool readVarint(uint64_t* value) {
+					uint64_t result = 0;
+					for (int shift = 0; shift < 64; shift += 7) {
+						if (position >= end)
+							return false;
+						unsigned char byte = *position++;
+						result |= (uint64_t)(byte & 0x7F) << shift;
+						if ((byte & 0x80) == 0) {
+							*value = result;
+							return true;
+						}
+					}
+					return false;
+				}
+
+				bool readWideString(wchar_t* value, size_t maxLength) {
+					uint64_t length;
+					if (!readVarint(&length) || length >= maxLength || length * 2 > (uint64_t)(end - position))
+						return false;
+					for (size_t i = 0; i < length; i++, position += 2)
+						value[i] = (wchar_t)(position[0] | (position[1] << 8));
+					value[length] = 0;
+					return true;
+				}
+
+				bool readBytes(unsigned char* value, size_t length) {
+					if (length > (size_t)(end - position))
+						return false;
+					memcpy(value, position, length);
+					position += length;
+					return true;
+				}
+
+				const unsigned char* position;
+				const unsigned char* end;
+			};
+
+		}
+
+
+		Recorder::Recorder() : hFile(INVALID_HANDLE_VALUE), previousTime(0), hasPrevious(false), failed(false) {
+			memset(&previous, 0, sizeof(previous));
+		}
+
+		Recorder::~Recorder() {
+			close();
+		}
+
+		bool Recorder::open(const std::string& path) {
+			close();
+			hFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+				return false;
+
+			// Sessions are appended to existing recordings of the same format
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(hFile, &fileSize)) {
+				close();
+				return false;
+			}
+			if (fileSize.QuadPart == 0) {
+				buffer.insert(buffer.end(), recordingMagic, recordingMagic + sizeof(recordingMagic));
+				buffer.push_back(recordingFormatVersion);
+			} else {
+				char header[headerSize];
+				DWORD bytesRead = 0;
+				LARGE_INTEGER distance;
+				distance.QuadPart = 0;
+				if (!ReadFile(hFile, header, sizeof(header), &bytesRead, NULL) || bytesRead != sizeof(header) ||
+					memcmp(header, recordingMagic, sizeof(recordingMagic)) != 0 || (unsigned char)header[sizeof(recordingMagic)] != recordingFormatVersion ||
+					!SetFilePointerEx(hFile, distance, NULL, FILE_END)) {
+					close();
+					return false;
+				}
+			}
+
+			hasPrevious = false;
+			return true;
+		}
+
+		bool Recorder::close() {
+			bool written = !failed;
+			if (hFile != INVALID_HANDLE_VALUE) {
+				if (!flush())
+					written = false;
+				CloseHandle(hFile);
+				hFile = INVALID_HANDLE_VALUE;
+			}
+			buffer.clear();
+			failed = false;
+			return written;
+		}
+
+		void Recorder::write(const LinkedMem& frame, ULONGLONG time) {
+			if (hFile == INVALID_HANDLE_VALUE)
+				return;
+
+			// Only the part that context_len covers is recorded, so the extended context of Guild Wars 2 (e.g. the compass rotation),
+			// which changes with nearly every move, doesn't count as a change
+			uint32_t contextLength = frame.context_len < sizeof(frame.context) ? frame.context_len : (uint32_t)sizeof(frame.context);
+			unsigned char flags = 0;
+			if (!hasPrevious) {
+				memset(&previous, 0, sizeof(previous));
+				previousTime = time;
+				flags = FLAG_KEYFRAME | FLAG_IDENTITY | FLAG_NAME | FLAG_CONTEXT;
+			} else {
+				if (memcmp(frame.identity, previous.identity, sizeof(frame.identity)) != 0)
+					flags |= FLAG_IDENTITY;
+				if (memcmp(frame.name, previous.name, sizeof(frame.name)) != 0)
+					flags |= FLAG_NAME;
+				if (frame.context_len != previous.context_len || memcmp(frame.context, previous.context, contextLength) != 0)
+					flags |= FLAG_CONTEXT;
+			}
+
+			buffer.push_back(flags);
+			writeVarint(buffer, time - previousTime);
+			writeVarint(buffer, (uint32_t)(frame.uiTick - previous.uiTick));
+			if (flags & FLAG_KEYFRAME)
+				writeVarint(buffer, frame.uiVersion);
+
+			uint32_t bits[floatCount];
+			uint32_t previousBits[floatCount];
+			getFloats(frame, bits);
+			getFloats(previous, previousBits);
+			for (int i = 0; i < floatCount; i++)
+				writeVarint(buffer, bits[i] ^ previousBits[i]);
+
+			if (flags & FLAG_IDENTITY)
+				writeWideString(buffer, frame.identity, 256);
+			if (flags & FLAG_NAME)
+				writeWideString(buffer, frame.name, 256);
+			if (flags & FLAG_CONTEXT) {
+				writeVarint(buffer, contextLength);
+				buffer.insert(buffer.end(), frame.context, frame.context + contextLength);
+			}
+
+			previous = frame;
+			previousTime = time;
+			hasPrevious = true;
+			if (buffer.size() >= flushSize && !flush()) {
+				CloseHandle(hFile);
+				hFile = INVALID_HANDLE_VALUE;
+				failed = true;
+			}
+		}
+
+		bool Recorder::flush() {
+			size_t written = 0;
+			while (written < buffer.size()) {
+				DWORD bytesWritten = 0;
+				if (!WriteFile(hFile, &buffer[written], (DWORD)(buffer.size() - written), &bytesWritten, NULL) || bytesWritten == 0)
+					break;
+				written += bytesWritten;
+			}
+			bool complete = written == buffer.size();
+			buffer.clear();
+			return complete;
+		}
+
+
+		Replayer::Replayer() : hFile(INVALID_HANDLE_VALUE), hMapping(NULL), data(NULL), size(0), offset(0), time(0) {
+			memset(&memory, 0, sizeof(memory));
+		}
+
+		Replayer::~Replayer() {
+			close();
+		}
+
+		bool Replayer::open(const std::string& path) {
+			close();
+			hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart < (LONGLONG)headerSize || (ULONGLONG)fileSize.QuadPart > (size_t)-1) {
+				close();
+				return false;
+			}
+			hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (hMapping == NULL) {
+				close();
+				return false;
+			}
+			data = (const unsigned char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+			size = (size_t)fileSize.QuadPart;
+			if (data == NULL || memcmp(data, recordingMagic, sizeof(recordingMagic)) != 0 || data[sizeof(recordingMagic)] != recordingFormatVersion) {
+				close();
+				return false;
+			}
+
+			rewind();
+			return true;
+		}
+
+		void Replayer::close() {
+			if (data != NULL) {
+				UnmapViewOfFile(data);
+				data = NULL;
+			}
+			if (hMapping != NULL) {
+				CloseHandle(hMapping);
+				hMapping = NULL;
+			}
+			if (hFile != INVALID_HANDLE_VALUE) {
+				CloseHandle(hFile);
+				hFile = INVALID_HANDLE_VALUE;
+			}
+			size = 0;
+			offset = 0;
+		}
+
+		void Replayer::rewind() {
+			offset = headerSize;
+			time = 0;
+			memset(&memory, 0, sizeof(memory));
+		}
+
+		bool Replayer::next() {
+			if (data == NULL || offset >= size)
+				return false;
+
+			Reader reader(data + offset, data + size);
+			unsigned char flags;
+			uint64_t timeDelta, tickDelta;
+			if (!reader.readByte(&flags) || !reader.readVarint(&timeDelta) || !reader.readVarint(&tickDelta))
+				return false;
+
+			// Decode into a copy, so a corrupt frame leaves the last good one in place
+			LinkedMem frame = memory;
+			if (flags & FLAG_KEYFRAME) {
+				memset(&frame, 0, sizeof(frame));
+				uint64_t version;
+				if (!reader.readVarint(&version))
+					return false;
+				frame.uiVersion = (uint32_t)version;
+				frame.uiTick = (uint32_t)tickDelta;
+			} else {
+				frame.uiTick += (uint32_t)tickDelta;
+			}
+
+			uint32_t bits[floatCount];
+			getFloats(frame, bits);
+			for (int i = 0; i < floatCount; i++) {
+				uint64_t delta;
+				if (!reader.readVarint(&delta))
+					return false;
+				bits[i] ^= (uint32_t)delta;
+			}
+			setFloats(frame, bits);
+
+			if ((flags & FLAG_IDENTITY) && !reader.readWideString(frame.identity, 256))
+				return false;
+			if ((flags & FLAG_NAME) && !reader.readWideString(frame.name, 256))
+				return false;
+			if (flags & FLAG_CONTEXT) {
+				uint64_t contextLength;
+				if (!reader.readVarint(&contextLength) || contextLength > sizeof(frame.context))
+					return false;
+				memset(frame.context, 0, sizeof(frame.context));
+				if (!reader.readBytes(frame.context, (size_t)contextLength))
+					return false;
+				frame.context_len = (uint32_t)contextLength;
+			}
+
+			time += timeDelta;
+			memory = frame;
+			offset = reader.position - data;
+			return true;
+		}
+
+		bool Replayer::peekTimeDelta(ULONGLONG* delta) const {
+			if (data == NULL || offset >= size)
+				return false;
+			Reader reader(data + offset, data + size);
+			unsigned char flags;
+			uint64_t value;
+			if (!reader.readByte(&flags) || !reader.readVarint(&value))
+				return false;
+			*delta = value;
+			return true;
+		}
+
+		bool Replayer::advance(ULONGLONG time) {
+			ULONGLONG delta;
+			while (peekTimeDelta(&delta) && this->time + delta <= time) {
+				if (!next())
+					return false;
+			}
+			return peekTimeDelta(&delta);
+		}
+
+	}
+
+}
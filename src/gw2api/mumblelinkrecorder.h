@@ -0,0 +1,102 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <Windows.h>
+#include "mumblelink.h"
+
+namespace Gw2Api {
+
+	namespace MumbleLink {
+
+		// Recordings are append-only logs of LinkedMem frames, to reproduce sessions offline (e.g. with the benchmark).
+		//
+		// Layout: a "GWML" magic and a format version byte, followed by frames. A frame consists of a flags byte,
+		// the milliseconds and ticks since the previous frame as varints, and the 18 avatar and camera floats, each stored as a varint
+		// of its bits XORed with the previous value (unchanged floats take one byte, small movements two or three).
+		// The identity, game name and context are only stored when they have changed. Every recording session starts with a key frame,
+		// which is relative to an all-zero frame, so sessions can be appended to an existing file.
+		// The description and the extended context of Guild Wars 2 beyond context_len (see MumbleContext) are not recorded.
+
+		const unsigned char recordingFormatVersion = 1;
+
+		// Buffers the frames in memory and only writes to disk every so often, to keep the Mumble Link loop cheap.
+		// If writing fails, the recorder closes itself, so the recording isn't continued with frames missing in between.
+		class Recorder {
+		public:
+			Recorder();
+			~Recorder();
+
+			bool open(const std::string& path);
+			// Returns false if frames have been lost since open, because writing them has failed
+			bool close();
+			bool isOpen() const { return hFile != INVALID_HANDLE_VALUE; }
+			// True once writing has failed, until the next close or open
+			bool hasFailed() const { return failed; }
+
+			void write(const LinkedMem& frame, ULONGLONG time);
+
+		private:
+			bool flush();
+
+			HANDLE hFile;
+			std::vector<unsigned char> buffer;
+			LinkedMem previous;
+			ULONGLONG previousTime;
+			bool hasPrevious;
+			bool failed;
+		};
+
+		// Decodes a recording from a memory-mapped file, frame by frame, into a LinkedMem that can be passed to initLink
+		class Replayer {
+		public:
+			Replayer();
+			~Replayer();
+
+			bool open(const std::string& path);
+			void close();
+			bool isOpen() const { return data != NULL; }
+
+			// Starts over at the first frame
+			void rewind();
+			// Decodes the next frame; returns false at the end of the recording or if it's corrupt
+			bool next();
+			// Decodes frames until the one that has been recorded after the given milliseconds since the start; returns false at the end
+			bool advance(ULONGLONG time);
+
+			LinkedMem* getMemory() { return &memory; }
+			// Milliseconds since the first frame of the recording
+			ULONGLONG getTime() const { return time; }
+
+		private:
+			bool peekTimeDelta(ULONGLONG* delta) const;
+
+			HANDLE hFile;
+			HANDLE hMapping;
+			const unsigned char* data;
+			size_t size;
+			size_t offset;
+			LinkedMem memory;
+			ULONGLONG time;
+		};
+
+		// Every frame with a new tick is passed to the recorder; NULL stops recording.
+		// Only the thread that polls Mumble Link may call this, the recorder has to stay alive until it's reset.
+		void setRecorder(Recorder* recorder);
+
+	}
+
+}
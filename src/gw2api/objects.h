@@ -11,52 +11,113 @@
 */
 
 #pragma once
+#include <algorithm>
+#include <memory>
+#include <string.h>
 #include <string>
+#include <utility>
 #include <vector>
 #include <time.h>
+#include "internedstring.h"
 #include "math.h"
 #include "requests.h"
+#include "waypointindex.h"
 
 namespace Gw2Api {
 
 	struct ApiResponseObject {
 		virtual ~ApiResponseObject() { }
 
+		ApiResponseObject() : requestTime(0), isCached(false), memoryUsage(0) { }
+
 		Requests::ApiRequest request;
-		time_t requestTime;
-		double getAge() { return difftime(time(NULL), requestTime); }
+		mutable time_t requestTime; // The only part that changes once cached, only accessed under the cache lock then (see Cache::renew)
 		bool isCached;
+		size_t memoryUsage; // Rough estimate for the memory budget of the cache, based on the size of the response it's parsed from
 	};
+	typedef std::shared_ptr<const ApiResponseObject> ApiResponseObjectPtr;
 
 	template<class T>
 	struct EntryCollection : public std::vector<T> {
 		~EntryCollection() { }
 	};
 
+	// Key/value pairs in a vector sorted by key, so lookups are binary searches over contiguous memory.
+	// Parsers append the entries in any order and sort them once they are done.
 	template<class K, class V>
-	struct EntryDictionary : public std::map<K, V> { 
+	struct EntryDictionary : public std::vector<std::pair<K, V>> {
+		typedef std::vector<std::pair<K, V>> Base;
+		typedef typename Base::iterator iterator;
+		typedef typename Base::const_iterator const_iterator;
+		typedef typename Base::value_type value_type;
+
 		~EntryDictionary() { }
+
+		// Invalidates iterators and references to other entries; call sort() before looking anything up
+		V& append(const K& key) {
+			this->push_back(value_type(key, V()));
+			return this->back().second;
+		}
+
+		void sort() {
+			std::stable_sort(this->begin(), this->end(), KeyLess());
+		}
+
+		iterator find(const K& key) {
+			iterator it = std::lower_bound(this->begin(), this->end(), key, KeyLess());
+			return it != this->end() && it->first == key ? it : this->end();
+		}
+
+		const_iterator find(const K& key) const {
+			const_iterator it = std::lower_bound(this->begin(), this->end(), key, KeyLess());
+			return it != this->end() && it->first == key ? it : this->end();
+		}
+
+	private:
+		struct KeyLess {
+			bool operator()(const value_type& lhs, const value_type& rhs) const { return lhs.first < rhs.first; }
+			bool operator()(const value_type& lhs, const K& rhs) const { return lhs.first < rhs; }
+			bool operator()(const K& lhs, const value_type& rhs) const { return lhs < rhs.first; }
+		};
 	};
 
 
+	// A view on a single value inside a cached response; the root is kept alive as long as the view exists
 	template<class R, class V>
 	struct ApiInnerResponseObject {
-		ApiInnerResponseObject() { }
+		ApiInnerResponseObject() : value(NULL) { }
 
-		ApiInnerResponseObject(const R* root, const V* value) {
-			this->root = *root;
-			this->value = *value;
-		}
+		ApiInnerResponseObject(const std::shared_ptr<const R>& root, const V* value) : root(root), value(value) { }
 
-		R root;
-		V value;
+		std::shared_ptr<const R> root;
+		const V* value;
 	};
 
 
 	struct PointOfInterestEntry {
+		enum Type {
+			Unknown,
+			Landmark,
+			Waypoint,
+			Vista,
+			Unlock
+		};
+
+		static Type parseType(const char* type, size_t length) {
+			if (isType(type, length, "waypoint")) return Waypoint;
+			if (isType(type, length, "landmark")) return Landmark;
+			if (isType(type, length, "vista")) return Vista;
+			if (isType(type, length, "unlock")) return Unlock;
+			return Unknown;
+		}
+
+		static bool isType(const char* type, size_t length, const char* name) {
+			return length == strlen(name) && memcmp(type, name, length) == 0;
+		}
+
 		int poi_id;
-		std::string name;
-		std::string type;
+		InternedString name;
+		Type type;
 		int floor;
 		Vector2D coord;
 	};
@@ -64,7 +125,7 @@ namespace Gw2Api {
 
 	struct TaskEntry {
 		int task_id;
-		std::string objective;
+		InternedString objective;
 		int level;
 		Vector2D coord;
 	};
@@ -77,14 +138,14 @@ namespace Gw2Api {
 
 	struct SectorEntry {
 		int sector_id;
-		std::string name;
+		InternedString name;
 		int level;
 		Vector2D coord;
 	};
 	typedef EntryCollection<SectorEntry> SectorEntries;
 
 	struct MapFloorEntry {
-		std::string name;
+		InternedString name;
 		int min_level;
 		int max_level;
 		int default_floor;
@@ -94,6 +155,7 @@ namespace Gw2Api {
 		TaskEntries tasks;
 		SkillChallengeEntries skill_challenges;
 		SectorEntries sectors;
+		WaypointIndex waypoints; // Built from points_of_interest by the parser
 	};
 
 	struct MapFloorEntries : public ApiResponseObject, public EntryDictionary<int, MapFloorEntry> {
@@ -101,7 +163,7 @@ namespace Gw2Api {
 	};
 
 	struct MapFloorRegionEntry {
-		std::string name;
+		InternedString name;
 		Vector2D label_coord;
 		MapFloorEntries maps;
 	};
@@ -114,17 +176,18 @@ namespace Gw2Api {
 		Rect clamped_view;
 		MapFloorRegionEntries regions;
 	};
+	typedef std::shared_ptr<const MapFloorRootEntry> MapFloorRootEntryPtr;
 
 	struct MapEntry {
-		std::string map_name;
+		InternedString map_name;
 		int min_level;
 		int max_level;
 		int default_floor;
 		std::vector<int> floors;
 		int region_id;
-		std::string region_name;
+		InternedString region_name;
 		int continent_id;
-		std::string continent_name;
+		InternedString continent_name;
 		Rect map_rect;
 		Rect continent_rect;
 	};
@@ -135,10 +198,11 @@ namespace Gw2Api {
 
 		MapEntries maps;
 	};
+	typedef std::shared_ptr<const MapsRootEntry> MapsRootEntryPtr;
 
 	struct WorldNameEntry {
 		int id;
-		std::string name;
+		InternedString name;
 	};
 	typedef EntryDictionary<int, WorldNameEntry> WorldNameEntries;
 
@@ -147,5 +211,6 @@ namespace Gw2Api {
 
 		WorldNameEntries world_names;
 	};
+	typedef std::shared_ptr<const WorldNamesRootEntry> WorldNamesRootEntryPtr;
 
 }
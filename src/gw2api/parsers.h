@@ -13,25 +13,28 @@
 #pragma once
 #include <string>
 #include "rapidjson/document.h"
+#include "jsonarena.h"
 #include "objects.h"
 #include "requests.h"
+#include "streamingparsers.h"
 
 
 namespace Gw2Api {
 
 	namespace Parsers {
 
-		typedef rapidjson::Document RJDoc;
-		typedef rapidjson::Value RJValue;
+		// Parsed documents live in the JsonArena of the parsing thread, so they are only valid within a JsonArena::Scope
+		typedef ArenaDocument RJDoc;
+		typedef ArenaValue RJValue;
 		typedef rapidjson::SizeType RJSizeType;
-		typedef rapidjson::Value::ConstMemberIterator RJIterator;
+		typedef ArenaValue::ConstMemberIterator RJIterator;
 
 
 		template<class T>
 		class ApiResponseParser {
 		protected:
 			virtual bool parseJsonString(const std::string& jsonString, RJDoc* result) const {
-				result->Parse<0>(jsonString.c_str());
+				result->ParseInsitu<0>(JsonArena::copyString(jsonString));
 				return true;
 			}
 
@@ -39,6 +42,7 @@ namespace Gw2Api {
 			virtual bool parse(const RJValue& jsonValue, T* result) const = 0;
 
 			virtual bool parse(const std::string& jsonString, T* result) const {
+				JsonArena::Scope scope;
 				RJDoc jsonObj;
 				parseJsonString(jsonString, &jsonObj);
 				return parse(jsonObj, result);
@@ -98,13 +102,10 @@ namespace Gw2Api {
 				P parser;
 				for (RJIterator i = jsonValue.MemberBegin(); i != jsonValue.MemberEnd(); i++) {
 					std::string key = i->name.GetString();
-					V entry;
-					if (parser.parse(i->value, &entry)) {
-						result->insert(EntryDictionary<std::string, V>::value_type(key, entry));
-					} else {
+					if (!parser.parse(i->value, &result->append(key)))
 						return false;
-					}
 				}
+				result->sort();
 				return true;
 			}
 		};
@@ -118,13 +119,10 @@ namespace Gw2Api {
 				P parser;
 				for (RJIterator i = jsonValue.MemberBegin(); i != jsonValue.MemberEnd(); i++) {
 					int key = atoi(i->name.GetString());
-					V entry;
-					if (parser.parse(i->value, &entry)) {
-						result->insert(EntryDictionary<int, V>::value_type(key, entry));
-					} else {
+					if (!parser.parse(i->value, &result->append(key)))
 						return false;
-					}
 				}
+				result->sort();
 				return true;
 			}
 		};
@@ -173,7 +171,7 @@ namespace Gw2Api {
 
 				if (!rj_poi_id.IsNull() && rj_poi_id.IsInt())	result->poi_id = rj_poi_id.GetInt();
 				if (!rj_name.IsNull() && rj_name.IsString())	result->name = rj_name.GetString();
-				if (!rj_type.IsNull() && rj_type.IsString())	result->type = rj_type.GetString();
+				if (!rj_type.IsNull() && rj_type.IsString())	result->type = PointOfInterestEntry::parseType(rj_type.GetString(), rj_type.GetStringLength());
 				if (!rj_floor.IsNull() && rj_floor.IsInt())		result->floor = rj_floor.GetInt();
 				bool success = true;
 				Vector2DParser vector2DParser;
@@ -272,6 +270,7 @@ namespace Gw2Api {
 				if (!rj_tasks.IsNull())					success &= tasksParser.parse(rj_tasks, &result->tasks);
 				if (!rj_skill_challenges.IsNull())		success &= skillChallengesParser.parse(rj_skill_challenges, &result->skill_challenges);
 				if (!rj_sectors.IsNull())				success &= sectorsParser.parse(rj_sectors, &result->sectors);
+				result->waypoints.build(result->points_of_interest);
 				return success;
 			}
 		};
@@ -299,6 +298,13 @@ namespace Gw2Api {
 
 		class MapFloorRootParser : public ApiResponseParser<MapFloorRootEntry> {
 		public:
+			using ApiResponseParser<MapFloorRootEntry>::parse;
+
+			// map_floor.json is several MB, so the response is parsed straight into the entries instead of through a DOM
+			bool parse(const std::string& jsonString, MapFloorRootEntry* result) const {
+				return Streaming::parseMapFloorRoot(jsonString, result);
+			}
+
 			bool parse(const RJValue& jsonValue, MapFloorRootEntry* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
@@ -355,6 +361,12 @@ namespace Gw2Api {
 		
 		class MapsRootParser : public ApiResponseParser<MapsRootEntry> {
 		public:
+			using ApiResponseParser<MapsRootEntry>::parse;
+
+			bool parse(const std::string& jsonString, MapsRootEntry* result) const {
+				return Streaming::parseMapsRoot(jsonString, result);
+			}
+
 			bool parse(const RJValue& jsonValue, MapsRootEntry* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject() || jsonValue["maps"].IsNull()) return false;
 				
@@ -367,6 +379,32 @@ namespace Gw2Api {
 			}
 		};
 		
+		// maps of the v2 API, e.g. the response of a BatchRequest: an array of maps that contain their id, and "name" instead of "map_name"
+		class MapsV2Parser : public ApiResponseParser<MapsRootEntry> {
+		public:
+			using ApiResponseParser<MapsRootEntry>::parse;
+
+			bool parse(const RJValue& jsonValue, MapsRootEntry* result) const {
+				if (jsonValue.IsNull() || !jsonValue.IsArray()) return false;
+
+				MapParser mapParser;
+				for (RJSizeType i = 0; i < jsonValue.Size(); i++) {
+					const RJValue& rj_map = jsonValue[i];
+					if (rj_map.IsNull() || !rj_map.IsObject()) return false;
+
+					const RJValue& rj_id = rj_map["id"];
+					const RJValue& rj_name = rj_map["name"];
+					if (rj_id.IsNull() || !rj_id.IsInt()) return false;
+
+					MapEntry& entry = result->maps.append(rj_id.GetInt());
+					if (!mapParser.parse(rj_map, &entry)) return false;
+					if (!rj_name.IsNull() && rj_name.IsString()) entry.map_name = rj_name.GetString();
+				}
+				result->maps.sort();
+				return true;
+			}
+		};
+		
 		class WorldNameParser : public ApiResponseParser<WorldNameEntry> {
 		public:
 			bool parse(const RJValue& jsonValue, WorldNameEntry* result) const {
@@ -391,8 +429,9 @@ namespace Gw2Api {
 				EntryCollection<WorldNameEntry> worldNameEntries;
 				if (worldNamesParser.parse(jsonValue, &worldNameEntries)) {
 					for (size_t i = 0; i < worldNameEntries.size(); i++) {
-						result->world_names[worldNameEntries[i].id] = worldNameEntries[i];
+						result->world_names.append(worldNameEntries[i].id) = worldNameEntries[i];
 					}
+					result->world_names.sort();
 					return true;
 				}
 				return false;
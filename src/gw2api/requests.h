@@ -11,8 +11,9 @@
 */
 
 #pragma once
-#include <map>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace Gw2Api {
 
@@ -21,105 +22,115 @@ namespace Gw2Api {
 		const std::string url_map_floor = "https://api.guildwars2.com/v1/map_floor.json";
 		const std::string url_maps = "https://api.guildwars2.com/v1/maps.json";
 		const std::string url_world_names = "https://api.guildwars2.com/v1/world_names.json";
+		const std::string url_v2_maps = "https://api.guildwars2.com/v2/maps";
 
-		struct ApiRequest {
-			ApiRequest() { }
-
-			ApiRequest(const std::string& url) {
-				this->url = url;
-			}
+		// The v2 API answers at most this many ids at once
+		const size_t maxBatchSize = 200;
 
-			std::string url;
-			std::map<std::string, std::string> parameters;
-
-			std::string getFullUrl() const {
-				std::string partParameters = std::string();
-				for (std::map<std::string, std::string>::const_iterator i = parameters.begin(); i != parameters.end(); i++) {
-					if (!partParameters.empty())
-						partParameters += "&";
-					partParameters += i->first;
-					partParameters += "=";
-					partParameters += i->second;
-				}
+		enum Endpoint {
+			EndpointNone = 0,
+			EndpointMapFloor,
+			EndpointMaps,
+			EndpointWorldNames
+		};
 
-				std::string url = std::string(this->url);
-				if (!partParameters.empty()) {
-					url += "?";
-					url += partParameters;
-				}
+		// Identifies a request without building its url: the endpoint in the top 4 bits, followed by both parameters with 30 bits each
+		typedef uint64_t RequestKey;
 
-				return url;
-			}
+		// Folds the parameters into the lower bits, size_t only has 32 of them on x86
+		struct RequestKeyHash {
+			size_t operator()(RequestKey key) const { return (size_t)(key ^ (key >> 32)); }
 		};
 
-		struct MapFloorRequest : ApiRequest {
-			MapFloorRequest() {
-				this->url = url_map_floor;
-			}
+		inline RequestKey makeKey(Endpoint endpoint, int param0, int param1) {
+			return ((RequestKey)endpoint << 60) | ((RequestKey)(param0 & 0x3FFFFFFF) << 30) | (RequestKey)(param1 & 0x3FFFFFFF);
+		}
 
-			MapFloorRequest(const int continent_id, const int floor) {
-				this->url = url_map_floor;
-				setContinentID(continent_id);
-				setFloor(floor);
+		// An endpoint with up to two integer parameters (0 if unused). The key is computed once, since it's what the caches look requests up by;
+		// the url is only built for an actual download. Immutable, so key and parameters always match.
+		struct ApiRequest {
+			ApiRequest() : endpoint(EndpointNone), key(makeKey(EndpointNone, 0, 0)) {
+				params[0] = params[1] = 0;
 			}
 
-			void setContinentID(const int continent_id) {
-				parameters["continent_id"] = std::to_string((long long)continent_id);
+			ApiRequest(Endpoint endpoint, int param0, int param1) : endpoint(endpoint), key(makeKey(endpoint, param0, param1)) {
+				params[0] = param0;
+				params[1] = param1;
 			}
 
-			int getContinentID() {
-				std::map<std::string, std::string>::iterator it = parameters.find("continent_id");
-				if (it != parameters.end())
-					return atoi(it->second.c_str());
-				return 1;
-			}
+			Endpoint getEndpoint() const { return endpoint; }
+			RequestKey getKey() const { return key; }
+			// The key of the same endpoint without parameters
+			RequestKey getEndpointKey() const { return makeKey(endpoint, 0, 0); }
+			// The parameters are named by the requests of the endpoints (e.g. MapsRequest::getMapID), this is for code that handles any request
+			int getParameter(int index) const { return params[index]; }
 
-			void setFloor(const int floor) {
-				parameters["floor"] = std::to_string((long long)floor);
+			std::string getFullUrl() const {
+				switch (endpoint) {
+					case EndpointMapFloor:
+						return url_map_floor + "?continent_id=" + std::to_string((long long)params[0]) + "&floor=" + std::to_string((long long)params[1]);
+					case EndpointMaps:
+						if (params[0] > 0)
+							return url_maps + "?map_id=" + std::to_string((long long)params[0]);
+						return url_maps;
+					case EndpointWorldNames:
+						return url_world_names;
+					default:
+						return std::string();
+				}
 			}
 
-			int getFloor() {
-				std::map<std::string, std::string>::iterator it = parameters.find("floor");
-				if (it != parameters.end())
-					return atoi(it->second.c_str());
-				return 1;
-			}
+		protected:
+			Endpoint endpoint;
+			int params[2];
+			RequestKey key;
 		};
 
-		struct MapsRequest : ApiRequest {
-			MapsRequest() {
-				this->url = url_maps;
-			}
+		struct MapFloorRequest : ApiRequest {
+			MapFloorRequest(const int continent_id, const int floor) : ApiRequest(EndpointMapFloor, continent_id, floor) { }
 
-			MapsRequest(const int map_id) {
-				this->url = url_maps;
-				setMapID(map_id);
-			}
+			int getContinentID() const { return params[0]; }
+			int getFloor() const { return params[1]; }
+		};
 
-			void setMapID(const int map_id) {
-				if (map_id > 0) {
-					parameters["map_id"] = std::to_string((long long)map_id);
-				} else {
-					parameters.erase("map_id");
-				}
-			}
-			
-			int getMapID() {
-				std::map<std::string, std::string>::iterator it = parameters.find("map_id");
-				if (it != parameters.end())
-					return atoi(it->second.c_str());
-				return 0;
-			}
+		struct MapsRequest : ApiRequest {
+			// All maps
+			MapsRequest() : ApiRequest(EndpointMaps, 0, 0) { }
+			// A single map, or all maps if map_id isn't positive
+			MapsRequest(const int map_id) : ApiRequest(EndpointMaps, map_id > 0 ? map_id : 0, 0) { }
 
-			void removeMapID() {
-				setMapID(0);
-			}
+			int getMapID() const { return params[0]; }
 		};
 
 		struct WorldNamesRequest : ApiRequest {
-			WorldNamesRequest() {
-				this->url = url_world_names;
+			WorldNamesRequest() : ApiRequest(EndpointWorldNames, 0, 0) { }
+		};
+
+		// Several objects of an endpoint at once through the ids parameter of the v2 API. It has no key, since the response isn't cached as a whole:
+		// every object in it is cached like the response of its own single request (e.g. MapsRequest(map_id)).
+		struct BatchRequest {
+			BatchRequest(Endpoint endpoint, const std::vector<int>& ids) : endpoint(endpoint), ids(ids) { }
+
+			Endpoint getEndpoint() const { return endpoint; }
+			const std::vector<int>& getIDs() const { return ids; }
+
+			std::string getFullUrl() const {
+				std::string url;
+				switch (endpoint) {
+					case EndpointMaps:
+						url = url_v2_maps;
+						break;
+					default:
+						return std::string();
+				}
+				for (size_t i = 0; i < ids.size(); i++)
+					url += (i == 0 ? "?ids=" : ",") + std::to_string((long long)ids[i]);
+				return url;
 			}
+
+		private:
+			Endpoint endpoint;
+			std::vector<int> ids;
 		};
 
 	}
@@ -0,0 +1,352 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <vector>
+#include "rapidjson/reader.h"
+#include "jsonarena.h"
+#include "streamingparsers.h"
+
+namespace Gw2Api {
+
+	namespace Parsers {
+
+		namespace Streaming {
+
+			namespace {
+
+				/*
+				 * Keeps track of where the reader is in the document and hands values over to the derived handler.
+				 * Everything inside a container the derived handler doesn't want is skipped without looking at it.
+				 * The contexts are chosen by the derived handler, the negative ones are reserved for this class.
+				 */
+				class Handler {
+				public:
+					typedef char Ch;
+
+					Handler() : skipDepth(0), failed(false), rect(NULL), vector(NULL) { }
+					virtual ~Handler() { }
+
+					bool parse(const std::string& jsonString) {
+						JsonArena::Scope scope;
+						ArenaReader reader;
+						rapidjson::StringStream stream(jsonString.c_str());
+						return reader.Parse<0>(stream, *this) && !failed;
+					}
+
+					// rapidjson handler concept
+					void Null() { value(); }
+					void Bool(bool) { value(); }
+					void Int(int i) { number(i, true); }
+					void Uint(unsigned i) { number(i, i <= INT_MAX); }
+					void Int64(int64_t i) { number((double)i, false); }
+					void Uint64(uint64_t i) { number((double)i, false); }
+					void Double(double d) { number(d, false); }
+					void String(const Ch* str, rapidjson::SizeType length, bool) {
+						if (skipDepth > 0)
+							return;
+						Frame& frame = frames.back();
+						if (!frame.isArray && frame.expectingName) {
+							name.assign(str, length);
+							frame.expectingName = false;
+							return;
+						}
+						onString(frame.context, str, length);
+						value();
+					}
+					void StartObject() { start(false); }
+					void EndObject(rapidjson::SizeType) { end(); }
+					void StartArray() { start(true); }
+					void EndArray(rapidjson::SizeType) { end(); }
+
+				protected:
+					static const int None = -1; // Parent context of the root
+					static const int Skip = -2; // Ignore this value
+					static const int Invalid = -3; // Fail, the value has the wrong type
+					static const int RectValue = -4;
+					static const int VectorValue = -5;
+
+					// Called when a container starts inside parent; name or index() tell where it is
+					virtual int onEnter(int parent, bool isArray) = 0;
+					virtual void onNumber(int context, double value, bool isInt) { }
+					virtual void onString(int context, const char* str, rapidjson::SizeType length) { }
+					virtual void onLeave(int context) { }
+
+					int enterRect(Rect* target, bool isArray) {
+						if (!isArray)
+							return Invalid;
+						rect = target;
+						return RectValue;
+					}
+
+					int enterVector(Vector2D* target, bool isArray) {
+						if (!isArray)
+							return Invalid;
+						vector = target;
+						return VectorValue;
+					}
+
+					// Index of the current value in its array
+					unsigned index() const { return frames.back().index; }
+
+					std::string name; // Name of the current member in its object
+
+				private:
+					struct Frame {
+						Frame(int context, bool isArray) : context(context), isArray(isArray), expectingName(true), index(0) { }
+
+						int context;
+						bool isArray;
+						bool expectingName;
+						unsigned index;
+					};
+
+					void value() {
+						if (skipDepth > 0 || frames.empty())
+							return;
+						Frame& frame = frames.back();
+						if (frame.isArray)
+							frame.index++;
+						else
+							frame.expectingName = true;
+					}
+
+					void number(double number, bool isInt) {
+						if (skipDepth > 0)
+							return;
+						int context = frames.back().context;
+						if (context == VectorValue) {
+							if (index() == 0)
+								vector->x = number;
+							else if (index() == 1)
+								vector->y = number;
+						} else {
+							onNumber(context, number, isInt);
+						}
+						value();
+					}
+
+					void start(bool isArray) {
+						if (skipDepth > 0) {
+							skipDepth++;
+							return;
+						}
+
+						int parent = frames.empty() ? None : frames.back().context;
+						int context = Skip;
+						if (parent == RectValue) {
+							if (index() < 2)
+								context = enterVector(index() == 0 ? &rect->upperLeft : &rect->bottomRight, isArray);
+						} else if (parent != VectorValue) {
+							context = onEnter(parent, isArray);
+						}
+
+						if (context == Invalid) {
+							failed = true;
+							context = Skip;
+						}
+						if (context == Skip) {
+							skipDepth = 1;
+							return;
+						}
+						frames.push_back(Frame(context, isArray));
+					}
+
+					void end() {
+						if (skipDepth > 0) {
+							if (--skipDepth == 0)
+								value();
+							return;
+						}
+						int context = frames.back().context;
+						frames.pop_back();
+						onLeave(context);
+						value();
+					}
+
+					std::vector<Frame> frames;
+					int skipDepth; // Nesting level inside a skipped container
+					bool failed;
+					Rect* rect;
+					Vector2D* vector;
+				};
+
+
+				class MapFloorRootHandler : public Handler {
+				public:
+					MapFloorRootHandler(MapFloorRootEntry* result) : result(result), region(NULL), map(NULL), pointOfInterest(NULL) { }
+
+				protected:
+					enum Context { Root, Regions, Region, Maps, Map, PointsOfInterest, PointOfInterest };
+
+					int onEnter(int parent, bool isArray) {
+						switch (parent) {
+						case None:
+							return isArray ? Invalid : Root;
+						case Root:
+							if (name == "texture_dims") return enterVector(&result->texture_dims, isArray);
+							if (name == "clamped_view") return enterRect(&result->clamped_view, isArray);
+							if (name == "regions") return isArray ? Invalid : Regions;
+							return Skip;
+						case Regions:
+							if (isArray) return Invalid;
+							region = &result->regions.append(atoi(name.c_str()));
+							return Region;
+						case Region:
+							if (name == "label_coord") return enterVector(&region->label_coord, isArray);
+							if (name == "maps") return isArray ? Invalid : Maps;
+							return Skip;
+						case Maps:
+							if (isArray) return Invalid;
+							map = &region->maps.append(atoi(name.c_str()));
+							return Map;
+						case Map:
+							if (name == "map_rect") return enterRect(&map->map_rect, isArray);
+							if (name == "continent_rect") return enterRect(&map->continent_rect, isArray);
+							if (name == "points_of_interest") return isArray ? PointsOfInterest : Invalid;
+							return Skip; // tasks, skill_challenges, sectors
+						case PointsOfInterest:
+							if (isArray) return Invalid;
+							map->points_of_interest.push_back(PointOfInterestEntry());
+							pointOfInterest = &map->points_of_interest.back();
+							return PointOfInterest;
+						case PointOfInterest:
+							if (name == "coord") return enterVector(&pointOfInterest->coord, isArray);
+							return Skip;
+						}
+						return Skip;
+					}
+
+					void onNumber(int context, double value, bool isInt) {
+						if (!isInt)
+							return;
+						if (context == Map) {
+							if (name == "min_level") map->min_level = (int)value;
+							else if (name == "max_level") map->max_level = (int)value;
+							else if (name == "default_floor") map->default_floor = (int)value;
+						} else if (context == PointOfInterest) {
+							if (name == "poi_id") pointOfInterest->poi_id = (int)value;
+							else if (name == "floor") pointOfInterest->floor = (int)value;
+						}
+					}
+
+					void onString(int context, const char* str, rapidjson::SizeType length) {
+						if (context == Region) {
+							if (name == "name") region->name.assign(str, length);
+						} else if (context == Map) {
+							if (name == "name") map->name.assign(str, length);
+						} else if (context == PointOfInterest) {
+							if (name == "name") pointOfInterest->name.assign(str, length);
+							else if (name == "type") pointOfInterest->type = PointOfInterestEntry::parseType(str, length);
+						}
+					}
+
+					void onLeave(int context) {
+						if (context == Regions)
+							result->regions.sort();
+						else if (context == Maps)
+							region->maps.sort();
+						else if (context == Map)
+							map->waypoints.build(map->points_of_interest);
+					}
+
+				private:
+					MapFloorRootEntry* result;
+					MapFloorRegionEntry* region;
+					MapFloorEntry* map;
+					PointOfInterestEntry* pointOfInterest;
+				};
+
+
+				class MapsRootHandler : public Handler {
+				public:
+					MapsRootHandler(MapsRootEntry* result) : result(result), map(NULL), hasMaps(false) { }
+
+					bool parse(const std::string& jsonString) {
+						return Handler::parse(jsonString) && hasMaps;
+					}
+
+				protected:
+					enum Context { Root, Maps, Map, Floors };
+
+					int onEnter(int parent, bool isArray) {
+						switch (parent) {
+						case None:
+							return isArray ? Invalid : Root;
+						case Root:
+							if (name != "maps") return Skip;
+							if (isArray) return Invalid;
+							hasMaps = true;
+							return Maps;
+						case Maps:
+							if (isArray) return Invalid;
+							map = &result->maps.append(atoi(name.c_str()));
+							return Map;
+						case Map:
+							if (name == "floors") return isArray ? Floors : Invalid;
+							if (name == "map_rect") return enterRect(&map->map_rect, isArray);
+							if (name == "continent_rect") return enterRect(&map->continent_rect, isArray);
+							return Skip;
+						}
+						return Skip;
+					}
+
+					void onNumber(int context, double value, bool isInt) {
+						if (context == Floors) {
+							map->floors.push_back((int)value);
+						} else if (context == Map && isInt) {
+							if (name == "min_level") map->min_level = (int)value;
+							else if (name == "max_level") map->max_level = (int)value;
+							else if (name == "default_floor") map->default_floor = (int)value;
+							else if (name == "region_id") map->region_id = (int)value;
+							else if (name == "continent_id") map->continent_id = (int)value;
+						}
+					}
+
+					void onString(int context, const char* str, rapidjson::SizeType length) {
+						if (context != Map)
+							return;
+						if (name == "map_name") map->map_name.assign(str, length);
+						else if (name == "region_name") map->region_name.assign(str, length);
+						else if (name == "continent_name") map->continent_name.assign(str, length);
+					}
+
+					void onLeave(int context) {
+						if (context == Maps)
+							result->maps.sort();
+					}
+
+				private:
+					MapsRootEntry* result;
+					MapEntry* map;
+					bool hasMaps;
+				};
+
+			}
+
+
+			bool parseMapFloorRoot(const std::string& jsonString, MapFloorRootEntry* result) {
+				MapFloorRootHandler handler(result);
+				return handler.parse(jsonString);
+			}
+
+			bool parseMapsRoot(const std::string& jsonString, MapsRootEntry* result) {
+				MapsRootHandler handler(result);
+				return handler.parse(jsonString);
+			}
+
+		}
+
+	}
+
+}
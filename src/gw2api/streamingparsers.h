@@ -0,0 +1,33 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <string>
+#include "objects.h"
+
+namespace Gw2Api {
+
+	namespace Parsers {
+
+		// SAX based parsers for the large endpoints: they fill the entries while reading the response, without building a DOM first.
+		// Fields the plugin doesn't use (e.g. tasks, skill_challenges and sectors of map floors) are skipped while parsing.
+		namespace Streaming {
+
+			bool parseMapFloorRoot(const std::string& jsonString, MapFloorRootEntry* result);
+
+			bool parseMapsRoot(const std::string& jsonString, MapsRootEntry* result);
+
+		}
+
+	}
+
+}
@@ -0,0 +1,209 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include "math.h"
+
+namespace Gw2Api {
+
+	// Packed waypoint coordinates of a single map (floor), bucketed in a uniform grid.
+	// The coordinates are stored sorted by grid cell, so every cell is one contiguous range in the arrays.
+	class WaypointIndex {
+
+	private:
+		std::vector<float> xs;
+		std::vector<float> ys;
+		std::vector<uint32_t> poiIndices; // Index in the points of interest the index has been built from
+		std::vector<uint32_t> cellStart; // cellStart[c] .. cellStart[c + 1] is the range of cell c
+		float originX;
+		float originY;
+		float cellSize;
+		int columns;
+		int rows;
+
+		struct Item {
+			int cell;
+			float x;
+			float y;
+			uint32_t poiIndex;
+
+			bool operator<(const Item& other) const { return cell < other.cell; }
+		};
+
+		int getCell(int column, int row) const {
+			return row * columns + column;
+		}
+
+		int clamp(int value, int max) const {
+			return value < 0 ? 0 : (value >= max ? max - 1 : value);
+		}
+
+		int getColumn(double x) const {
+			return clamp((int)floor((x - originX) / cellSize), columns);
+		}
+
+		int getRow(double y) const {
+			return clamp((int)floor((y - originY) / cellSize), rows);
+		}
+
+		// closest[0] and distanceSq[0] are the closest one so far, closest[1] and distanceSq[1] the second closest
+		void scanCell(int column, int row, double x, double y, uint32_t closest[2], double distanceSq[2]) const {
+			int cell = getCell(column, row);
+			for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; i++) {
+				double dx = xs[i] - x;
+				double dy = ys[i] - y;
+				double d = dx * dx + dy * dy;
+				if (d < distanceSq[0]) {
+					distanceSq[1] = distanceSq[0];
+					closest[1] = closest[0];
+					distanceSq[0] = d;
+					closest[0] = i;
+				} else if (d < distanceSq[1]) {
+					distanceSq[1] = d;
+					closest[1] = i;
+				}
+			}
+		}
+
+		// Searches the grid in rings around the cell of the position, until the next ring can't contain anything closer than the last one wanted
+		int search(const Vector2D& position, int count, uint32_t closest[2], double distanceSq[2]) const {
+			int column = getColumn(position.x);
+			int row = getRow(position.y);
+			closest[0] = closest[1] = 0;
+			distanceSq[0] = distanceSq[1] = HUGE_VAL;
+			int maxRing = std::max(columns, rows);
+			for (int ring = 0; ring <= maxRing; ring++) {
+				int left = column - ring, right = column + ring, top = row - ring, bottom = row + ring;
+				for (int c = std::max(left, 0); c <= std::min(right, columns - 1); c++) {
+					if (top >= 0)
+						scanCell(c, top, position.x, position.y, closest, distanceSq);
+					if (bottom < rows && bottom != top)
+						scanCell(c, bottom, position.x, position.y, closest, distanceSq);
+				}
+				for (int r = std::max(top + 1, 0); r <= std::min(bottom - 1, rows - 1); r++) {
+					if (left >= 0)
+						scanCell(left, r, position.x, position.y, closest, distanceSq);
+					if (right < columns && right != left)
+						scanCell(right, r, position.x, position.y, closest, distanceSq);
+				}
+
+				// Everything in the next ring is at least this far away
+				double ringDistance = ring * (double)cellSize;
+				if (distanceSq[count - 1] != HUGE_VAL && distanceSq[count - 1] <= ringDistance * ringDistance)
+					break;
+			}
+			return distanceSq[1] != HUGE_VAL ? 2 : 1;
+		}
+
+	public:
+		WaypointIndex() : originX(0), originY(0), cellSize(1), columns(0), rows(0) { }
+
+		size_t size() const { return xs.size(); }
+		bool empty() const { return xs.empty(); }
+
+		// Builds the index from all points of interest with the type Waypoint
+		template<class T>
+		void build(const T& pointsOfInterest) {
+			std::vector<Item> items;
+			float minX = 0, minY = 0, maxX = 0, maxY = 0;
+			for (uint32_t i = 0; i < pointsOfInterest.size(); i++) {
+				if (pointsOfInterest[i].type != T::value_type::Waypoint)
+					continue;
+
+				Item item;
+				item.cell = 0;
+				item.x = (float)pointsOfInterest[i].coord.x;
+				item.y = (float)pointsOfInterest[i].coord.y;
+				item.poiIndex = i;
+				if (items.empty()) {
+					minX = maxX = item.x;
+					minY = maxY = item.y;
+				} else {
+					minX = std::min(minX, item.x);
+					minY = std::min(minY, item.y);
+					maxX = std::max(maxX, item.x);
+					maxY = std::max(maxY, item.y);
+				}
+				items.push_back(item);
+			}
+
+			xs.clear();
+			ys.clear();
+			poiIndices.clear();
+			cellStart.clear();
+			columns = rows = 0;
+			if (items.empty())
+				return;
+
+			// Aim for roughly two waypoints per cell, with a sane upper bound on the grid dimensions
+			float width = std::max(maxX - minX, 1.0f);
+			float height = std::max(maxY - minY, 1.0f);
+			cellSize = std::max((float)sqrt(width * height * 2 / items.size()), 1.0f);
+			columns = std::min((int)(width / cellSize) + 1, 64);
+			rows = std::min((int)(height / cellSize) + 1, 64);
+			cellSize = std::max(width / columns, height / rows) * 1.0001f; // Keep the max coordinates inside the grid
+			originX = minX;
+			originY = minY;
+
+			for (size_t i = 0; i < items.size(); i++)
+				items[i].cell = getCell(getColumn(items[i].x), getRow(items[i].y));
+			std::stable_sort(items.begin(), items.end());
+
+			xs.reserve(items.size());
+			ys.reserve(items.size());
+			poiIndices.reserve(items.size());
+			cellStart.assign(columns * rows + 1, 0);
+			for (size_t i = 0; i < items.size(); i++) {
+				xs.push_back(items[i].x);
+				ys.push_back(items[i].y);
+				poiIndices.push_back(items[i].poiIndex);
+				cellStart[items[i].cell + 1]++;
+			}
+			for (size_t c = 1; c < cellStart.size(); c++)
+				cellStart[c] += cellStart[c - 1];
+		}
+
+		// Finds the closest waypoint. Returns the index in the points of interest the index has been built from.
+		bool findClosest(const Vector2D& position, uint32_t* poiIndex, double* distance) const {
+			if (xs.empty())
+				return false;
+
+			uint32_t closest[2];
+			double distanceSq[2];
+			search(position, 1, closest, distanceSq);
+			*poiIndex = poiIndices[closest[0]];
+			*distance = sqrt(distanceSq[0]);
+			return true;
+		}
+
+		// Finds the closest two waypoints, closest first; returns how many there are (up to 2)
+		int findClosestTwo(const Vector2D& position, uint32_t poiIndex[2], double distance[2]) const {
+			if (xs.empty())
+				return 0;
+
+			uint32_t closest[2];
+			double distanceSq[2];
+			int found = search(position, xs.size() > 1 ? 2 : 1, closest, distanceSq);
+			for (int i = 0; i < found; i++) {
+				poiIndex[i] = poiIndices[closest[i]];
+				distance[i] = sqrt(distanceSq[i]);
+			}
+			return found;
+		}
+
+	};
+
+}
@@ -10,12 +10,19 @@
  * GNU General Public License for more details.
 */
 
+#include <algorithm>
 #include "plugin_definitions.h"
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #include "gw2api/chat.h"
+#include "gw2api/jsonarena.h"
+#include "deadreckoning.h"
 #include "gw2info.h"
+#include "gw2infocodec.h"
+#include "gw2mathutils.h"
+#include "stringutils.h"
+#include "updatechecker.h"
 using namespace std;
 using namespace Gw2Api;
 using namespace Gw2Api::ChatLink;
@@ -29,98 +36,170 @@ using namespace Gw2Api::MumbleLink;
 
 
 Gw2Info::Gw2Info(string jsonString) {
-	rapidjson::Document json;
-	if (!json.Parse<0>(jsonString.c_str()).HasParseError()) {
-		const rapidjson::Value& rj_character_name = json["character_name"];
-		const rapidjson::Value& rj_profession = json["profession"];
-		const rapidjson::Value& rj_character_continent_position = json["character_continent_position"];
-		const rapidjson::Value& rj_map_id = json["map_id"];
-		const rapidjson::Value& rj_map_name = json["map_name"];
-		const rapidjson::Value& rj_region_id = json["region_id"];
-		const rapidjson::Value& rj_region_name = json["region_name"];
-		const rapidjson::Value& rj_continent_id = json["continent_id"];
-		const rapidjson::Value& rj_continent_name = json["continent_name"];
-		const rapidjson::Value& rj_world_id = json["world_id"];
-		const rapidjson::Value& rj_world_name = json["world_name"];
-		const rapidjson::Value& rj_waypoint_id = json["waypoint_id"];
-		const rapidjson::Value& rj_waypoint_name = json["waypoint_name"];
-		const rapidjson::Value& rj_waypoint_continent_position = json["waypoint_continent_position"];
-		const rapidjson::Value& rj_team_color_id = json["team_color_id"];
-		const rapidjson::Value& rj_commander = json["commander"];
-		const rapidjson::Value& rj_plugin_version = json["plugin_version"];
-
-		if (!rj_character_name.IsNull() && rj_character_name.IsString())		characterName = rj_character_name.GetString();
-		if (!rj_profession.IsNull() && rj_profession.IsInt())					profession = (Profession)rj_profession.GetInt();
-		if (!rj_character_continent_position.IsNull() && rj_character_continent_position.IsArray()) {
-			characterContinentPosition = Vector3D(
-				rj_character_continent_position[0u].GetDouble(),
-				rj_character_continent_position[1].GetDouble(),
-				rj_character_continent_position[2].GetDouble()
-			);
-		}
-		if (!rj_map_id.IsNull() && rj_map_id.IsInt())							mapId = rj_map_id.GetInt();
-		if (!rj_map_name.IsNull() && rj_map_name.IsString())					mapName = rj_map_name.GetString();
-		if (!rj_region_id.IsNull() && rj_region_id.IsInt())						regionId = rj_region_id.GetInt();
-		if (!rj_region_name.IsNull() && rj_region_name.IsString())				regionName = rj_region_name.GetString();
-		if (!rj_continent_id.IsNull() && rj_continent_id.IsInt())				continentId = rj_continent_id.GetInt();
-		if (!rj_continent_name.IsNull() && rj_continent_name.IsString())		continentName = rj_continent_name.GetString();
-		if (!rj_world_id.IsNull() && rj_world_id.IsInt())						worldId = rj_world_id.GetInt();
-		if (!rj_world_name.IsNull() && rj_world_name.IsString())				worldName = rj_world_name.GetString();
-		if (!rj_waypoint_id.IsNull() && rj_waypoint_id.IsInt())					waypointId = rj_waypoint_id.GetInt();
-		if (!rj_waypoint_name.IsNull() && rj_waypoint_name.IsString())			waypointName = rj_waypoint_name.GetString();
-		if (!rj_waypoint_continent_position.IsNull() && rj_waypoint_continent_position.IsArray()) {
-			waypointContinentPosition = Vector2D(
-				rj_waypoint_continent_position[0u].GetDouble(),
-				rj_waypoint_continent_position[1].GetDouble()
-			);
-		}
-		if (!rj_team_color_id.IsNull() && rj_team_color_id.IsString())			teamColorId = rj_team_color_id.GetInt();
-		if (!rj_commander.IsNull() && rj_commander.IsBool())					commander = rj_commander.GetBool();
-		if (!rj_plugin_version.IsNull() && rj_plugin_version.IsString())		pluginVersion = rj_plugin_version.GetString();
+	clear();
+	applyJson(jsonString, NULL);
+}
+
+bool Gw2Info::applyJson(const StringRef& jsonString, uint32_t* sequence) {
+	JsonArena::Scope scope;
+	ArenaDocument json;
+	if (json.ParseInsitu<0>(JsonArena::copyString(jsonString.data(), jsonString.size())).HasParseError() || !json.IsObject())
+		return false;
+
+	const ArenaValue& rj_seq = json["seq"];
+	const ArenaValue& rj_character_name = json["character_name"];
+	const ArenaValue& rj_profession = json["profession"];
+	const ArenaValue& rj_character_continent_position = json["character_continent_position"];
+	const ArenaValue& rj_character_continent_velocity = json["character_continent_velocity"];
+	const ArenaValue& rj_map_id = json["map_id"];
+	const ArenaValue& rj_map_name = json["map_name"];
+	const ArenaValue& rj_region_id = json["region_id"];
+	const ArenaValue& rj_region_name = json["region_name"];
+	const ArenaValue& rj_continent_id = json["continent_id"];
+	const ArenaValue& rj_continent_name = json["continent_name"];
+	const ArenaValue& rj_world_id = json["world_id"];
+	const ArenaValue& rj_world_name = json["world_name"];
+	const ArenaValue& rj_waypoint_id = json["waypoint_id"];
+	const ArenaValue& rj_waypoint_name = json["waypoint_name"];
+	const ArenaValue& rj_waypoint_continent_position = json["waypoint_continent_position"];
+	const ArenaValue& rj_team_color_id = json["team_color_id"];
+	const ArenaValue& rj_commander = json["commander"];
+	const ArenaValue& rj_plugin_version = json["plugin_version"];
+
+	// Senders in ids-only mode don't send names, so names of ids that change are stale
+	uint32_t oldMapId = mapId, oldWorldId = worldId, oldWaypointId = waypointId;
+
+	if (sequence != NULL && !rj_seq.IsNull() && rj_seq.IsUint())			*sequence = rj_seq.GetUint();
+	if (!rj_character_name.IsNull() && rj_character_name.IsString())		characterName = rj_character_name.GetString();
+	if (!rj_profession.IsNull() && rj_profession.IsInt())					profession = (Profession)rj_profession.GetInt();
+	if (!rj_character_continent_position.IsNull() && rj_character_continent_position.IsArray()) {
+		characterContinentPosition = Vector3D(
+			rj_character_continent_position[0u].GetDouble(),
+			rj_character_continent_position[1].GetDouble(),
+			rj_character_continent_position[2].GetDouble()
+		);
+	}
+	if (!rj_character_continent_velocity.IsNull() && rj_character_continent_velocity.IsArray()) {
+		characterContinentVelocity = Vector2D(
+			rj_character_continent_velocity[0u].GetDouble(),
+			rj_character_continent_velocity[1].GetDouble()
+		);
 	}
+	if (!rj_map_id.IsNull() && rj_map_id.IsInt())							mapId = rj_map_id.GetInt();
+	if (!rj_map_name.IsNull() && rj_map_name.IsString())					mapName = rj_map_name.GetString();
+	if (!rj_region_id.IsNull() && rj_region_id.IsInt())						regionId = rj_region_id.GetInt();
+	if (!rj_region_name.IsNull() && rj_region_name.IsString())				regionName = rj_region_name.GetString();
+	if (!rj_continent_id.IsNull() && rj_continent_id.IsInt())				continentId = rj_continent_id.GetInt();
+	if (!rj_continent_name.IsNull() && rj_continent_name.IsString())		continentName = rj_continent_name.GetString();
+	if (!rj_world_id.IsNull() && rj_world_id.IsInt())						worldId = rj_world_id.GetInt();
+	if (!rj_world_name.IsNull() && rj_world_name.IsString())				worldName = rj_world_name.GetString();
+	if (!rj_waypoint_id.IsNull() && rj_waypoint_id.IsInt())					waypointId = rj_waypoint_id.GetInt();
+	if (!rj_waypoint_name.IsNull() && rj_waypoint_name.IsString())			waypointName = rj_waypoint_name.GetString();
+	if (!rj_waypoint_continent_position.IsNull() && rj_waypoint_continent_position.IsArray()) {
+		waypointContinentPosition = Vector2D(
+			rj_waypoint_continent_position[0u].GetDouble(),
+			rj_waypoint_continent_position[1].GetDouble()
+		);
+	}
+	if (!rj_team_color_id.IsNull() && rj_team_color_id.IsInt())				teamColorId = rj_team_color_id.GetInt();
+	if (!rj_commander.IsNull() && rj_commander.IsBool())					commander = rj_commander.GetBool();
+	if (!rj_plugin_version.IsNull() && rj_plugin_version.IsString())		pluginVersion = rj_plugin_version.GetString();
+
+	if (mapId != oldMapId && rj_map_name.IsNull()) {
+		mapName = "";
+		regionName = "";
+		continentName = "";
+	}
+	if (worldId != oldWorldId && rj_world_name.IsNull())
+		worldName = "";
+	if (waypointId != oldWaypointId && rj_waypoint_name.IsNull())
+		waypointName = "";
+	return true;
 }
 
-string Gw2Info::toJson() const {
-	rapidjson::Document json;
-	json.Parse<0>("{}");
-	json.AddMember("character_name", characterName.c_str(), json.GetAllocator());
-	json.AddMember("profession", profession, json.GetAllocator());
-	json.AddMember("character_continent_position", "[]", json.GetAllocator());
-	json["character_continent_position"].SetArray();
-	json["character_continent_position"].PushBack(characterContinentPosition.x, json.GetAllocator());
-	json["character_continent_position"].PushBack(characterContinentPosition.y, json.GetAllocator());
-	json["character_continent_position"].PushBack(characterContinentPosition.z, json.GetAllocator());
-	json.AddMember("map_id", mapId, json.GetAllocator());
-	json.AddMember("map_name", mapName.c_str(), json.GetAllocator());
-	json.AddMember("region_id", regionId, json.GetAllocator());
-	json.AddMember("region_name", regionName.c_str(), json.GetAllocator());
-	json.AddMember("continent_id", continentId, json.GetAllocator());
-	json.AddMember("continent_name", continentName.c_str(), json.GetAllocator());
-	json.AddMember("world_id", worldId, json.GetAllocator());
-	json.AddMember("world_name", worldName.c_str(), json.GetAllocator());
-	json.AddMember("waypoint_id", waypointId, json.GetAllocator());
-	json.AddMember("waypoint_name", waypointName.c_str(), json.GetAllocator());
-	json.AddMember("waypoint_continent_position", "[]", json.GetAllocator());
-	json["waypoint_continent_position"].SetArray();
-	json["waypoint_continent_position"].PushBack(waypointContinentPosition.x, json.GetAllocator());
-	json["waypoint_continent_position"].PushBack(waypointContinentPosition.y, json.GetAllocator());
-	json.AddMember("team_color_id", teamColorId, json.GetAllocator());
-	json.AddMember("commander", commander, json.GetAllocator());
-	json.AddMember("plugin_version", pluginVersion.c_str(), json.GetAllocator());
+/* Adds all fields to the object, without the names if idsOnly is set */
+static void addJsonMembers(const Gw2Info& info, bool idsOnly, rapidjson::Document& json) {
+	rapidjson::Document::AllocatorType& allocator = json.GetAllocator();
+	json.AddMember("character_name", info.characterName.c_str(), allocator);
+	json.AddMember("profession", info.profession, allocator);
+	rapidjson::Value position(rapidjson::kArrayType);
+	position.PushBack(info.characterContinentPosition.x, allocator);
+	position.PushBack(info.characterContinentPosition.y, allocator);
+	position.PushBack(info.characterContinentPosition.z, allocator);
+	json.AddMember("character_continent_position", position, allocator);
+	rapidjson::Value velocity(rapidjson::kArrayType);
+	velocity.PushBack(info.characterContinentVelocity.x, allocator);
+	velocity.PushBack(info.characterContinentVelocity.y, allocator);
+	json.AddMember("character_continent_velocity", velocity, allocator);
+	json.AddMember("map_id", info.mapId, allocator);
+	if (!idsOnly)
+		json.AddMember("map_name", info.mapName.c_str(), allocator);
+	json.AddMember("region_id", info.regionId, allocator);
+	if (!idsOnly)
+		json.AddMember("region_name", info.regionName.c_str(), allocator);
+	json.AddMember("continent_id", info.continentId, allocator);
+	if (!idsOnly)
+		json.AddMember("continent_name", info.continentName.c_str(), allocator);
+	json.AddMember("world_id", info.worldId, allocator);
+	if (!idsOnly)
+		json.AddMember("world_name", info.worldName.c_str(), allocator);
+	json.AddMember("waypoint_id", info.waypointId, allocator);
+	if (!idsOnly)
+		json.AddMember("waypoint_name", info.waypointName.c_str(), allocator);
+	rapidjson::Value waypointPosition(rapidjson::kArrayType);
+	waypointPosition.PushBack(info.waypointContinentPosition.x, allocator);
+	waypointPosition.PushBack(info.waypointContinentPosition.y, allocator);
+	json.AddMember("waypoint_continent_position", waypointPosition, allocator);
+	json.AddMember("team_color_id", info.teamColorId, allocator);
+	json.AddMember("commander", info.commander, allocator);
+	json.AddMember("plugin_version", info.pluginVersion.c_str(), allocator);
+}
 
+static string writeJson(const rapidjson::Document& json) {
 	rapidjson::StringBuffer buffer;
 	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 	json.Accept(writer);
 	return buffer.GetString();
 }
 
+string Gw2Info::toJson() const {
+	rapidjson::Document json;
+	json.SetObject();
+	addJsonMembers(*this, false, json);
+	return writeJson(json);
+}
 
-Gw2RemoteInfoContainer::Gw2RemoteInfoContainer() {
-	InitializeCriticalSection(&cs);
+string Gw2Info::toJson(uint32_t sequence, bool idsOnly) const {
+	rapidjson::Document json;
+	json.SetObject();
+	json.AddMember("seq", sequence, json.GetAllocator());
+	addJsonMembers(*this, idsOnly, json);
+	return writeJson(json);
 }
 
-Gw2RemoteInfoContainer::~Gw2RemoteInfoContainer() {
-	DeleteCriticalSection(&cs);
+bool Gw2Info::supportsIdsOnly(const string& pluginVersion) {
+	return !pluginVersion.empty() && Version(pluginVersion) >= Version(PROTOCOL_MINVERSION_IDSONLY);
+}
+
+bool Gw2Info::supportsPacked(const string& pluginVersion) {
+	return !pluginVersion.empty() && Version(pluginVersion) >= Version(PROTOCOL_MINVERSION_PACKED);
+}
+
+bool Gw2Info::supportsVelocity(const string& pluginVersion) {
+	return !pluginVersion.empty() && Version(pluginVersion) >= Version(PROTOCOL_MINVERSION_VELOCITY);
+}
+
+
+Vector3D Gw2RemoteInfo::getPredictedPosition(ULONGLONG now) const {
+	if (!isMoving() || positionTime == 0 || now < positionTime)
+		return characterContinentPosition;
+	Vector2D predicted = DeadReckoning::predict(characterContinentPosition.toVector2D(), characterContinentVelocity, now - positionTime);
+	return Vector3D(predicted.x, predicted.y, characterContinentPosition.z);
+}
+
+
+Gw2RemoteInfoContainer::Gw2RemoteInfoContainer() {
+	InitializeSRWLock(&lock);
 }
 
 static string getDirectionString(Angle::Direction direction) {
@@ -137,103 +216,555 @@ static string getDirectionString(Angle::Direction direction) {
 	return "";
 }
 
-string Gw2RemoteInfoContainer::getInfoData(uint64 serverConnectionHandlerID, anyID clientID, PluginItemType type) {
+string Gw2RemoteInfoContainer::getInfoData(uint64 serverConnectionHandlerID, uint64 id, PluginItemType type) {
 	string data;
-	getInfoData(serverConnectionHandlerID, clientID, type, data);
+	getInfoData(serverConnectionHandlerID, id, type, data);
 	return data;
 }
 
-bool Gw2RemoteInfoContainer::getInfoData(uint64 serverConnectionHandlerID, anyID clientID, PluginItemType type, string& data) {
-	if (type == PLUGIN_CLIENT) {
-		Gw2RemoteInfo gw2RemoteInfo;
-		if (getRemoteGW2Info(serverConnectionHandlerID, clientID, gw2RemoteInfo)) {
-			debuglog("GW2Plugin: Parsing data for client %d\n", clientID);
-			if (gw2RemoteInfo.characterName.empty()) {
-				data = "Currently offline";
+/*
+ * Fills in the names that haven't been received from the local API cache; missing API data is queued for download.
+ * Returns false if a name is still missing.
+ */
+static bool resolveNames(Gw2RemoteInfo& info, const Async::Callback& onFetched) {
+	bool resolved = true;
+	if (info.mapId > 0 && info.mapName.empty()) {
+		ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
+		if (getCachedMap(info.mapId, &map)) {
+			info.mapName = map.value->map_name;
+			info.regionName = map.value->region_name;
+			info.continentName = map.value->continent_name;
+		} else {
+			resolved = false;
+			if (onFetched)
+				Async::fetchMap(info.mapId, onFetched);
+		}
+	}
+
+	if (info.worldId > 0 && info.worldName.empty()) {
+		WorldNamesRootEntryPtr worldNames;
+		if (getCachedWorldNames(&worldNames)) {
+			WorldNameEntries::const_iterator worldName = worldNames->world_names.find(info.worldId);
+			if (worldName != worldNames->world_names.end())
+				info.worldName = worldName->second.name;
+			else
+				info.worldName = "World " + to_string(info.worldId);
+		} else {
+			resolved = false;
+			if (onFetched)
+				Async::fetchWorldNames(onFetched);
+		}
+	}
+
+	if (info.waypointId > 0 && info.waypointName.empty()) {
+		PointOfInterestEntry waypoint;
+		bool isPending;
+		if (getWaypoint(info.mapId, info.waypointId, &waypoint, &isPending, onFetched) && !waypoint.name.empty()) {
+			info.waypointName = waypoint.name;
+		} else if (isPending) {
+			resolved = false;
+		} else {
+			info.waypointName = "Waypoint " + to_string(info.waypointId);
+		}
+	}
+	return resolved;
+}
+
+static void renderInfoData(const Gw2RemoteInfo& gw2RemoteInfo, string& data) {
+	if (gw2RemoteInfo.characterName.empty()) {
+		data = "Currently offline";
+	} else {
+		// A moving client is shown where it is expected to be by now, relative to the waypoint closest to that position
+		Vector3D characterContinentPosition = gw2RemoteInfo.characterContinentPosition;
+		uint32_t waypointId = gw2RemoteInfo.waypointId;
+		string waypointName = gw2RemoteInfo.waypointName;
+		Vector2D waypointContinentPosition = gw2RemoteInfo.waypointContinentPosition;
+		if (gw2RemoteInfo.isMoving()) {
+			characterContinentPosition = gw2RemoteInfo.getPredictedPosition(GetTickCount64());
+			PointOfInterestEntry waypoint;
+			bool isPending;
+			if (getClosestWaypoint(characterContinentPosition, gw2RemoteInfo.mapId, &waypoint, &isPending, Async::Callback()) && waypoint.poi_id != (int)waypointId) {
+				waypointId = waypoint.poi_id;
+				waypointName = waypoint.name;
+				waypointContinentPosition = waypoint.coord;
+			}
+		}
+
+		// Placeholders for names that are still being resolved
+		string mapName = !gw2RemoteInfo.mapName.empty() ? gw2RemoteInfo.mapName : "Map " + to_string(gw2RemoteInfo.mapId);
+		string regionName = !gw2RemoteInfo.regionName.empty() ? gw2RemoteInfo.regionName : "Unknown region";
+		string worldName = !gw2RemoteInfo.worldName.empty() ? gw2RemoteInfo.worldName : "World " + to_string(gw2RemoteInfo.worldId);
+		if (waypointName.empty())
+			waypointName = "Waypoint " + to_string(waypointId);
+
+		data = "Playing as [color=blue]" + gw2RemoteInfo.characterName + "[/color] (" + getProfessionName(gw2RemoteInfo.profession) + ")\n" +
+			regionName + " - [color=blue]" + mapName + "[/color] (" + worldName + ")";
+		if (waypointId > 0) {
+			Vector2D characterPosition = characterContinentPosition.toVector2D();
+			double waypointDistance = characterPosition.getDistance(waypointContinentPosition);
+			Angle angle = characterPosition.getAngleFrom(waypointContinentPosition);
+			if (waypointDistance < 50) {
+				data += "\nRight next to ";
+			} else if (waypointDistance < 200) {
+				data += "\nNear " + getDirectionString(angle) + " of ";
+			} else if (waypointDistance < 400) {
+				data += "\nSomewhere " + getDirectionString(angle) + " of ";
+			} else if (waypointDistance < 700) {
+				data += "\nFar " + getDirectionString(angle) + " of ";
 			} else {
-				data = "Playing as [color=blue]" + gw2RemoteInfo.characterName + "[/color] (" + getProfessionName(gw2RemoteInfo.profession) + ")\n" +
-					gw2RemoteInfo.regionName + " - [color=blue]" + gw2RemoteInfo.mapName + "[/color] (" + gw2RemoteInfo.worldName + ")";
-				if (gw2RemoteInfo.waypointId > 0) {
-					Vector2D characterPosition = gw2RemoteInfo.characterContinentPosition.toVector2D();
-					double waypointDistance = characterPosition.getDistance(gw2RemoteInfo.waypointContinentPosition);
-					Angle angle = characterPosition.getAngleFrom(gw2RemoteInfo.waypointContinentPosition);
-					if (waypointDistance < 50) {
-						data += "\nRight next to ";
-					} else if (waypointDistance < 200) {
-						data += "\nNear " + getDirectionString(angle) + " of ";
-					} else if (waypointDistance < 400) {
-						data += "\nSomewhere " + getDirectionString(angle) + " of ";
-					} else if (waypointDistance < 700) {
-						data += "\nFar " + getDirectionString(angle) + " of ";
-					} else {
-						data += "\nVery far " + getDirectionString(angle) + " of ";
-					}
-					data += "[color=blue]" + gw2RemoteInfo.waypointName + "[/color] [&" + poiToChatLink(gw2RemoteInfo.waypointId) + "]";
+				data += "\nVery far " + getDirectionString(angle) + " of ";
+			}
+			data += "[color=blue]" + waypointName + "[/color] ";
+			appendChatLink(data, poiToChatLink(waypointId));
+		} else {
+			data += "\nNot nearby any waypoint";
+		}
+	}
+}
+
+bool Gw2RemoteInfoContainer::getInfoData(uint64 serverConnectionHandlerID, uint64 id, PluginItemType type, string& data) {
+	if (type == PLUGIN_CHANNEL)
+		return getChannelInfoData(serverConnectionHandlerID, id, data);
+
+	if (type == PLUGIN_CLIENT) {
+		anyID clientID = (anyID)id;
+		AcquireSRWLockShared(&lock);
+		const Gw2RemoteInfo* gw2RemoteInfo = findRemoteGW2Info(serverConnectionHandlerID, clientID);
+		if (gw2RemoteInfo != NULL && !gw2RemoteInfo->infoData.empty()) {
+			data = gw2RemoteInfo->infoData;
+			appendNearbyClients(*gw2RemoteInfo, data);
+			ReleaseSRWLockShared(&lock);
+			return true;
+		}
+		ReleaseSRWLockShared(&lock);
+
+		if (gw2RemoteInfo != NULL) {
+			// The rendered text is cached in the record, so this only happens once after every update
+			AcquireSRWLockExclusive(&lock);
+			Gw2RemoteInfo* record = const_cast<Gw2RemoteInfo*>(findRemoteGW2Info(serverConnectionHandlerID, clientID));
+			if (record != NULL) {
+				if (record->infoData.empty()) {
+					debuglog("GW2Plugin: Resolving names and parsing data for client %d\n", clientID);
+					bool namesResolved = resolveNames(*record, onNamesFetched);
+					renderInfoData(*record, data);
+					if (namesResolved && !record->isMoving())
+						record->infoData = data; // The prediction of a moving client changes with every call
 				} else {
-					data += "\nNot nearby any waypoint";
+					data = record->infoData;
 				}
+				appendNearbyClients(*record, data);
+				ReleaseSRWLockExclusive(&lock);
+				return true;
 			}
-			return true;
-		} else {
-			debuglog("GW2Plugin: No data found for client %d\n", clientID);
-			data = "No information available";
+			ReleaseSRWLockExclusive(&lock);
 		}
+
+		debuglog("GW2Plugin: No data found for client %d\n", clientID);
+		data = "No information available";
 	}
 	return false;
 }
 
 
-bool Gw2RemoteInfoContainer::getRemoteGW2InfoRowID(uint64 serverConnectionHandlerID, anyID clientID, int& result) {
-	unsigned int i = 0;
+/* How many of the closest other clients the info panel lists */
+static const size_t infoNearbyClientCount = 3;
 
-	while (i < gw2RemoteInfos.size()) {
-		Gw2RemoteInfo currentRow = gw2RemoteInfos.at(i);
-		if (currentRow.clientID == clientID && currentRow.serverConnectionHandlerID == serverConnectionHandlerID) {
-			result = i;
-			return true;
+void Gw2RemoteInfoContainer::appendNearbyClients(const Gw2RemoteInfo& record, string& data) const {
+	if (record.characterName.empty())
+		return;
+	vector<ProximityIndex::Neighbour> neighbours;
+	proximityIndex.findNearest(record.serverConnectionHandlerID, record.mapId, record.characterContinentPosition.toVector2D(), infoNearbyClientCount,
+		record.clientID, neighbours);
+	bool first = true;
+	for (size_t i = 0; i < neighbours.size(); i++) {
+		const Gw2RemoteInfo* other = findRemoteGW2Info(record.serverConnectionHandlerID, neighbours[i].clientID);
+		if (other == NULL)
+			continue;
+		data += first ? "\nNearby: " : ", ";
+		data += "[color=blue]" + other->characterName + "[/color] (" + to_string((int)(neighbours[i].distance + 0.5)) + ")";
+		first = false;
+	}
+}
+
+static void removeCount(map<uint32_t, size_t>& counts, uint32_t id) {
+	map<uint32_t, size_t>::iterator it = counts.find(id);
+	if (it != counts.end() && --it->second == 0)
+		counts.erase(it);
+}
+
+static size_t getProfessionIndex(Profession profession) {
+	return profession >= Guardian && profession <= Necromancer ? (size_t)profession : 0;
+}
+
+void Gw2RemoteInfoContainer::summarizeRecord(const Gw2RemoteInfo& record, int weight) {
+	// Like in the proximity index, only clients with a character count
+	if (record.channelID == 0 || record.characterName.empty())
+		return;
+	ChannelSummaryMap::key_type key(record.serverConnectionHandlerID, record.channelID);
+	ChannelSummary& summary = channelSummaries[key];
+	if (weight > 0) {
+		summary.inGameCount++;
+		summary.mapCounts[record.mapId]++;
+		summary.worldCounts[record.worldId]++;
+		summary.professionCounts[getProfessionIndex(record.profession)]++;
+		if (record.commander)
+			summary.commanders.insert(record.characterName);
+	} else {
+		if (summary.inGameCount <= 1) {
+			channelSummaries.erase(key);
+			return;
+		}
+		summary.inGameCount--;
+		removeCount(summary.mapCounts, record.mapId);
+		removeCount(summary.worldCounts, record.worldId);
+		summary.professionCounts[getProfessionIndex(record.profession)]--;
+		if (record.commander) {
+			multiset<string>::iterator commander = summary.commanders.find(record.characterName);
+			if (commander != summary.commanders.end())
+				summary.commanders.erase(commander);
 		}
-		i++;
 	}
+	summary.infoData.clear();
+}
+
+/* Highest count first */
+static void sortByCount(const map<uint32_t, size_t>& counts, vector<pair<size_t, uint32_t>>& result) {
+	result.clear();
+	for (map<uint32_t, size_t>::const_iterator it = counts.begin(); it != counts.end(); it++)
+		result.push_back(make_pair(it->second, it->first));
+	sort(result.begin(), result.end(), [](const pair<size_t, uint32_t>& lhs, const pair<size_t, uint32_t>& rhs) {
+		return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+	});
+}
 
+/* Returns false if the name isn't cached yet, a placeholder is used in the meantime */
+static bool getMapName(uint32_t mapId, const Async::Callback& onFetched, string& name) {
+	if (mapId == 0) {
+		name = "Unknown map";
+		return true;
+	}
+	ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
+	if (getCachedMap(mapId, &map)) {
+		name = map.value->map_name;
+		return true;
+	}
+	name = "Map " + to_string(mapId);
+	if (onFetched)
+		Async::fetchMap(mapId, onFetched);
 	return false;
 }
 
-bool Gw2RemoteInfoContainer::getRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, Gw2RemoteInfo& result) {
-	int row;
-	if (getRemoteGW2InfoRowID(serverConnectionHandlerID, clientID, row)) {
-		result = gw2RemoteInfos.at(row);
+static bool getWorldName(uint32_t worldId, const Async::Callback& onFetched, string& name) {
+	WorldNamesRootEntryPtr worldNames;
+	if (worldId > 0 && getCachedWorldNames(&worldNames)) {
+		WorldNameEntries::const_iterator worldName = worldNames->world_names.find(worldId);
+		if (worldName != worldNames->world_names.end())
+			name = worldName->second.name;
+		else
+			name = "World " + to_string(worldId);
 		return true;
 	}
+	name = worldId > 0 ? "World " + to_string(worldId) : "Unknown world";
+	if (worldId > 0 && onFetched)
+		Async::fetchWorldNames(onFetched);
+	return worldId == 0;
+}
 
-	return false;
+/* Returns false if a name is still missing */
+static bool renderChannelSummary(const Gw2RemoteInfoContainer::ChannelSummary& summary, const Async::Callback& onFetched, string& data) {
+	bool resolved = true;
+	vector<pair<size_t, uint32_t>> sorted;
+	string name;
+
+	data = to_string((int)summary.inGameCount) + (summary.inGameCount == 1 ? " member" : " members") + " in Guild Wars 2";
+
+	sortByCount(summary.mapCounts, sorted);
+	data += "\nMaps: ";
+	for (size_t i = 0; i < sorted.size(); i++) {
+		resolved = getMapName(sorted[i].second, onFetched, name) && resolved;
+		data += (i > 0 ? ", [color=blue]" : "[color=blue]") + name + "[/color] (" + to_string((int)sorted[i].first) + ")";
+	}
+
+	sortByCount(summary.worldCounts, sorted);
+	data += "\nWorlds: ";
+	for (size_t i = 0; i < sorted.size(); i++) {
+		resolved = getWorldName(sorted[i].second, onFetched, name) && resolved;
+		data += (i > 0 ? ", " : "") + name + " (" + to_string((int)sorted[i].first) + ")";
+	}
+
+	if (!summary.commanders.empty()) {
+		data += "\nCommanders: ";
+		for (multiset<string>::const_iterator it = summary.commanders.begin(); it != summary.commanders.end(); it++)
+			data += (it != summary.commanders.begin() ? ", [color=blue]" : "[color=blue]") + *it + "[/color]";
+	}
+
+	map<uint32_t, size_t> professionCounts;
+	for (size_t i = 0; i <= Necromancer; i++) {
+		if (summary.professionCounts[i] > 0)
+			professionCounts[(uint32_t)i] = summary.professionCounts[i];
+	}
+	sortByCount(professionCounts, sorted);
+	data += "\nProfessions: ";
+	for (size_t i = 0; i < sorted.size(); i++)
+		data += (i > 0 ? ", " : "") + to_string((int)sorted[i].first) + " " + getProfessionName((Profession)sorted[i].second);
+	return resolved;
 }
 
-void Gw2RemoteInfoContainer::updateRemoteGW2Info(const Gw2RemoteInfo& data) {
-	int existingRecordId;
+bool Gw2RemoteInfoContainer::getChannelInfoData(uint64 serverConnectionHandlerID, uint64 channelID, string& data) {
+	ChannelSummaryMap::key_type key(serverConnectionHandlerID, channelID);
+	AcquireSRWLockShared(&lock);
+	ChannelSummaryMap::const_iterator cached = channelSummaries.find(key);
+	bool found = cached != channelSummaries.end();
+	if (found && !cached->second.infoData.empty()) {
+		data = cached->second.infoData;
+		ReleaseSRWLockShared(&lock);
+		return true;
+	}
+	ReleaseSRWLockShared(&lock);
+	if (!found)
+		return false;
 
-	EnterCriticalSection(&cs);
-	if (getRemoteGW2InfoRowID(data.serverConnectionHandlerID, data.clientID, existingRecordId)) {
-		gw2RemoteInfos[existingRecordId] = data;
-		debuglog("GW2Plugin: Updated existing remote GW2 client record in row %d\n", existingRecordId);
+	// Like the text of a client, this only happens once after every change in the channel
+	AcquireSRWLockExclusive(&lock);
+	ChannelSummaryMap::iterator summary = channelSummaries.find(key);
+	found = summary != channelSummaries.end();
+	if (found) {
+		if (summary->second.infoData.empty()) {
+			if (renderChannelSummary(summary->second, onNamesFetched, data))
+				summary->second.infoData = data;
+		} else {
+			data = summary->second.infoData;
+		}
+	}
+	ReleaseSRWLockExclusive(&lock);
+	return found;
+}
+
+
+/* Maximum amount of requests that can be sent to a server connection at once, before the per-minute limit kicks in */
+static const double requestBurst = 5;
+
+void Gw2RemoteInfoContainer::markReceived(uint64 serverConnectionHandlerID, anyID clientID) {
+	requestStates[makeKey(serverConnectionHandlerID, clientID)].lastReceived = GetTickCount64();
+}
+
+void Gw2RemoteInfoContainer::indexRecord(const Gw2RemoteInfo& record) {
+	// Offline clients (without a character) stay in the container, but nobody is near them; neither is a client whose map hasn't been resolved yet
+	if (record.characterName.empty() || record.mapId <= 0 || record.characterContinentPosition == Vector3D())
+		proximityIndex.remove(record.serverConnectionHandlerID, record.clientID);
+	else
+		proximityIndex.update(record.serverConnectionHandlerID, record.clientID, record.mapId, record.characterContinentPosition.toVector2D());
+}
+
+bool Gw2RemoteInfoContainer::beginGW2InfoRequest(uint64 serverConnectionHandlerID, anyID clientID, bool stale) {
+	ULONGLONG now = GetTickCount64();
+	ULONGLONG ttl = (ULONGLONG)Globals::infoRequestTtl * 1000;
+	bool send = false;
+
+	AcquireSRWLockExclusive(&lock);
+	RequestState& state = requestStates[makeKey(serverConnectionHandlerID, clientID)];
+	// Clients without the plugin never answer, so a request is only considered in flight for one TTL
+	bool inFlight = state.lastRequested > state.lastReceived && now - state.lastRequested < ttl;
+	bool fresh = state.lastReceived > 0 && now - state.lastReceived < ttl;
+	if (!inFlight && (stale || !fresh)) {
+		RequestBudget& budget = requestBudgets[serverConnectionHandlerID];
+		if (budget.tokens < 0) {
+			budget.tokens = requestBurst;
+		} else {
+			budget.tokens += (now - budget.lastRefill) / 60000.0 * Globals::infoRequestsPerMinute;
+			if (budget.tokens > requestBurst)
+				budget.tokens = requestBurst;
+		}
+		budget.lastRefill = now;
+
+		if (budget.tokens >= 1) {
+			budget.tokens -= 1;
+			state.lastRequested = now;
+			send = true;
+		}
+	}
+	ReleaseSRWLockExclusive(&lock);
+
+	if (!send) {
+		debuglog("GW2Plugin: Skipped request for client %d (%s)\n", clientID, inFlight ? "in flight" : (!stale && fresh) ? "fresh" : "rate limited");
+	}
+	return send;
+}
+
+const Gw2RemoteInfo* Gw2RemoteInfoContainer::findRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID) const {
+	RecordMap::const_iterator it = gw2RemoteInfos.find(makeKey(serverConnectionHandlerID, clientID));
+	if (it == gw2RemoteInfos.end())
+		return NULL;
+	return &it->second;
+}
+
+bool Gw2RemoteInfoContainer::getRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, Gw2RemoteInfo& result) {
+	AcquireSRWLockShared(&lock);
+	const Gw2RemoteInfo* gw2RemoteInfo = findRemoteGW2Info(serverConnectionHandlerID, clientID);
+	if (gw2RemoteInfo != NULL)
+		result = *gw2RemoteInfo;
+	ReleaseSRWLockShared(&lock);
+	return gw2RemoteInfo != NULL;
+}
+
+void Gw2RemoteInfoContainer::findNearbyClients(uint64 serverConnectionHandlerID, int mapId, const Vector2D& position, anyID excludeClientID, size_t maxCount,
+	vector<NearbyClient>& result) {
+	result.clear();
+	vector<ProximityIndex::Neighbour> neighbours;
+
+	AcquireSRWLockShared(&lock);
+	proximityIndex.findNearest(serverConnectionHandlerID, mapId, position, maxCount, excludeClientID, neighbours);
+	for (size_t i = 0; i < neighbours.size(); i++) {
+		const Gw2RemoteInfo* record = findRemoteGW2Info(serverConnectionHandlerID, neighbours[i].clientID);
+		if (record == NULL)
+			continue;
+		NearbyClient client;
+		client.clientID = neighbours[i].clientID;
+		client.characterName = record->characterName;
+		client.waypointId = record->waypointId;
+		client.waypointName = record->waypointName;
+		client.distance = neighbours[i].distance;
+		result.push_back(client);
+	}
+	ReleaseSRWLockShared(&lock);
+}
+
+void Gw2RemoteInfoContainer::updateRemoteGW2Info(const Gw2RemoteInfo& data) {
+	AcquireSRWLockExclusive(&lock);
+	uint64 key = makeKey(data.serverConnectionHandlerID, data.clientID);
+	RecordMap::iterator it = gw2RemoteInfos.find(key);
+	if (it != gw2RemoteInfos.end()) {
+		summarizeRecord(it->second, -1);
+		uint64 channelID = it->second.channelID;
+		it->second = data;
+		it->second.channelID = channelID;
+		debuglog("GW2Plugin: Updated existing remote GW2 client record for client %d\n", data.clientID);
 	} else {
-		gw2RemoteInfos.push_back(data);
+		it = gw2RemoteInfos.insert(RecordMap::value_type(key, data)).first;
+		serverClients[data.serverConnectionHandlerID].insert(data.clientID);
+		if (channelResolver)
+			it->second.channelID = channelResolver(data.serverConnectionHandlerID, data.clientID);
 		debuglog("GW2Plugin: Added new remote GW2 client record for client %d\n", data.clientID);
 	}
-	LeaveCriticalSection(&cs);
+	it->second.positionTime = GetTickCount64();
+	markReceived(data.serverConnectionHandlerID, data.clientID);
+	indexRecord(it->second);
+	summarizeRecord(it->second, 1);
+
+	if (Gw2Info::supportsCompact(data.pluginVersion)) {
+		ServerClientsMap::iterator server = legacyClients.find(data.serverConnectionHandlerID);
+		if (server != legacyClients.end()) {
+			server->second.erase(data.clientID);
+			if (server->second.empty())
+				legacyClients.erase(server);
+		}
+	} else {
+		legacyClients[data.serverConnectionHandlerID].insert(data.clientID);
+	}
+	ReleaseSRWLockExclusive(&lock);
 }
 
-bool Gw2RemoteInfoContainer::removeRemoteGW2InfoRecord(uint64 serverConnectionHandlerID, anyID clientID) {
-	int existingRecord;
+/* Remembers the position and velocity of a record before a delta, to restart its prediction if the delta changes them */
+class MotionState {
+public:
+	MotionState(const Gw2RemoteInfo& record) : position(record.characterContinentPosition), velocity(record.characterContinentVelocity) { }
 
-	EnterCriticalSection(&cs);
-	if (getRemoteGW2InfoRowID(serverConnectionHandlerID, clientID, existingRecord)) {
-		gw2RemoteInfos.erase(gw2RemoteInfos.begin() + existingRecord);
-		debuglog("GW2Plugin: Removed remote GW2 client record for client %d\n", clientID);
-		LeaveCriticalSection(&cs);
+	void update(Gw2RemoteInfo& record) const {
+		if (record.characterContinentPosition != position || record.characterContinentVelocity != velocity)
+			record.positionTime = GetTickCount64();
+	}
+
+private:
+	Vector3D position;
+	Vector2D velocity;
+};
+
+bool Gw2RemoteInfoContainer::updateRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, const Gw2InfoCodec::Decoder& message) {
+	if (message.isSnapshot()) {
+		Gw2RemoteInfo gw2RemoteInfo;
+		gw2RemoteInfo.pluginVersion = "";
+		message.apply(gw2RemoteInfo);
+		gw2RemoteInfo.sequence = message.sequence();
+		gw2RemoteInfo.serverConnectionHandlerID = serverConnectionHandlerID;
+		gw2RemoteInfo.clientID = clientID;
+		updateRemoteGW2Info(gw2RemoteInfo);
 		return true;
 	}
-	LeaveCriticalSection(&cs);
-	return false;
+
+	bool applied = false;
+	AcquireSRWLockExclusive(&lock);
+	RecordMap::iterator it = gw2RemoteInfos.find(makeKey(serverConnectionHandlerID, clientID));
+	if (it != gw2RemoteInfos.end() && it->second.sequence + 1 == message.sequence()) {
+		MotionState motion(it->second);
+		summarizeRecord(it->second, -1);
+		message.apply(it->second);
+		motion.update(it->second);
+		it->second.sequence = message.sequence();
+		it->second.infoData.clear();
+		markReceived(serverConnectionHandlerID, clientID);
+		indexRecord(it->second);
+		summarizeRecord(it->second, 1);
+		applied = true;
+	}
+	ReleaseSRWLockExclusive(&lock);
+
+	if (applied) {
+		debuglog("GW2Plugin: Applied packed delta %u to remote GW2 client record for client %d\n", message.sequence(), clientID);
+	} else {
+		debuglog("GW2Plugin: Could not apply packed delta %u for client %d\n", message.sequence(), clientID);
+	}
+	return applied;
+}
+
+void Gw2RemoteInfoContainer::markLegacyClient(uint64 serverConnectionHandlerID, anyID clientID) {
+	AcquireSRWLockExclusive(&lock);
+	legacyClients[serverConnectionHandlerID].insert(clientID);
+	ReleaseSRWLockExclusive(&lock);
+}
+
+bool Gw2RemoteInfoContainer::hasLegacyClients(uint64 serverConnectionHandlerID) {
+	AcquireSRWLockShared(&lock);
+	bool result = legacyClients.find(serverConnectionHandlerID) != legacyClients.end();
+	ReleaseSRWLockShared(&lock);
+	return result;
+}
+
+void Gw2RemoteInfoContainer::moveRemoteGW2InfoRecord(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID) {
+	AcquireSRWLockExclusive(&lock);
+	RecordMap::iterator it = gw2RemoteInfos.find(makeKey(serverConnectionHandlerID, clientID));
+	if (it != gw2RemoteInfos.end() && it->second.channelID != channelID) {
+		summarizeRecord(it->second, -1);
+		it->second.channelID = channelID;
+		summarizeRecord(it->second, 1);
+	}
+	ReleaseSRWLockExclusive(&lock);
+}
+
+bool Gw2RemoteInfoContainer::removeRemoteGW2InfoRecord(uint64 serverConnectionHandlerID, anyID clientID) {
+	AcquireSRWLockExclusive(&lock);
+	requestStates.erase(makeKey(serverConnectionHandlerID, clientID));
+	RecordMap::iterator record = gw2RemoteInfos.find(makeKey(serverConnectionHandlerID, clientID));
+	bool removed = record != gw2RemoteInfos.end();
+	if (removed) {
+		summarizeRecord(record->second, -1);
+		gw2RemoteInfos.erase(record);
+		proximityIndex.remove(serverConnectionHandlerID, clientID);
+		ServerClientsMap::iterator server = serverClients.find(serverConnectionHandlerID);
+		if (server != serverClients.end()) {
+			server->second.erase(clientID);
+			if (server->second.empty())
+				serverClients.erase(server);
+		}
+		server = legacyClients.find(serverConnectionHandlerID);
+		if (server != legacyClients.end()) {
+			server->second.erase(clientID);
+			if (server->second.empty())
+				legacyClients.erase(server);
+		}
+		debuglog("GW2Plugin: Removed remote GW2 client record for client %d\n", clientID);
+	}
+	ReleaseSRWLockExclusive(&lock);
+	return removed;
 }
 
 void Gw2RemoteInfoContainer::removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID) {
@@ -241,19 +772,28 @@ void Gw2RemoteInfoContainer::removeAllRemoteGW2InfoRecords(uint64 serverConnecti
 }
 
 void Gw2RemoteInfoContainer::removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID, int* removedRecords) {
-	unsigned int i = 0;
 	int removed = 0;
 
-	EnterCriticalSection(&cs);
-	while (i < gw2RemoteInfos.size()) {
-		if (gw2RemoteInfos[i].serverConnectionHandlerID == serverConnectionHandlerID) {
-			gw2RemoteInfos.erase(gw2RemoteInfos.begin() + i);
-			removed++;
-		} else {
-			i++;
-		}
+	AcquireSRWLockExclusive(&lock);
+	ServerClientsMap::iterator server = serverClients.find(serverConnectionHandlerID);
+	if (server != serverClients.end()) {
+		for (std::unordered_set<anyID>::const_iterator it = server->second.begin(); it != server->second.end(); it++)
+			removed += (int)gw2RemoteInfos.erase(makeKey(serverConnectionHandlerID, *it));
+		serverClients.erase(server);
+	}
+	legacyClients.erase(serverConnectionHandlerID);
+	proximityIndex.removeServer(serverConnectionHandlerID);
+	ChannelSummaryMap::iterator summary = channelSummaries.lower_bound(ChannelSummaryMap::key_type(serverConnectionHandlerID, 0));
+	while (summary != channelSummaries.end() && summary->first.first == serverConnectionHandlerID)
+		summary = channelSummaries.erase(summary);
+	for (RequestStateMap::iterator it = requestStates.begin(); it != requestStates.end();) {
+		if ((it->first >> 16) == serverConnectionHandlerID)
+			it = requestStates.erase(it);
+		else
+			it++;
 	}
-	LeaveCriticalSection(&cs);
+	requestBudgets.erase(serverConnectionHandlerID);
+	ReleaseSRWLockExclusive(&lock);
 
 	debuglog("GW2Plugin: Removed %d remote GW2 client record(s)\n", removed);
 
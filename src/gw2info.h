@@ -11,13 +11,25 @@
 */
 
 #pragma once
+#include <functional>
+#include <map>
+#include <set>
 #include <string>
-#include <vector>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <Windows.h>
 #include "public_definitions.h"
+#include "gw2api/gw2api.h"
 #include "gw2api/math.h"
 #include "gw2api/mumblelink.h"
 #include "globals.h"
+#include "proximityindex.h"
+#include "stringutils.h"
+
+namespace Gw2InfoCodec {
+	class Decoder;
+}
 
 struct Gw2Info {
 	std::string characterName;
@@ -31,6 +43,7 @@ struct Gw2Info {
 	uint32_t worldId;
 	std::string worldName;
 	Gw2Api::Vector3D characterContinentPosition;
+	Gw2Api::Vector2D characterContinentVelocity; // In continent units per second; its direction is the heading
 	uint32_t waypointId;
 	std::string waypointName;
 	Gw2Api::Vector2D waypointContinentPosition;
@@ -41,7 +54,23 @@ struct Gw2Info {
 	Gw2Info() { clear(); }
 	Gw2Info(std::string jsonString);
 
+	/* Overwrites only the fields that are present; sequence is optional */
+	bool applyJson(const StringRef& jsonString, uint32_t* sequence);
+
+	/* With idsOnly, the names are left out and receivers resolve them from the ids themselves */
 	std::string toJson() const;
+	std::string toJson(uint32_t sequence, bool idsOnly) const;
+	/* Whether a client with the given plugin version resolves names from ids itself */
+	static bool supportsIdsOnly(const std::string& pluginVersion);
+	/* Whether a client with the given plugin version understands GW2InfoPacked commands */
+	static bool supportsPacked(const std::string& pluginVersion);
+	/* Whether a client with the given plugin version extrapolates positions with the velocity (and decodes it in packed messages) */
+	static bool supportsVelocity(const std::string& pluginVersion);
+	/* Whether a client with the given plugin version can be sent packed deltas without names, and fewer position updates */
+	static bool supportsCompact(const std::string& pluginVersion) {
+		return supportsIdsOnly(pluginVersion) && supportsPacked(pluginVersion) && supportsVelocity(pluginVersion);
+	}
+
 	void clear() {
 		characterName = "";
 		profession = (Gw2Api::MumbleLink::Profession)0;
@@ -54,6 +83,7 @@ struct Gw2Info {
 		worldId = 0;
 		worldName = "";
 		characterContinentPosition = Gw2Api::Vector3D();
+		characterContinentVelocity = Gw2Api::Vector2D();
 		waypointId = 0;
 		waypointName = "";
 		waypointContinentPosition = Gw2Api::Vector2D();
@@ -66,33 +96,139 @@ struct Gw2Info {
 struct Gw2RemoteInfo : Gw2Info {
 	uint64 serverConnectionHandlerID;
 	anyID clientID;
+	uint64 channelID; // The TeamSpeak channel the client is in, 0 if it isn't known
+	uint32_t sequence; // Sequence number of the last applied snapshot or delta, 0 for older clients
+	std::string infoData; // Rendered info panel text; only cached once every id has a name and the client isn't moving, empty otherwise
+	ULONGLONG positionTime; // When (GetTickCount64) the position or velocity has last been received, the base for predictions
 
-	Gw2RemoteInfo() : Gw2Info() { }
-	Gw2RemoteInfo(std::string jsonString, uint64 serverConnectionHandlerID, anyID clientID) : Gw2Info(jsonString) {
+	Gw2RemoteInfo() : Gw2Info(), channelID(0), sequence(0), positionTime(0) { }
+	Gw2RemoteInfo(const StringRef& jsonString, uint64 serverConnectionHandlerID, anyID clientID) : Gw2Info() {
+		pluginVersion = ""; // Very old clients don't send it at all
+		channelID = 0;
+		sequence = 0;
+		positionTime = 0;
+		applyJson(jsonString, &sequence);
 		this->serverConnectionHandlerID = serverConnectionHandlerID;
 		this->clientID = clientID;
 	}
+
+	bool isMoving() const { return characterContinentVelocity != Gw2Api::Vector2D(); }
+	/* Extrapolates the last received position with the velocity (see DeadReckoning) */
+	Gw2Api::Vector3D getPredictedPosition(ULONGLONG now) const;
 };
 
 
+/* Remote records are keyed by server connection and client; see makeKey */
 class Gw2RemoteInfoContainer {
 
+public:
+	/* Looks up the channel of a client that has just got a record, returns 0 if it isn't known */
+	typedef std::function<uint64 (uint64 serverConnectionHandlerID, anyID clientID)> ChannelResolver;
+
+	/* Totals over the in-game clients of a channel, kept up to date with every change of a record */
+	struct ChannelSummary {
+		ChannelSummary() : inGameCount(0) { memset(professionCounts, 0, sizeof(professionCounts)); }
+
+		size_t inGameCount;
+		std::map<uint32_t, size_t> mapCounts; // By map ID
+		std::map<uint32_t, size_t> worldCounts; // By world ID
+		std::multiset<std::string> commanders; // Character names
+		size_t professionCounts[Gw2Api::MumbleLink::Necromancer + 1]; // By profession, 0 for unknown ones
+		std::string infoData; // Rendered info panel text; only cached once every id has a name, empty otherwise
+	};
+
 private:
-	std::vector<Gw2RemoteInfo> gw2RemoteInfos;
+	typedef std::unordered_map<uint64, Gw2RemoteInfo> RecordMap;
+	typedef std::unordered_map<uint64, std::unordered_set<anyID>> ServerClientsMap;
+
+	/* Timestamps (GetTickCount64) of the last request to and the last snapshot or delta from a client */
+	struct RequestState {
+		RequestState() : lastRequested(0), lastReceived(0) { }
+
+		ULONGLONG lastRequested;
+		ULONGLONG lastReceived;
+	};
+	typedef std::unordered_map<uint64, RequestState> RequestStateMap;
+
+	/* Token bucket that limits how many requests are sent to a server connection */
+	struct RequestBudget {
+		RequestBudget() : tokens(-1), lastRefill(0) { }
+
+		double tokens; // Negative until the first request
+		ULONGLONG lastRefill;
+	};
+	typedef std::unordered_map<uint64, RequestBudget> RequestBudgetMap;
+
+	typedef std::map<std::pair<uint64, uint64>, ChannelSummary> ChannelSummaryMap; // By server connection and channel
+
+	RecordMap gw2RemoteInfos;
+	ServerClientsMap serverClients; // Client IDs with a record, per server connection
+	ServerClientsMap legacyClients; // Client IDs that need full JSON snapshots with names, per server connection
+	RequestStateMap requestStates; // By makeKey
+	RequestBudgetMap requestBudgets; // By server connection
+	ProximityIndex proximityIndex; // Online clients by map and position
+	ChannelSummaryMap channelSummaries;
+	Gw2Api::Async::Callback onNamesFetched;
+	ChannelResolver channelResolver;
+
+	/* Needs the exclusive lock */
+	void markReceived(uint64 serverConnectionHandlerID, anyID clientID);
+	/* Needs the exclusive lock; to be called after every change of a record */
+	void indexRecord(const Gw2RemoteInfo& record);
+	/* Needs the lock; the text depends on other clients, so it isn't part of the cached info data */
+	void appendNearbyClients(const Gw2RemoteInfo& record, std::string& data) const;
+	/* Needs the exclusive lock; adds the record to the summary of its channel (weight 1) or takes it out again (weight -1) */
+	void summarizeRecord(const Gw2RemoteInfo& record, int weight);
+	/* Renders the summary only if it isn't cached; returns false if nobody in the channel is in game */
+	bool getChannelInfoData(uint64 serverConnectionHandlerID, uint64 channelID, std::string& data);
 
 protected:
-	CRITICAL_SECTION cs;
-	bool getRemoteGW2InfoRowID(uint64 serverConnectionHandlerID, anyID clientID, int& result);
+	SRWLOCK lock;
+
+	static uint64 makeKey(uint64 serverConnectionHandlerID, anyID clientID) { return (serverConnectionHandlerID << 16) | clientID; }
+
+	/* Callers need to hold the lock for as long as they use the returned record */
+	const Gw2RemoteInfo* findRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID) const;
 
 public:
+	/* A client close to a position, see findNearbyClients */
+	struct NearbyClient {
+		anyID clientID;
+		std::string characterName;
+		uint32_t waypointId; // The waypoint closest to the client, 0 if there is none
+		std::string waypointName; // Empty if the name hasn't been resolved yet
+		double distance; // In continent units, from the last received position
+	};
+
 	Gw2RemoteInfoContainer();
-	~Gw2RemoteInfoContainer();
 
-	std::string getInfoData(uint64 serverConnectionHandlerID, anyID clientID, enum PluginItemType type);
-	bool getInfoData(uint64 serverConnectionHandlerID, anyID clientID, enum PluginItemType type, std::string& data);
+	/* Called (on a worker thread) when API data for names that were missing while rendering has been downloaded */
+	void setNamesFetchedCallback(const Gw2Api::Async::Callback& callback) { onNamesFetched = callback; }
+	/* Called with the lock held, so it must not call back into the container */
+	void setChannelResolver(const ChannelResolver& resolver) { channelResolver = resolver; }
+
+	/* The text of the info panel for a client, or the summary of a channel (id is its channel ID then) */
+	std::string getInfoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type);
+	bool getInfoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type, std::string& data);
 
 	bool getRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, Gw2RemoteInfo& result);
+	/* Replaces result with up to maxCount online clients on mapId, closest to position first; excludeClientID (0 for none) is left out */
+	void findNearbyClients(uint64 serverConnectionHandlerID, int mapId, const Gw2Api::Vector2D& position, anyID excludeClientID, size_t maxCount,
+		std::vector<NearbyClient>& result);
 	void updateRemoteGW2Info(const Gw2RemoteInfo& data);
+	/* Stores a decoded packed snapshot, or applies a packed delta on top of the existing record;
+	 * returns false if there's no record or a delta is missing in between */
+	bool updateRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, const Gw2InfoCodec::Decoder& message);
+	/*
+	 * Decides whether a RequestGW2Info should be sent to a client and marks it as in flight if so.
+	 * Requests are skipped while one is in flight, if the data is younger than the configured TTL (unless stale is set,
+	 * e.g. after a missed delta) and once the request budget of the server connection is used up.
+	 */
+	bool beginGW2InfoRequest(uint64 serverConnectionHandlerID, anyID clientID, bool stale);
+	void markLegacyClient(uint64 serverConnectionHandlerID, anyID clientID);
+	bool hasLegacyClients(uint64 serverConnectionHandlerID);
+	/* Moves the record of a client (if there is one) to another channel, for its summary */
+	void moveRemoteGW2InfoRecord(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID);
 	bool removeRemoteGW2InfoRecord(uint64 serverConnectionHandlerID, anyID clientID);
 	void removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID);
 	void removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID, int* removedRecords);
@@ -0,0 +1,332 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <cmath>
+#include "gw2api/base64.h"
+#include "gw2infocodec.h"
+using namespace std;
+using namespace Gw2Api;
+using namespace Gw2Api::MumbleLink;
+
+namespace Gw2InfoCodec {
+
+	namespace {
+
+		enum Field {
+			FIELD_CHARACTERNAME = 0,
+			FIELD_PROFESSION,
+			FIELD_CHARACTERCONTINENTPOSITION,
+			FIELD_MAPID,
+			FIELD_MAPNAME,
+			FIELD_REGIONID,
+			FIELD_REGIONNAME,
+			FIELD_CONTINENTID,
+			FIELD_CONTINENTNAME,
+			FIELD_WORLDID,
+			FIELD_WORLDNAME,
+			FIELD_WAYPOINTID,
+			FIELD_WAYPOINTNAME,
+			FIELD_WAYPOINTCONTINENTPOSITION,
+			FIELD_TEAMCOLORID,
+			FIELD_COMMANDER,
+			FIELD_PLUGINVERSION,
+			FIELD_CHARACTERCONTINENTVELOCITY,
+			FIELD_COUNT
+		};
+
+		const uint32_t nameFields = (1 << FIELD_MAPNAME) | (1 << FIELD_REGIONNAME) | (1 << FIELD_CONTINENTNAME) | (1 << FIELD_WORLDNAME) | (1 << FIELD_WAYPOINTNAME);
+		const uint32_t allFields = (1 << FIELD_COUNT) - 1;
+
+		const uint32_t FLAG_SNAPSHOT = 1;
+
+		// Coordinates are sent in tenths of a continent unit, far below anything the info panel can show
+		const double positionScale = 10.0;
+
+		inline int64_t quantize(double value) {
+			return (int64_t)floor(value * positionScale + 0.5);
+		}
+
+		inline double dequantize(int64_t value) {
+			return value / positionScale;
+		}
+
+
+		inline void writeVarint(vector<unsigned char>& bytes, uint64_t value) {
+			while (value >= 0x80) {
+				bytes.push_back((unsigned char)(value | 0x80));
+				value >>= 7;
+			}
+			bytes.push_back((unsigned char)value);
+		}
+
+		inline void writeSignedVarint(vector<unsigned char>& bytes, int64_t value) {
+			writeVarint(bytes, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+		}
+
+		inline void writeString(vector<unsigned char>& bytes, const string& value) {
+			writeVarint(bytes, value.size());
+			bytes.insert(bytes.end(), value.begin(), value.end());
+		}
+
+
+		/* Reads from a decoded message; every read fails once the end has been reached in the middle of a value */
+		class Reader {
+		public:
+			Reader(const unsigned char* begin, const unsigned char* end) : position(begin), end(end) { }
+
+			bool readVarint(uint64_t* value) {
+				uint64_t result = 0;
+				for (int shift = 0; shift < 64; shift += 7) {
+					if (position == end)
+						return false;
+					unsigned char byte = *position++;
+					result |= (uint64_t)(byte & 0x7F) << shift;
+					if ((byte & 0x80) == 0) {
+						*value = result;
+						return true;
+					}
+				}
+				return false;
+			}
+
+			bool readUint(uint32_t* value) {
+				uint64_t result;
+				if (!readVarint(&result) || result > 0xFFFFFFFF)
+					return false;
+				*value = (uint32_t)result;
+				return true;
+			}
+
+			bool readSigned(int64_t* value) {
+				uint64_t result;
+				if (!readVarint(&result))
+					return false;
+				*value = (int64_t)(result >> 1) ^ -(int64_t)(result & 1);
+				return true;
+			}
+
+			/* The string is skipped if value is NULL */
+			bool readString(string* value) {
+				uint64_t length;
+				if (!readVarint(&length) || length > (uint64_t)(end - position))
+					return false;
+				if (value != NULL)
+					value->assign((const char*)position, (size_t)length);
+				position += (size_t)length;
+				return true;
+			}
+
+			bool atEnd() const { return position == end; }
+			const unsigned char* current() const { return position; }
+
+		private:
+			const unsigned char* position;
+			const unsigned char* end;
+		};
+
+		/* Reads the fields in mask into info; with info being NULL it only checks whether they can be read */
+		bool readFields(Reader& reader, uint32_t mask, Gw2Info* info) {
+			Gw2Info ignored;
+			Gw2Info& target = info != NULL ? *info : ignored;
+			string* strings[FIELD_COUNT] = { NULL };
+			if (info != NULL) {
+				strings[FIELD_CHARACTERNAME] = &info->characterName;
+				strings[FIELD_MAPNAME] = &info->mapName;
+				strings[FIELD_REGIONNAME] = &info->regionName;
+				strings[FIELD_CONTINENTNAME] = &info->continentName;
+				strings[FIELD_WORLDNAME] = &info->worldName;
+				strings[FIELD_WAYPOINTNAME] = &info->waypointName;
+				strings[FIELD_PLUGINVERSION] = &info->pluginVersion;
+			}
+
+			for (int field = 0; field < FIELD_COUNT; field++) {
+				if ((mask & (1 << field)) == 0)
+					continue;
+
+				bool success = true;
+				uint32_t number = 0;
+				int64_t x = 0, y = 0, z = 0;
+				switch (field) {
+					case FIELD_CHARACTERNAME:
+					case FIELD_MAPNAME:
+					case FIELD_REGIONNAME:
+					case FIELD_CONTINENTNAME:
+					case FIELD_WORLDNAME:
+					case FIELD_WAYPOINTNAME:
+					case FIELD_PLUGINVERSION:
+						success = reader.readString(strings[field]);
+						break;
+					case FIELD_CHARACTERCONTINENTPOSITION:
+						success = reader.readSigned(&x) && reader.readSigned(&y) && reader.readSigned(&z);
+						if (success)
+							target.characterContinentPosition = Vector3D(dequantize(x), dequantize(y), dequantize(z));
+						break;
+					case FIELD_WAYPOINTCONTINENTPOSITION:
+						success = reader.readSigned(&x) && reader.readSigned(&y);
+						if (success)
+							target.waypointContinentPosition = Vector2D(dequantize(x), dequantize(y));
+						break;
+					case FIELD_CHARACTERCONTINENTVELOCITY:
+						success = reader.readSigned(&x) && reader.readSigned(&y);
+						if (success)
+							target.characterContinentVelocity = Vector2D(dequantize(x), dequantize(y));
+						break;
+					default:
+						success = reader.readUint(&number);
+						if (!success)
+							break;
+						switch (field) {
+							case FIELD_PROFESSION:	target.profession = (Profession)number; break;
+							case FIELD_MAPID:		target.mapId = number; break;
+							case FIELD_REGIONID:	target.regionId = number; break;
+							case FIELD_CONTINENTID:	target.continentId = number; break;
+							case FIELD_WORLDID:		target.worldId = number; break;
+							case FIELD_WAYPOINTID:	target.waypointId = number; break;
+							case FIELD_TEAMCOLORID:	target.teamColorId = number; break;
+							case FIELD_COMMANDER:	target.commander = number != 0; break;
+						}
+						break;
+				}
+				if (!success)
+					return false;
+			}
+			return true;
+		}
+
+	}
+
+
+	bool Encoder::encode(const Gw2Info& info, const Gw2Info* previous, uint32_t sequence, bool idsOnly) {
+		uint32_t mask = allFields;
+		if (previous != NULL) {
+			mask = 0;
+			if (info.characterName != previous->characterName)					mask |= 1 << FIELD_CHARACTERNAME;
+			if (info.profession != previous->profession)						mask |= 1 << FIELD_PROFESSION;
+			if (quantize(info.characterContinentPosition.x) != quantize(previous->characterContinentPosition.x) ||
+				quantize(info.characterContinentPosition.y) != quantize(previous->characterContinentPosition.y) ||
+				quantize(info.characterContinentPosition.z) != quantize(previous->characterContinentPosition.z))
+																				mask |= 1 << FIELD_CHARACTERCONTINENTPOSITION;
+			if (info.mapId != previous->mapId)									mask |= 1 << FIELD_MAPID;
+			if (info.mapName != previous->mapName)								mask |= 1 << FIELD_MAPNAME;
+			if (info.regionId != previous->regionId)							mask |= 1 << FIELD_REGIONID;
+			if (info.regionName != previous->regionName)						mask |= 1 << FIELD_REGIONNAME;
+			if (info.continentId != previous->continentId)						mask |= 1 << FIELD_CONTINENTID;
+			if (info.continentName != previous->continentName)					mask |= 1 << FIELD_CONTINENTNAME;
+			if (info.worldId != previous->worldId)								mask |= 1 << FIELD_WORLDID;
+			if (info.worldName != previous->worldName)							mask |= 1 << FIELD_WORLDNAME;
+			if (info.waypointId != previous->waypointId)						mask |= 1 << FIELD_WAYPOINTID;
+			if (info.waypointName != previous->waypointName)					mask |= 1 << FIELD_WAYPOINTNAME;
+			if (quantize(info.waypointContinentPosition.x) != quantize(previous->waypointContinentPosition.x) ||
+				quantize(info.waypointContinentPosition.y) != quantize(previous->waypointContinentPosition.y))
+																				mask |= 1 << FIELD_WAYPOINTCONTINENTPOSITION;
+			if (info.teamColorId != previous->teamColorId)						mask |= 1 << FIELD_TEAMCOLORID;
+			if (info.commander != previous->commander)							mask |= 1 << FIELD_COMMANDER;
+			if (info.pluginVersion != previous->pluginVersion)					mask |= 1 << FIELD_PLUGINVERSION;
+			if (quantize(info.characterContinentVelocity.x) != quantize(previous->characterContinentVelocity.x) ||
+				quantize(info.characterContinentVelocity.y) != quantize(previous->characterContinentVelocity.y))
+																				mask |= 1 << FIELD_CHARACTERCONTINENTVELOCITY;
+		}
+		if (idsOnly)
+			mask &= ~nameFields;
+		if (previous != NULL && mask == 0)
+			return false;
+
+		bytes.clear();
+		bytes.push_back(formatVersion);
+		bytes.push_back((unsigned char)(previous == NULL ? FLAG_SNAPSHOT : 0));
+		writeVarint(bytes, sequence);
+		writeVarint(bytes, mask);
+
+		if (mask & (1 << FIELD_CHARACTERNAME))				writeString(bytes, info.characterName);
+		if (mask & (1 << FIELD_PROFESSION))					writeVarint(bytes, (uint32_t)info.profession);
+		if (mask & (1 << FIELD_CHARACTERCONTINENTPOSITION)) {
+			writeSignedVarint(bytes, quantize(info.characterContinentPosition.x));
+			writeSignedVarint(bytes, quantize(info.characterContinentPosition.y));
+			writeSignedVarint(bytes, quantize(info.characterContinentPosition.z));
+		}
+		if (mask & (1 << FIELD_MAPID))						writeVarint(bytes, info.mapId);
+		if (mask & (1 << FIELD_MAPNAME))					writeString(bytes, info.mapName);
+		if (mask & (1 << FIELD_REGIONID))					writeVarint(bytes, info.regionId);
+		if (mask & (1 << FIELD_REGIONNAME))					writeString(bytes, info.regionName);
+		if (mask & (1 << FIELD_CONTINENTID))				writeVarint(bytes, info.continentId);
+		if (mask & (1 << FIELD_CONTINENTNAME))				writeString(bytes, info.continentName);
+		if (mask & (1 << FIELD_WORLDID))					writeVarint(bytes, info.worldId);
+		if (mask & (1 << FIELD_WORLDNAME))					writeString(bytes, info.worldName);
+		if (mask & (1 << FIELD_WAYPOINTID))					writeVarint(bytes, info.waypointId);
+		if (mask & (1 << FIELD_WAYPOINTNAME))				writeString(bytes, info.waypointName);
+		if (mask & (1 << FIELD_WAYPOINTCONTINENTPOSITION)) {
+			writeSignedVarint(bytes, quantize(info.waypointContinentPosition.x));
+			writeSignedVarint(bytes, quantize(info.waypointContinentPosition.y));
+		}
+		if (mask & (1 << FIELD_TEAMCOLORID))				writeVarint(bytes, info.teamColorId);
+		if (mask & (1 << FIELD_COMMANDER))					writeVarint(bytes, info.commander ? 1 : 0);
+		if (mask & (1 << FIELD_PLUGINVERSION))				writeString(bytes, info.pluginVersion);
+		if (mask & (1 << FIELD_CHARACTERCONTINENTVELOCITY)) {
+			writeSignedVarint(bytes, quantize(info.characterContinentVelocity.x));
+			writeSignedVarint(bytes, quantize(info.characterContinentVelocity.y));
+		}
+
+		base64Encode(&bytes[0], bytes.size(), encoded);
+		return true;
+	}
+
+
+	bool Decoder::decode(const StringRef& text) {
+		lastSequence = 0;
+		lastFlags = 0;
+		lastFieldMask = 0;
+		if (!base64Decode(text.data(), text.size(), bytes) || bytes.size() < 2 || bytes[0] != formatVersion) {
+			bytes.clear();
+			return false;
+		}
+
+		Reader reader(&bytes[0] + 2, &bytes[0] + bytes.size());
+		lastFlags = bytes[1];
+		bool valid = reader.readUint(&lastSequence) && reader.readUint(&lastFieldMask) && (lastFieldMask & ~allFields) == 0;
+		if (valid) {
+			// Check everything up front, so apply never leaves a record half updated
+			fieldsOffset = reader.current() - &bytes[0];
+			valid = readFields(reader, lastFieldMask, NULL) && reader.atEnd();
+		}
+		if (!valid) {
+			bytes.clear();
+			lastFieldMask = 0;
+		}
+		return valid;
+	}
+
+	void Decoder::apply(Gw2Info& info) const {
+		if (bytes.empty())
+			return;
+
+		// Senders in ids-only mode don't send names, so names of ids that change are stale
+		uint32_t oldMapId = info.mapId, oldWorldId = info.worldId, oldWaypointId = info.waypointId;
+
+		Reader reader(&bytes[0] + fieldsOffset, &bytes[0] + bytes.size());
+		readFields(reader, lastFieldMask, &info);
+
+		if (info.mapId != oldMapId && (lastFieldMask & (1 << FIELD_MAPNAME)) == 0) {
+			info.mapName = "";
+			info.regionName = "";
+			info.continentName = "";
+		}
+		if (info.worldId != oldWorldId && (lastFieldMask & (1 << FIELD_WORLDNAME)) == 0)
+			info.worldName = "";
+		if (info.waypointId != oldWaypointId && (lastFieldMask & (1 << FIELD_WAYPOINTNAME)) == 0)
+			info.waypointName = "";
+	}
+
+	bool Decoder::isSnapshot() const {
+		return (lastFlags & FLAG_SNAPSHOT) != 0;
+	}
+
+}
@@ -0,0 +1,65 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <string>
+#include <stdint.h>
+#include <vector>
+#include "gw2info.h"
+#include "stringutils.h"
+
+/*
+ * Packed binary encoding of Gw2Info for the GW2InfoPacked command, base64 encoded to keep it text-safe.
+ *
+ * Layout: format version byte, flags byte, sequence varint, field mask varint, followed by the fields in the mask in bit order.
+ * Numbers are varints, coordinates (and the velocity) are zigzag varints in tenths of a continent unit and strings are prefixed with their length.
+ * A snapshot carries every field; a delta only the ones that changed and is relative to the previous sequence.
+ */
+namespace Gw2InfoCodec {
+
+	const unsigned char formatVersion = 1;
+
+	/* Keeps its buffers between calls, so encoding doesn't allocate once they're large enough */
+	class Encoder {
+	public:
+		/* Encodes all fields, or only the ones that differ from previous if it isn't NULL; returns false if there are none */
+		bool encode(const Gw2Info& info, const Gw2Info* previous, uint32_t sequence, bool idsOnly);
+		/* The result of the last successful encode */
+		const std::string& text() const { return encoded; }
+
+	private:
+		std::vector<unsigned char> bytes;
+		std::string encoded;
+	};
+
+	/* Keeps its buffer between calls, so decoding doesn't allocate once it's large enough */
+	class Decoder {
+	public:
+		Decoder() : fieldsOffset(0), lastSequence(0), lastFlags(0), lastFieldMask(0) { }
+
+		/* Decodes and validates the whole message; returns false if it isn't a packed message this version understands */
+		bool decode(const StringRef& text);
+		/* Overwrites the fields present in the last decoded message, like Gw2Info::applyJson */
+		void apply(Gw2Info& info) const;
+
+		uint32_t sequence() const { return lastSequence; }
+		bool isSnapshot() const;
+
+	private:
+		std::vector<unsigned char> bytes;
+		size_t fieldsOffset;
+		uint32_t lastSequence;
+		uint32_t lastFlags;
+		uint32_t lastFieldMask;
+	};
+
+}
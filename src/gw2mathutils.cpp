@@ -10,38 +10,201 @@
  * GNU General Public License for more details.
 */
 
+#include <math.h>
+#include <memory>
+#include <unordered_map>
+#include <Windows.h>
 #include "gw2mathutils.h"
 #include "gw2api/gw2api.h"
 using namespace Gw2Api;
 
-bool getClosestWaypoint(const Vector3D& characterContinentPosition, int map_id, PointOfInterestEntry* waypoint) {
+namespace {
+
+	struct MapTransformEntry {
+		MapTransform transform;
+		std::weak_ptr<const MapsRootEntry> root; // Expires once the cache has dropped the response the transform has been built from
+	};
+
+	struct State {
+		State() { InitializeCriticalSection(&cs); }
+		~State() { DeleteCriticalSection(&cs); }
+
+		CRITICAL_SECTION cs;
+		std::unordered_map<int, MapTransformEntry> mapTransforms;
+	};
+
+	State state;
+
+	class Lock {
+	public:
+		Lock() { EnterCriticalSection(&state.cs); }
+		~Lock() { LeaveCriticalSection(&state.cs); }
+	};
+
+}
+
+MapTransform::MapTransform(int map_id, const MapEntry& map) {
+	Gw2Position position = Gw2Position(Vector3D(), Gw2Position::Mumble, map_id, map.map_rect, map.continent_rect);
+	horizontal = position.getTransform(Gw2Position::Mumble, Gw2Position::Continent);
+	heightScale = Gw2Position::getHeightScale(Gw2Position::Mumble, Gw2Position::Continent);
+}
+
+bool getMapTransform(int map_id, MapTransform* transform, bool* isPending, const Async::Callback& onFetched) {
+	*isPending = false;
+	{
+		Lock lock;
+		std::unordered_map<int, MapTransformEntry>::const_iterator it = state.mapTransforms.find(map_id);
+		if (it != state.mapTransforms.end() && !it->second.root.expired()) {
+			*transform = it->second.transform;
+			return true;
+		}
+	}
+
+	ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
+	if (!getCachedMap(map_id, &map)) {
+		*isPending = true;
+		if (onFetched)
+			Async::fetchMap(map_id, onFetched);
+		return false;
+	}
+
+	MapTransformEntry entry;
+	entry.transform = MapTransform(map_id, *map.value);
+	entry.root = map.root;
+	*transform = entry.transform;
+	Lock lock;
+	state.mapTransforms[map_id] = entry;
+	return true;
+}
+
+bool getClosestWaypoint(const Vector3D& characterContinentPosition, int map_id, PointOfInterestEntry* waypoint,
+	bool* isPending, const Async::Callback& onFetched) {
+	return getClosestWaypoint(characterContinentPosition, map_id, waypoint, NULL, isPending, onFetched);
+}
+
+bool getClosestWaypoint(const Vector3D& characterContinentPosition, int map_id, PointOfInterestEntry* waypoint, double* safeRadius,
+	bool* isPending, const Async::Callback& onFetched) {
+	*isPending = false;
 	ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
-	getMap(map_id, &map);
+	if (!getCachedMap(map_id, &map)) {
+		*isPending = true;
+		if (onFetched)
+			Async::fetchMap(map_id, onFetched);
+		return false;
+	}
 
 	Vector2D position2D = characterContinentPosition.toVector2D();
-	double currentDistance;
-	for (unsigned i = 0; i < map.value.floors.size(); i++) {
-		int floor = map.value.floors[i];
-		MapFloorRootEntry mapFloorRoot;
-		getMapFloor(map.value.continent_id, floor, &mapFloorRoot);
-		MapFloorEntry mapFloor = mapFloorRoot.regions[map.value.region_id].maps[map_id];
-
-		for (unsigned j = 0; j < mapFloor.points_of_interest.size(); j++) {
-			if (mapFloor.points_of_interest[j].type == "waypoint") {
-				if (waypoint->name.empty()) {
-					*waypoint = mapFloor.points_of_interest[j];
-					currentDistance = waypoint->coord.getDistance(position2D);
-				}
-				else {
-					double distance = mapFloor.points_of_interest[j].coord.getDistance(position2D);
-					if (distance < currentDistance) {
-						*waypoint = mapFloor.points_of_interest[j];
-						currentDistance = distance;
-					}
-				}
+	MapFloorRootEntryPtr closestFloorRoot; // Keeps the closest waypoint alive while other floors are checked
+	const PointOfInterestEntry* closest = NULL;
+	double currentDistance = 0;
+	double secondDistance = HUGE_VAL; // Of the closest waypoint that isn't the closest one, floors share most of their waypoints
+	for (unsigned i = 0; i < map.value->floors.size(); i++) {
+		int floor = map.value->floors[i];
+		MapFloorRootEntryPtr mapFloorRoot;
+		if (!getCachedMapFloor(map.value->continent_id, floor, &mapFloorRoot)) {
+			*isPending = true;
+			if (onFetched)
+				Async::fetchMapFloor(map.value->continent_id, floor, onFetched);
+			continue;
+		}
+
+		MapFloorRegionEntries::const_iterator region = mapFloorRoot->regions.find(map.value->region_id);
+		if (region == mapFloorRoot->regions.end())
+			continue;
+		MapFloorEntries::const_iterator mapFloor = region->second.maps.find(map_id);
+		if (mapFloor == region->second.maps.end())
+			continue;
+
+		uint32_t poiIndices[2];
+		double distances[2];
+		int found = safeRadius != NULL ? mapFloor->second.waypoints.findClosestTwo(position2D, poiIndices, distances)
+			: (mapFloor->second.waypoints.findClosest(position2D, &poiIndices[0], &distances[0]) ? 1 : 0);
+		for (int j = 0; j < found; j++) {
+			const PointOfInterestEntry* poi = &mapFloor->second.points_of_interest[poiIndices[j]];
+			if (closest != NULL && poi->poi_id == closest->poi_id)
+				continue;
+			if (closest == NULL || distances[j] < currentDistance) {
+				if (closest != NULL)
+					secondDistance = currentDistance;
+				closest = poi;
+				closestFloorRoot = mapFloorRoot;
+				currentDistance = distances[j];
+			} else if (distances[j] < secondDistance) {
+				secondDistance = distances[j];
 			}
 		}
 	}
 
-	return !waypoint->name.empty();
+	if (closest == NULL)
+		return false;
+	*waypoint = *closest;
+	// Moving by d changes both distances by d at most, so the closest one stays the closest within half of their difference
+	if (safeRadius != NULL)
+		*safeRadius = (secondDistance - currentDistance) / 2;
+	return true;
+}
+
+bool WaypointTracker::update(const Vector3D& characterContinentPosition, int map_id, PointOfInterestEntry* waypoint, bool* isPending,
+	const Async::Callback& onFetched) {
+	Vector2D position = characterContinentPosition.toVector2D();
+	if (valid && map_id == mapId && position.getDistance(searchPosition) < safeRadius) {
+		stats.reused++;
+		*waypoint = closest;
+		*isPending = false;
+		return true;
+	}
+
+	stats.searches++;
+	valid = false;
+	double radius;
+	if (!getClosestWaypoint(characterContinentPosition, map_id, waypoint, &radius, isPending, onFetched))
+		return false;
+	// A floor that is still being downloaded may have a closer one
+	if (!*isPending) {
+		valid = true;
+		mapId = map_id;
+		searchPosition = position;
+		safeRadius = radius;
+		closest = *waypoint;
+	}
+	return true;
+}
+
+bool getWaypoint(int map_id, int poi_id, PointOfInterestEntry* waypoint, bool* isPending, const Async::Callback& onFetched) {
+	*isPending = false;
+	ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
+	if (!getCachedMap(map_id, &map)) {
+		*isPending = true;
+		if (onFetched)
+			Async::fetchMap(map_id, onFetched);
+		return false;
+	}
+
+	for (unsigned i = 0; i < map.value->floors.size(); i++) {
+		int floor = map.value->floors[i];
+		MapFloorRootEntryPtr mapFloorRoot;
+		if (!getCachedMapFloor(map.value->continent_id, floor, &mapFloorRoot)) {
+			*isPending = true;
+			if (onFetched)
+				Async::fetchMapFloor(map.value->continent_id, floor, onFetched);
+			continue;
+		}
+
+		MapFloorRegionEntries::const_iterator region = mapFloorRoot->regions.find(map.value->region_id);
+		if (region == mapFloorRoot->regions.end())
+			continue;
+		MapFloorEntries::const_iterator mapFloor = region->second.maps.find(map_id);
+		if (mapFloor == region->second.maps.end())
+			continue;
+
+		const PointOfInterestEntries& pointsOfInterest = mapFloor->second.points_of_interest;
+		for (unsigned j = 0; j < pointsOfInterest.size(); j++) {
+			if (pointsOfInterest[j].poi_id == poi_id) {
+				*waypoint = pointsOfInterest[j];
+				*isPending = false;
+				return true;
+			}
+		}
+	}
+	return false;
 }
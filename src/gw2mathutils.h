@@ -11,7 +11,83 @@
 */
 
 #pragma once
+#include <stdint.h>
+#include "gw2api/gw2api.h"
 #include "gw2api/math.h"
 #include "gw2api/objects.h"
 
-bool getClosestWaypoint(const Gw2Api::Vector3D& characterContinentPosition, int map_id, Gw2Api::PointOfInterestEntry* waypoint);
+/*
+ * Converts Mumble Link positions on one map to continent coordinates.
+ * The meters to inches scale, the map to continent mapping and the inverted axis are folded into a single transform,
+ * so a conversion is only a few multiply-adds instead of deriving everything from the map and continent rectangles again.
+ */
+class MapTransform {
+public:
+	MapTransform() : heightScale(1) { }
+	MapTransform(int map_id, const Gw2Api::MapEntry& map);
+
+	Gw2Api::Vector3D toContinentPosition(const Gw2Api::Vector3D& mumblePosition) const {
+		Gw2Api::Vector2D position = horizontal.apply(mumblePosition.toVector2D());
+		return Gw2Api::Vector3D(position.x, mumblePosition.y * heightScale, position.y);
+	}
+
+	/* The x and z part of the conversion, e.g. for Gw2Api::BatchTransform */
+	const Gw2Api::AffineTransform2D& getHorizontalTransform() const { return horizontal; }
+
+private:
+	Gw2Api::AffineTransform2D horizontal;
+	double heightScale;
+};
+
+/*
+ * Returns the transform of a map, which is built the first time the map is seen and kept until its cached API data is dropped.
+ * Uses the same cache-only behavior as getClosestWaypoint below.
+ */
+bool getMapTransform(int map_id, MapTransform* transform, bool* isPending, const Gw2Api::Async::Callback& onFetched);
+
+/*
+ * Finds the closest waypoint using cached API data only, so it never blocks on a download.
+ * Missing map or floor data is queued for download with onFetched as callback (unless it's empty),
+ * and isPending is set so the caller knows it should try again once that is done.
+ */
+bool getClosestWaypoint(const Gw2Api::Vector3D& characterContinentPosition, int map_id, Gw2Api::PointOfInterestEntry* waypoint,
+	bool* isPending, const Gw2Api::Async::Callback& onFetched);
+
+/* Also sets safeRadius to how far the position may move before another waypoint could be the closest one (HUGE_VAL if there is no other) */
+bool getClosestWaypoint(const Gw2Api::Vector3D& characterContinentPosition, int map_id, Gw2Api::PointOfInterestEntry* waypoint, double* safeRadius,
+	bool* isPending, const Gw2Api::Async::Callback& onFetched);
+
+/*
+ * Remembers the result of the last getClosestWaypoint together with its safe radius, so the waypoint is only searched again
+ * once the position has left that radius or the map has changed. Not thread-safe, every thread that tracks a position needs its own.
+ */
+class WaypointTracker {
+public:
+	struct Statistics {
+		Statistics() : searches(0), reused(0) { }
+
+		uint64_t searches;
+		uint64_t reused;
+	};
+
+	WaypointTracker() : valid(false), mapId(0), safeRadius(0) { }
+
+	/* Like getClosestWaypoint */
+	bool update(const Gw2Api::Vector3D& characterContinentPosition, int map_id, Gw2Api::PointOfInterestEntry* waypoint, bool* isPending,
+		const Gw2Api::Async::Callback& onFetched);
+	/* Searches again on the next update, e.g. after new API data has arrived */
+	void reset() { valid = false; }
+
+	const Statistics& getStatistics() const { return stats; }
+
+private:
+	bool valid;
+	int mapId;
+	Gw2Api::Vector2D searchPosition;
+	double safeRadius;
+	Gw2Api::PointOfInterestEntry closest;
+	Statistics stats;
+};
+
+/* Looks up a waypoint of a map by its id, with the same cache-only behavior as getClosestWaypoint */
+bool getWaypoint(int map_id, int poi_id, Gw2Api::PointOfInterestEntry* waypoint, bool* isPending, const Gw2Api::Async::Callback& onFetched);
@@ -0,0 +1,132 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <Windows.h>
+#include "gw2api/metrics.h"
+#include "globals.h"
+#include "infopanel.h"
+#include "mainthread.h"
+using namespace std;
+
+namespace InfoPanel {
+
+	/* Invalidations within this many ms end up in one refresh */
+	const DWORD refreshDelay = 100;
+
+	class PanelState {
+	public:
+		PanelState() : serverConnectionHandlerID(0), type((PluginItemType)0), id(0), hTimerQueue(NULL), hRefreshTimer(NULL) { InitializeCriticalSection(&cs); }
+		~PanelState() { DeleteCriticalSection(&cs); }
+
+		CRITICAL_SECTION cs;
+		Renderer renderer;
+		uint64 serverConnectionHandlerID;
+		PluginItemType type;
+		uint64 id;
+		string data; // What TeamSpeak has been given last time
+		HANDLE hTimerQueue;
+		HANDLE hRefreshTimer; // Set while a refresh is pending
+	};
+
+	static PanelState panel;
+
+	/* Runs on the GUI thread */
+	static void refresh() {
+		EnterCriticalSection(&panel.cs);
+		if (panel.hRefreshTimer != NULL) {
+			// Has fired already, so this doesn't have to wait
+			DeleteTimerQueueTimer(panel.hTimerQueue, panel.hRefreshTimer, NULL);
+			panel.hRefreshTimer = NULL;
+		}
+		Renderer renderer = panel.renderer;
+		uint64 serverConnectionHandlerID = panel.serverConnectionHandlerID;
+		PluginItemType type = panel.type;
+		uint64 id = panel.id;
+		string shownData = panel.data;
+		LeaveCriticalSection(&panel.cs);
+
+		if (type <= 0 || id <= 0 || !renderer)
+			return;
+		string data;
+		renderer(serverConnectionHandlerID, type, id, data);
+		if (data == shownData) {
+			Gw2Api::Metrics::add(Gw2Api::Metrics::InfoPanelRefreshesAvoided);
+			return;
+		}
+		Gw2Api::Metrics::add(Gw2Api::Metrics::InfoPanelRefreshes);
+		Globals::ts3Functions.requestInfoUpdate(serverConnectionHandlerID, type, id);
+	}
+
+	static VOID CALLBACK onRefreshTimer(PVOID lpParameter, BOOLEAN timerOrWaitFired) {
+		/* Requesting an info update from another thread crashes TeamSpeak */
+		MainThread::post(refresh);
+	}
+
+	/* Needs to be called with panel.cs held */
+	static void scheduleRefresh() {
+		if (panel.hRefreshTimer != NULL || panel.hTimerQueue == NULL) {
+			// Will be part of the pending refresh
+			Gw2Api::Metrics::add(Gw2Api::Metrics::InfoPanelRefreshesAvoided);
+			return;
+		}
+		if (!CreateTimerQueueTimer(&panel.hRefreshTimer, panel.hTimerQueue, onRefreshTimer, NULL, refreshDelay, 0, WT_EXECUTEONLYONCE))
+			panel.hRefreshTimer = NULL;
+	}
+
+	void init(const Renderer& renderer) {
+		EnterCriticalSection(&panel.cs);
+		panel.renderer = renderer;
+		if (panel.hTimerQueue == NULL)
+			panel.hTimerQueue = CreateTimerQueue();
+		LeaveCriticalSection(&panel.cs);
+	}
+
+	void shutdown() {
+		EnterCriticalSection(&panel.cs);
+		HANDLE hTimerQueue = panel.hTimerQueue;
+		panel.hTimerQueue = NULL;
+		panel.hRefreshTimer = NULL;
+		panel.renderer = Renderer();
+		LeaveCriticalSection(&panel.cs);
+
+		// Waits for a running onRefreshTimer and deletes the pending timer
+		if (hTimerQueue != NULL)
+			DeleteTimerQueueEx(hTimerQueue, INVALID_HANDLE_VALUE);
+	}
+
+	bool setShown(uint64 serverConnectionHandlerID, PluginItemType type, uint64 id, const string& data) {
+		EnterCriticalSection(&panel.cs);
+		bool isNew = panel.id != id;
+		panel.serverConnectionHandlerID = serverConnectionHandlerID;
+		panel.type = type;
+		panel.id = id;
+		panel.data = data;
+		LeaveCriticalSection(&panel.cs);
+		return isNew;
+	}
+
+	void invalidate(uint64 serverConnectionHandlerID) {
+		EnterCriticalSection(&panel.cs);
+		if (panel.serverConnectionHandlerID == serverConnectionHandlerID)
+			scheduleRefresh();
+		else
+			Gw2Api::Metrics::add(Gw2Api::Metrics::InfoPanelRefreshesAvoided);
+		LeaveCriticalSection(&panel.cs);
+	}
+
+	void invalidate() {
+		EnterCriticalSection(&panel.cs);
+		scheduleRefresh();
+		LeaveCriticalSection(&panel.cs);
+	}
+
+}
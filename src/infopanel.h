@@ -0,0 +1,45 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <functional>
+#include <string>
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+
+/*
+ * Keeps track of what the TeamSpeak info panel shows and refreshes it only when its text would actually change.
+ * Invalidations are collected for refreshDelay ms; the shown item is then rendered again and only handed to
+ * requestInfoUpdate if the text differs from what TeamSpeak got last time.
+ */
+namespace InfoPanel {
+
+	/* Produces the text ts3plugin_infoData hands to TeamSpeak for an item, empty for none */
+	typedef std::function<void (uint64 serverConnectionHandlerID, PluginItemType type, uint64 id, std::string& data)> Renderer;
+
+	/* Needs to be called from the GUI thread, e.g. in ts3plugin_init */
+	void init(const Renderer& renderer);
+	/* Waits for a running timer callback; call it before MainThread::shutdown */
+	void shutdown();
+
+	/* Called from ts3plugin_infoData with the item TeamSpeak is showing and its text; returns true if another item has been selected */
+	bool setShown(uint64 serverConnectionHandlerID, PluginItemType type, uint64 id, const std::string& data);
+
+	/*
+	 * Something on the server connection that the shown text may depend on has changed, e.g. a client (or one near it) got an update.
+	 * Can be called from any thread; does nothing if the panel shows something of another server connection.
+	 */
+	void invalidate(uint64 serverConnectionHandlerID);
+	/* Like above, for changes that aren't limited to one server connection, e.g. downloaded names */
+	void invalidate();
+
+}
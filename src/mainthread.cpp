@@ -0,0 +1,82 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QEvent>
+#include <QtCore/QObject>
+#include <Windows.h>
+#include "mainthread.h"
+
+namespace MainThread {
+
+	static const QEvent::Type functionEventType = (QEvent::Type)QEvent::registerEventType();
+
+	class FunctionEvent : public QEvent {
+	public:
+		FunctionEvent(const std::function<void ()>& function) : QEvent(functionEventType), function(function) { }
+
+		std::function<void ()> function;
+	};
+
+	/* Lives on the thread it has been created on, so Qt delivers the posted events there */
+	class Dispatcher : public QObject {
+	public:
+		bool event(QEvent* e) {
+			if (e->type() != functionEventType)
+				return QObject::event(e);
+
+			try {
+				static_cast<FunctionEvent*>(e)->function();
+			} catch (...) { }
+			return true;
+		}
+	};
+
+	class DispatcherContainer {
+	public:
+		DispatcherContainer() : dispatcher(NULL) { InitializeCriticalSection(&cs); }
+		~DispatcherContainer() { DeleteCriticalSection(&cs); }
+
+		CRITICAL_SECTION cs;
+		Dispatcher* dispatcher;
+	};
+
+	static DispatcherContainer container;
+
+
+	void init() {
+		EnterCriticalSection(&container.cs);
+		if (container.dispatcher == NULL)
+			container.dispatcher = new Dispatcher();
+		LeaveCriticalSection(&container.cs);
+	}
+
+	void shutdown() {
+		EnterCriticalSection(&container.cs);
+		Dispatcher* dispatcher = container.dispatcher;
+		container.dispatcher = NULL;
+		LeaveCriticalSection(&container.cs);
+
+		if (dispatcher != NULL) {
+			QCoreApplication::removePostedEvents(dispatcher);
+			delete dispatcher;
+		}
+	}
+
+	void post(const std::function<void ()>& function) {
+		EnterCriticalSection(&container.cs);
+		if (container.dispatcher != NULL)
+			QCoreApplication::postEvent(container.dispatcher, new FunctionEvent(function));
+		LeaveCriticalSection(&container.cs);
+	}
+
+}
@@ -0,0 +1,31 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <functional>
+
+/*
+ * Runs functions on the TeamSpeak GUI thread through its Qt event loop.
+ * Some TeamSpeak functions (e.g. requestInfoUpdate) crash the client when they are called from another thread,
+ * so background threads post their work here instead.
+ */
+namespace MainThread {
+
+	/* Needs to be called from the GUI thread, e.g. in ts3plugin_init */
+	void init();
+	/* Drops everything that hasn't run yet */
+	void shutdown();
+
+	/* Can be called from any thread; does nothing after shutdown */
+	void post(const std::function<void ()>& function);
+
+}
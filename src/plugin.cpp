@@ -23,31 +23,51 @@
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
+#include "gw2api/embeddeddata.h"
 #include "gw2api/gw2api.h"
+#include "gw2api/jsonarena.h"
+#include "gw2api/metrics.h"
 #include "gw2api/mumblelink.h"
+#include "gw2api/mumblelinkrecorder.h"
 #include "commands.h"
+#include "deadreckoning.h"
+#include "diagnostics.h"
 #include "plugin.h"
 #include "globals.h"
 #include "gw2info.h"
+#include "gw2infocodec.h"
 #include "gw2mathutils.h"
+#include "infopanel.h"
+#include "mainthread.h"
+#include "prefetcher.h"
+#include "processmonitor.h"
+#include "snapshotslot.h"
 #include "stringutils.h"
+#include "tickscheduler.h"
 #include "updatechecker.h"
 #include "configdialog.h"
 using namespace std;
 using namespace Globals;
 
-static Gw2Info gw2Info;
+static SnapshotSlot<Gw2Info> localInfo; // Published by the Mumble Link loop, read by the TeamSpeak callbacks
 static Gw2RemoteInfoContainer gw2RemoteInfoContainer;
+static Gw2InfoCodec::Decoder packedDecoder; // Plugin commands always arrive on the same thread
 
-static PluginItemType infoDataType = (PluginItemType)0;
-static uint64 infoDataId = 0;
-
-static time_t lastUpdateCheck = 0;
-static bool threadStopRequested = false;
 static HANDLE hThread = 0;
+static HANDLE hThreadStopEvent = 0;
+static HANDLE hApiResponseEvent = 0;
+static volatile LONG serverConnectionsChanged = 0; // Set when a server connection has been established, so the Mumble loop sends it a snapshot
+static TickScheduler tickScheduler;
+static WaypointTracker waypointTracker; // Only used by the Mumble Link loop
+
+/* Where the Mumble Link loop reads from; switched by chat commands, but applied by the loop itself since it owns the link */
+enum LinkMode { LinkModeNone, LinkModeLive, LinkModeRecord, LinkModeReplay };
+static volatile LONG linkModeRequest = LinkModeNone;
 
-DWORD WINAPI checkForUpdatesAsync(LPVOID lpParam);
+void getPublishTargets(vector<Commands::PublishTarget>& targets);
 DWORD WINAPI mumbleLinkCheckLoop(LPVOID lpParam);
+void onRemoteNamesFetched(bool success);
+void renderInfoData(uint64 serverConnectionHandlerID, PluginItemType type, uint64 id, string& data);
 
 
 /*********************************** Required functions ************************************/
@@ -94,8 +114,31 @@ int ts3plugin_init() {
 	debuglog("GW2Plugin: init\n");
 
 	Globals::loadConfig();
+	Gw2Api::EmbeddedData::addToCache();
+	Gw2Api::DiskCache::open(Globals::getCacheFilePath());
+
+	hThreadStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (hThreadStopEvent == 0) {
+		debuglog("\tCould not create the Mumble Link thread stop event: %d\n", GetLastError());
+		return 1;
+	}
+
+	hApiResponseEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hApiResponseEvent == 0) {
+		debuglog("\tCould not create the API response event: %d\n", GetLastError());
+		return 1;
+	}
+
+	Gw2Api::Async::start(Globals::apiConcurrency);
+	MainThread::init();
+	Commands::init();
+	InfoPanel::init(renderInfoData);
+	gw2RemoteInfoContainer.setNamesFetchedCallback(onRemoteNamesFetched);
+	gw2RemoteInfoContainer.setChannelResolver([](uint64 serverConnectionHandlerID, anyID clientID) -> uint64 {
+		uint64 channelID;
+		return ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &channelID) == ERROR_ok ? channelID : 0;
+	});
 
-	threadStopRequested = false;
 	hThread = CreateThread(NULL, 0, mumbleLinkCheckLoop, NULL, 0, NULL);
 	if (hThread == 0) {
 		debuglog("\tCould not create thread to check for Guild Wars 2 updates through Mumble Link: %d\n", GetLastError());
@@ -121,40 +164,60 @@ void ts3plugin_shutdown() {
 	debuglog("GW2Plugin: shutdown\n");
 
 	if (hThread != 0) {
-		bool threadClosed = false;
-		threadStopRequested = true;
-		DWORD threadReturn = WaitForSingleObject(hThread, 1000);
-		switch (threadReturn) {
-			case WAIT_ABANDONED:
-				debuglog("\tGuild Wars 2 checker thread has been abandoned\n");
-				break;
-			case WAIT_OBJECT_0:
-				debuglog("\tGuild Wars 2 checker thread has exited\n");
-				CloseHandle(hThread);
-				threadClosed = true;
-				break;
-			case WAIT_TIMEOUT:
-				debuglog("\tGuild Wars 2 checker thread has timed out\n");
-				break;
-			case WAIT_FAILED:
-				debuglog("\tWaiting on Guild Wars 2 checker thread has failed: %d\n", GetLastError());
-				break;
+		/* The loop only sleeps on the stop and API response events, so it notices the request within one iteration */
+		SetEvent(hThreadStopEvent);
+		DWORD threadReturn = WaitForSingleObject(hThread, INFINITE);
+		if (threadReturn == WAIT_OBJECT_0) {
+			debuglog("\tGuild Wars 2 checker thread has exited\n");
+		} else {
+			debuglog("\tWaiting on Guild Wars 2 checker thread has failed: %d\n", GetLastError());
 		}
-
-		/* In case the thread has not been exited within the given timeout, terminate it to prevent hanging */
-		if (!threadClosed) {
-			TerminateThread(hThread, 0);
-			CloseHandle(hThread);
+		CloseHandle(hThread);
+		hThread = 0;
+
+		TickScheduler::Statistics stats = tickScheduler.getStatistics();
+		debuglog("\tMumble Link wake-ups: %llu (unlinked: %llu, stalled: %llu, steady: %llu, changing: %llu)\n",
+			stats.wakeUps, stats.unlinkedWakeUps, stats.stalledWakeUps, stats.steadyWakeUps, stats.changingWakeUps);
+		for (int i = Gw2Api::Metrics::MumbleRead; i <= Gw2Api::Metrics::Send; i++) {
+			Gw2Api::Metrics::Histogram timing = Gw2Api::Metrics::get((Gw2Api::Metrics::Timer)i);
+			debuglog("\t%s: %llu times, %.3f ms on average, %.3f ms at most\n", Gw2Api::Metrics::getName((Gw2Api::Metrics::Timer)i),
+				timing.count, timing.count > 0 ? timing.totalMicroseconds / 1000.0 / timing.count : 0.0, timing.maxMicroseconds / 1000.0);
 		}
+		WaypointTracker::Statistics waypointStats = waypointTracker.getStatistics();
+		debuglog("\tClosest waypoint: %llu searches, %llu reused\n", waypointStats.searches, waypointStats.reused);
+	}
+	if (hThreadStopEvent != 0) {
+		CloseHandle(hThreadStopEvent);
+		hThreadStopEvent = 0;
+	}
+
+	/* Wait for running API requests, their callbacks signal hApiResponseEvent or post to the main thread */
+	Gw2Api::Async::stop();
+	InfoPanel::shutdown();
+	MainThread::shutdown();
+	Commands::shutdown();
+	if (hApiResponseEvent != 0) {
+		CloseHandle(hApiResponseEvent);
+		hApiResponseEvent = 0;
 	}
 
-	gw2Info.clear();
+	Gw2Api::Cache::Statistics cacheStats = Gw2Api::Cache::getStatistics();
+	debuglog("\tAPI cache: %llu hits, %llu misses, %llu evictions, %u objects using about %u of %u bytes\n",
+		cacheStats.hits, cacheStats.misses, cacheStats.evictions, (unsigned)cacheStats.objectCount, (unsigned)cacheStats.memoryUsage, (unsigned)cacheStats.memoryBudget);
+	size_t stringPoolMemory;
+	size_t stringPoolSize = Gw2Api::InternedString::getPoolSize(&stringPoolMemory);
+	debuglog("\tAPI name pool: %u strings using about %u bytes\n", (unsigned)stringPoolSize, (unsigned)stringPoolMemory);
+	Gw2Api::DiskCache::close();
+	Gw2Api::Http::close();
+	Gw2Info offlineInfo;
+	localInfo.publish(offlineInfo);
 
 	/* In case the plugin was deactivated without shutting down TeamSpeak, we need to let the other clients know */
-	uint64 serverConnectionHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
-	if (serverConnectionHandlerID != 0) {
-		debuglog("GW2Plugin: Sending offline Guild Wars 2 info message\n");
-		Commands::sendGW2Info(serverConnectionHandlerID, gw2Info, PluginCommandTarget_SERVER, NULL);
+	vector<Commands::PublishTarget> targets;
+	getPublishTargets(targets);
+	for (size_t i = 0; i < targets.size(); i++) {
+		debuglog("GW2Plugin: Sending offline Guild Wars 2 info message to server %llu\n", (long long unsigned int)targets[i].serverConnectionHandlerID);
+		Commands::sendGW2Info(targets[i].serverConnectionHandlerID, offlineInfo, targets[i].compact);
 	}
 
 	/*
@@ -209,6 +272,82 @@ void ts3plugin_registerPluginID(const char* id) {
 	debuglog("GW2Plugin: registerPluginID: %s\n", pluginID);
 }
 
+/*
+ * Plugin command keyword, the chat commands are typed as "/gw2 <command>":
+ * stats prints the performance counters, record and replay switch Mumble Link to a recording in the config folder, live switches back
+ */
+const char* ts3plugin_commandKeyword() {
+	return "gw2";
+}
+
+/* How many clients /gw2 near lists at most */
+static const size_t maxListedNearbyClients = 10;
+
+static void printNearbyClients(uint64 serverConnectionHandlerID) {
+	shared_ptr<const Gw2Info> info = localInfo.get();
+	if (info->characterName.empty() || info->mapId <= 0) {
+		ts3Functions.printMessageToCurrentTab("You are not in Guild Wars 2 right now.");
+		return;
+	}
+	if (info->characterContinentPosition == Gw2Api::Vector3D()) {
+		ts3Functions.printMessageToCurrentTab("Your position is not known yet, the map is still being downloaded.");
+		return;
+	}
+
+	anyID myID;
+	if (ts3Functions.getClientID(serverConnectionHandlerID, &myID) != ERROR_ok)
+		myID = 0;
+	vector<Gw2RemoteInfoContainer::NearbyClient> nearby;
+	gw2RemoteInfoContainer.findNearbyClients(serverConnectionHandlerID, info->mapId, info->characterContinentPosition.toVector2D(), myID,
+		maxListedNearbyClients, nearby);
+
+	string mapName = !info->mapName.empty() ? info->mapName : "Map " + to_string(info->mapId);
+	if (nearby.empty()) {
+		string message = "Nobody else on this server is in [color=blue]" + mapName + "[/color].";
+		ts3Functions.printMessageToCurrentTab(message.c_str());
+		return;
+	}
+	string title = "[b]Closest players in " + mapName + "[/b]";
+	ts3Functions.printMessageToCurrentTab(title.c_str());
+	for (size_t i = 0; i < nearby.size(); i++) {
+		string line = "[color=blue]" + nearby[i].characterName + "[/color] - " + to_string((int)(nearby[i].distance + 0.5)) + " away";
+		if (nearby[i].waypointId > 0)
+			line += ", near " + (!nearby[i].waypointName.empty() ? nearby[i].waypointName : "Waypoint " + to_string(nearby[i].waypointId));
+		ts3Functions.printMessageToCurrentTab(line.c_str());
+	}
+}
+
+/* Plugin processes console command. Return 0 if plugin handled the command, 1 if not handled. */
+int ts3plugin_processCommand(uint64 serverConnectionHandlerID, const char* command) {
+	if (strcmp(command, "stats") == 0) {
+		string report = Diagnostics::getReport();
+		vector<string> lines = split(report, '\n');
+		ts3Functions.printMessageToCurrentTab("[b]Guild Wars 2 plugin statistics[/b]");
+		for (size_t i = 0; i < lines.size(); i++) {
+			if (!lines[i].empty())
+				ts3Functions.printMessageToCurrentTab(lines[i].c_str());
+		}
+		return 0;
+	}
+	if (strcmp(command, "near") == 0) {
+		printNearbyClients(serverConnectionHandlerID);
+		return 0;
+	}
+	LinkMode mode = LinkModeNone;
+	if (strcmp(command, "live") == 0)
+		mode = LinkModeLive;
+	else if (strcmp(command, "record") == 0)
+		mode = LinkModeRecord;
+	else if (strcmp(command, "replay") == 0)
+		mode = LinkModeReplay;
+	if (mode != LinkModeNone) {
+		InterlockedExchange(&linkModeRequest, mode);
+		if (hApiResponseEvent != 0)
+			SetEvent(hApiResponseEvent); // Wake up the Mumble loop
+		return 0;
+	}
+	return 1;
+}
 
 /* Client changed current server connection handler */
 void ts3plugin_currentServerConnectionChanged(uint64 serverConnectionHandlerID) {
@@ -232,26 +371,23 @@ const char* ts3plugin_infoTitle() {
  * "data" to NULL to have the client ignore the info data.
  */
 void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 clientID, enum PluginItemType type, char** data) {
+	// Kept between calls, so copying the cached text out of the container doesn't allocate
+	static string result;
+	renderInfoData(serverConnectionHandlerID, type, clientID, result);
+	if (result.length() > 0) {
+		*data = _strdup(result.c_str());
+	} else {
+		*data = NULL;
+	}
+
 	/* Save this in case the right panel needs to be updated visually without having to reselect the client */
 	/* This also has a purpose of getting the last selected row and check if it's the same as the current one */
-	bool isNew = infoDataId != clientID;
-	infoDataType = type;
-	infoDataId = clientID;
+	bool isNew = InfoPanel::setShown(serverConnectionHandlerID, type, clientID, result);
 
-	try {
-		string result = gw2RemoteInfoContainer.getInfoData(serverConnectionHandlerID, (anyID)clientID, type);
-		if (result.length() > 0) {
-			*data = _strdup(result.c_str());
-		} else {
-			*data = NULL;
-		}
-	} catch (int e) {
-		debuglog("GW2Plugin: Exception caught while trying to display info data: %d", e);
-		*data = NULL;
+	if (isNew && type == PLUGIN_CLIENT && gw2RemoteInfoContainer.beginGW2InfoRequest(serverConnectionHandlerID, (anyID)clientID, false)) {
+		anyID targetIDs[] = { (anyID)clientID, 0 };
+		Commands::requestGW2Info(serverConnectionHandlerID, PluginCommandTarget_CLIENT, targetIDs);
 	}
-
-	if (isNew && type == PLUGIN_CLIENT)
-		Commands::requestGW2Info(serverConnectionHandlerID, PluginCommandTarget_CLIENT, (anyID*)&clientID);
 }
 
 /* Required to release the memory for parameter "data" allocated in ts3plugin_infoData and ts3plugin_initMenus */
@@ -282,13 +418,53 @@ void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int
 		case STATUS_DISCONNECTED: {
 			debuglog("GW2Plugin: Disconnected; removing all previous received client data\n");			
 			gw2RemoteInfoContainer.removeAllRemoteGW2InfoRecords(serverConnectionHandlerID);
+			Commands::removeServerConnection(serverConnectionHandlerID);
 			break;
 		}
-		case STATUS_CONNECTION_ESTABLISHED:
+		case STATUS_CONNECTION_ESTABLISHED: {
 			debuglog("GW2Plugin: Connection with server %d established\n", serverConnectionHandlerID);
 			checkForUpdates();
+
+			// Everyone with this version answers one broadcast request, so their records are fresh before they are selected
+			Commands::syncGW2Info(serverConnectionHandlerID);
+
+			InterlockedExchange(&serverConnectionsChanged, 1);
+			if (hApiResponseEvent != 0)
+				SetEvent(hApiResponseEvent); // Wake up the Mumble loop
 			break;
+		}
+	}
+}
+
+/* Keeps the channel summaries up to date; a new channel of 0 means the client has left the server */
+static void onClientMoved(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID) {
+	if (newChannelID == 0) {
+		debuglog("GW2Plugin: Client %d has left the server, removing received data\n", clientID);
+		gw2RemoteInfoContainer.removeRemoteGW2InfoRecord(serverConnectionHandlerID, clientID);
+	} else {
+		gw2RemoteInfoContainer.moveRemoteGW2InfoRecord(serverConnectionHandlerID, clientID, newChannelID);
 	}
+	InfoPanel::invalidate(serverConnectionHandlerID);
+}
+
+void ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* moveMessage) {
+	onClientMoved(serverConnectionHandlerID, clientID, newChannelID);
+}
+
+void ts3plugin_onClientMoveSubscriptionEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility) {
+	onClientMoved(serverConnectionHandlerID, clientID, newChannelID);
+}
+
+void ts3plugin_onClientMoveTimeoutEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* timeoutMessage) {
+	onClientMoved(serverConnectionHandlerID, clientID, newChannelID);
+}
+
+void ts3plugin_onClientMoveMovedEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID moverID, const char* moverName, const char* moverUniqueIdentifier, const char* moveMessage) {
+	onClientMoved(serverConnectionHandlerID, clientID, newChannelID);
+}
+
+void ts3plugin_onClientKickFromChannelEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
+	onClientMoved(serverConnectionHandlerID, clientID, newChannelID);
 }
 
 void ts3plugin_onClientKickFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
@@ -318,107 +494,390 @@ void ts3plugin_onServerStopEvent(uint64 serverConnectionHandlerID, const char* s
 void ts3plugin_onPluginCommandEvent(uint64 serverConnectionHandlerID, const char* pluginName, const char* pluginCommand) {
 	debuglog("GW2Plugin: Received command '%s'\n", pluginCommand);
 
-	Commands::CommandType commandType;
-	vector<string> commandParameters;
-	Commands::parseCommand(pluginCommand, commandType, commandParameters);
+	Commands::ParsedCommand command;
+	Commands::parseCommand(pluginCommand, command);
+	const StringRef* commandParameters = command.parameters;
 
-	switch(commandType) {
+	switch(command.type) {
 		case Commands::CMD_NONE:
 			debuglog("\tUnknown command\n");
 			break;  /* Command not handled by plugin */
 		case Commands::CMD_GW2INFO: {
-			if (commandParameters.size() != 2) {
-				debuglog("\tInvalid parameter count: %d\n", commandParameters.size());
+			if (command.parameterCount != 2) {
+				debuglog("\tInvalid parameter count: %d\n", command.parameterCount);
 				break;
 			}
-			debuglog("\tCommand: GW2Info\n\tClient: %s\n\tData: %s\n", commandParameters.at(0).c_str(), commandParameters.at(1).c_str());
-			
-			anyID clientID = (anyID)atoi(commandParameters.at(0).c_str());
-			string jsonString = commandParameters.at(1);
-			Gw2RemoteInfo gw2RemoteInfo = Gw2RemoteInfo(jsonString, serverConnectionHandlerID, clientID);
+			debuglog("\tCommand: GW2Info\n\tClient: %.*s\n\tData: %.*s\n", (int)commandParameters[0].size(), commandParameters[0].data(), (int)commandParameters[1].size(), commandParameters[1].data());
+
+			uint32_t clientID;
+			if (!parseUnsigned(commandParameters[0], &clientID)) {
+				debuglog("\tInvalid client ID\n");
+				break;
+			}
+			Gw2RemoteInfo gw2RemoteInfo = Gw2RemoteInfo(commandParameters[1], serverConnectionHandlerID, (anyID)clientID);
 			gw2RemoteInfoContainer.updateRemoteGW2Info(gw2RemoteInfo);
-			updateInfoPanel();
+			InfoPanel::invalidate(serverConnectionHandlerID);
+			break;
+		}
+		case Commands::CMD_GW2INFOPACKED: {
+			if (command.parameterCount != 2) {
+				debuglog("\tInvalid parameter count: %d\n", command.parameterCount);
+				break;
+			}
+			debuglog("\tCommand: GW2InfoPacked\n\tClient: %.*s\n\tData: %.*s\n", (int)commandParameters[0].size(), commandParameters[0].data(), (int)commandParameters[1].size(), commandParameters[1].data());
+
+			uint32_t clientID;
+			if (!parseUnsigned(commandParameters[0], &clientID)) {
+				debuglog("\tInvalid client ID\n");
+				break;
+			}
+			if (!packedDecoder.decode(commandParameters[1])) {
+				debuglog("\tInvalid or unsupported packed data\n");
+				break;
+			}
+			if (gw2RemoteInfoContainer.updateRemoteGW2Info(serverConnectionHandlerID, (anyID)clientID, packedDecoder)) {
+				InfoPanel::invalidate(serverConnectionHandlerID);
+			} else if (!packedDecoder.isSnapshot() && gw2RemoteInfoContainer.beginGW2InfoRequest(serverConnectionHandlerID, (anyID)clientID, true)) {
+				// We've missed the snapshot or a delta, ask for a new snapshot
+				anyID targetIDs[] = { (anyID)clientID, 0 };
+				Commands::requestGW2Info(serverConnectionHandlerID, PluginCommandTarget_CLIENT, targetIDs);
+			}
 			break;
 		}
 		case Commands::CMD_REQUESTGW2INFO: {
-			if (commandParameters.size() != 1) {
-				debuglog("\tInvalid parameter count: %d\n", commandParameters.size());
+			if (command.parameterCount != 1 && command.parameterCount != 2) {
+				debuglog("\tInvalid parameter count: %d\n", command.parameterCount);
+				break;
+			}
+			debuglog("\tCommand: RequestGW2Info\n\tClient: %.*s\n", (int)commandParameters[0].size(), commandParameters[0].data());
+
+			uint32_t clientID;
+			if (!parseUnsigned(commandParameters[0], &clientID)) {
+				debuglog("\tInvalid client ID\n");
+				break;
+			}
+			if (command.parameterCount < 2 || !Gw2Info::supportsCompact(commandParameters[1].str()))
+				gw2RemoteInfoContainer.markLegacyClient(serverConnectionHandlerID, (anyID)clientID);
+			Commands::replyGW2Info(serverConnectionHandlerID, *localInfo.get(), (anyID)clientID, !gw2RemoteInfoContainer.hasLegacyClients(serverConnectionHandlerID));
+			break;
+		}
+		case Commands::CMD_SYNCGW2INFO: {
+			if (command.parameterCount != 2) {
+				debuglog("\tInvalid parameter count: %d\n", command.parameterCount);
 				break;
 			}
-			debuglog("\tCommand: RequestGW2Info\n\tClient: %s\n", commandParameters.at(0).c_str());
+			debuglog("\tCommand: SyncGW2Info\n\tClient: %.*s\n", (int)commandParameters[0].size(), commandParameters[0].data());
 
-			anyID clientID = (anyID)atoi(commandParameters.at(0).c_str());
-			Commands::sendGW2Info(serverConnectionHandlerID, gw2Info, PluginCommandTarget_CLIENT, &clientID);
+			uint32_t clientID;
+			if (!parseUnsigned(commandParameters[0], &clientID)) {
+				debuglog("\tInvalid client ID\n");
+				break;
+			}
+			size_t clientCount = 0;
+			anyID* clientIDs;
+			if (ts3Functions.getClientList(serverConnectionHandlerID, &clientIDs) == ERROR_ok) {
+				while (clientIDs[clientCount] != 0)
+					clientCount++;
+				ts3Functions.freeMemory(clientIDs);
+			}
+			Commands::replySyncGW2Info(serverConnectionHandlerID, (anyID)clientID, !gw2RemoteInfoContainer.hasLegacyClients(serverConnectionHandlerID), clientCount);
 			break;
 		}
 	}
 }
 
-void updateInfoPanel() {
-	if (infoDataType > 0 && infoDataId > 0) ts3Functions.requestInfoUpdate(ts3Functions.getCurrentServerConnectionHandlerID(), infoDataType, infoDataId);
+/* The text of the info panel, see ts3plugin_infoData; InfoPanel renders it as well to find out whether it has changed */
+void renderInfoData(uint64 serverConnectionHandlerID, PluginItemType type, uint64 id, string& data) {
+	data.clear();
+	try {
+		gw2RemoteInfoContainer.getInfoData(serverConnectionHandlerID, id, type, data);
+	} catch (int e) {
+		debuglog("GW2Plugin: Exception caught while trying to display info data: %d", e);
+		data.clear();
+	}
+}
+
+void onRemoteNamesFetched(bool success) {
+	if (success)
+		InfoPanel::invalidate();
 }
 
 bool checkForUpdates() {
 #ifndef _DEBUG
-	HANDLE hThread = CreateThread(NULL, 0, checkForUpdatesAsync, NULL, 0, NULL);
-	return hThread != 0;
+	return queueUpdateCheck(true, [](Version newVersion, const string& url) {
+		string updateMessage = "[color=blue]Guild Wars 2 plugin version " + newVersion.getVersionString() + " is now available.[/color] " + 
+			"[url=" + url + "]Click here to download.[/url]";
+		MainThread::post([=]() { ts3Functions.printMessageToCurrentTab(updateMessage.c_str()); });
+	});
 #else
 	return false;
 #endif
 }
 
-DWORD WINAPI checkForUpdatesAsync(LPVOID lpParam) {
-	try {
-		// Delay update checks for an hour since last check
-		if (difftime(time(NULL), lastUpdateCheck) >= 3600) {
-			Version newVersion;
-			string url;
-			if (checkForUpdate(true, newVersion, url)) {
-				string updateMessage = "[color=blue]Guild Wars 2 plugin version " + newVersion.getVersionString() + " is now available.[/color] " + 
-					"[url=" + url + "]Click here to download.[/url]";
-				ts3Functions.printMessageToCurrentTab(updateMessage.c_str());
-			}
-			lastUpdateCheck = time(NULL);
+
+void onApiResponse(bool success) {
+	SetEvent(hApiResponseEvent);
+}
+
+/* Every server connection that is fully established, with whether all of its clients understand compact messages */
+void getPublishTargets(vector<Commands::PublishTarget>& targets) {
+	targets.clear();
+	uint64* serverConnectionHandlerIDs;
+	if (ts3Functions.getServerConnectionHandlerList(&serverConnectionHandlerIDs) != ERROR_ok)
+		return;
+
+	for (size_t i = 0; serverConnectionHandlerIDs[i] != 0; i++) {
+		int status;
+		if (ts3Functions.getConnectionStatus(serverConnectionHandlerIDs[i], &status) != ERROR_ok || status != STATUS_CONNECTION_ESTABLISHED)
+			continue;
+		Commands::PublishTarget target;
+		target.serverConnectionHandlerID = serverConnectionHandlerIDs[i];
+		target.compact = !gw2RemoteInfoContainer.hasLegacyClients(serverConnectionHandlerIDs[i]);
+		targets.push_back(target);
+	}
+	ts3Functions.freeMemory(serverConnectionHandlerIDs);
+}
+
+/*
+ * The resolve functions fill in the names and positions that depend on API data, but only with what is cached already,
+ * so the Mumble Link loop never waits on a download. They return false when something is still missing, and, if requested,
+ * queue the download; onApiResponse then wakes up the loop to try again.
+ */
+
+bool resolveMapInfo(Gw2Info* info, bool queueMissing) {
+	Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::MapLookup);
+	Gw2Api::ApiInnerResponseObject<Gw2Api::MapsRootEntry, Gw2Api::MapEntry> map;
+	if (Gw2Api::getCachedMap(info->mapId, &map)) {
+		info->mapName = map.value->map_name;
+		info->regionId = map.value->region_id;
+		info->regionName = map.value->region_name;
+		info->continentId = map.value->continent_id;
+		info->continentName = map.value->continent_name;
+		return true;
+	}
+
+	info->mapName = "Map " + to_string(info->mapId);
+	info->regionId = 0;
+	info->regionName = "Unknown region";
+	info->continentId = 0;
+	info->continentName = "Unknown continent";
+	if (queueMissing)
+		Gw2Api::Async::fetchMap(info->mapId, onApiResponse);
+	return false;
+}
+
+bool resolveWorldName(Gw2Info* info, bool queueMissing) {
+	Gw2Api::WorldNamesRootEntryPtr worldNames;
+	Gw2Api::WorldNameEntries::const_iterator worldName;
+	if (Gw2Api::getCachedWorldNames(&worldNames)) {
+		if ((worldName = worldNames->world_names.find(info->worldId)) != worldNames->world_names.end())
+			info->worldName = worldName->second.name;
+		else
+			info->worldName = "World " + to_string(info->worldId);
+		return true;
+	}
+
+	info->worldName = "World " + to_string(info->worldId);
+	if (queueMissing)
+		Gw2Api::Async::fetchWorldNames(onApiResponse);
+	return false;
+}
+
+bool resolvePosition(Gw2Info* info, const Gw2Api::Vector3D& avatarPosition, bool queueMissing) {
+	// Calculate continent position
+	bool isPending = false;
+	{
+		Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::MapLookup);
+		MapTransform transform;
+		if (getMapTransform(info->mapId, &transform, &isPending, Gw2Api::Async::Callback()))
+			info->characterContinentPosition = transform.toContinentPosition(avatarPosition);
+		else
+			info->characterContinentPosition = Gw2Api::Vector3D(); // Unknown until the map has arrived, not the position on the previous map
+	}
+
+	// Calculate closest waypoint nearby
+	Gw2Api::PointOfInterestEntry waypoint;
+	bool isWaypointPending = false;
+	bool hasWaypoint = false;
+	if (!isPending) {
+		Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::WaypointSearch);
+		hasWaypoint = waypointTracker.update(info->characterContinentPosition, info->mapId, &waypoint, &isWaypointPending,
+			queueMissing ? Gw2Api::Async::Callback(onApiResponse) : Gw2Api::Async::Callback());
+	}
+	if (hasWaypoint) {
+		info->waypointId = waypoint.poi_id;
+		if (!waypoint.name.empty()) {
+			info->waypointName = waypoint.name;
+		} else {
+			info->waypointName = "Waypoint " + to_string(info->waypointId);
 		}
-	} catch (...) {
-		ts3Functions.printMessageToCurrentTab("Error while checking for Guild Wars 2 plugin updates.");
+		info->waypointContinentPosition = waypoint.coord;
+	} else {
+		info->waypointId = 0;
+		info->waypointName = "";
+		info->waypointContinentPosition = Gw2Api::Vector2D();
 	}
-	return 0;
+
+	if (isPending && queueMissing)
+		Gw2Api::Async::fetchMap(info->mapId, onApiResponse);
+	return !isPending && !isWaypointPending;
 }
 
+void printMessageOnMainThread(const string& message) {
+	MainThread::post([=]() { ts3Functions.printMessageToCurrentTab(message.c_str()); });
+}
+
+void applyLinkMode(LinkMode mode, Gw2Api::MumbleLink::Recorder& recorder, Gw2Api::MumbleLink::Replayer& replayer) {
+	string path = getRecordingFilePath();
+	Gw2Api::MumbleLink::setRecorder(NULL);
+	if (!recorder.close())
+		printMessageOnMainThread("Guild Wars 2 plugin: Could not record Mumble Link data to " + path + ", the recording is incomplete");
+	if (replayer.isOpen()) {
+		replayer.close();
+		Gw2Api::MumbleLink::initLink();
+	}
+	waypointTracker.reset(); // A session that starts on the same map must not reuse the waypoint of the previous one
+
+	switch (mode) {
+		case LinkModeLive:
+			printMessageOnMainThread("Guild Wars 2 plugin: Reading live Mumble Link data");
+			break;
+		case LinkModeRecord:
+			if (recorder.open(path)) {
+				Gw2Api::MumbleLink::setRecorder(&recorder);
+				printMessageOnMainThread("Guild Wars 2 plugin: Recording Mumble Link data to " + path);
+			} else {
+				printMessageOnMainThread("Guild Wars 2 plugin: Could not record Mumble Link data to " + path);
+			}
+			break;
+		case LinkModeReplay:
+			if (replayer.open(path)) {
+				Gw2Api::MumbleLink::initLink(replayer.getMemory());
+				printMessageOnMainThread("Guild Wars 2 plugin: Replaying Mumble Link data from " + path);
+			} else {
+				printMessageOnMainThread("Guild Wars 2 plugin: Could not replay Mumble Link data from " + path);
+			}
+			break;
+	}
+}
 
 DWORD WINAPI mumbleLinkCheckLoop(LPVOID lpParam) {
 	Gw2Api::MumbleLink::initLink();
 	debuglog("GW2Plugin: Mumble Link created\n");
 
-	time_t lastMumbleLinkUpdate = 0;
-	time_t lastTransmissionTime = 0;
-	time_t lastOffline = 0;
+	// Performance counter values, the thresholds they are compared against are in milliseconds
+	LONGLONG lastTransmissionTime = 0;
+	LONGLONG lastOffline = 0;
 
+	// Only this thread works on it, the callbacks get a copy whenever it's published
+	Gw2Info gw2Info;
 	bool linked = false;
 	bool prevIsOnline = false;
 	Gw2Api::MumbleLink::MumbleIdentity prevIdentity;
 	Gw2Api::Vector3D prevAvatarPosition;
 	Gw2Api::Vector2D prevDistancePosition;
 
-	while (!threadStopRequested) {
+	// Parts of gw2Info that still wait for API data
+	bool mapInfoPending = false;
+	bool worldNamePending = false;
+	bool positionPending = false;
+
+	vector<Commands::PublishTarget> publishTargets;
+
+	// Receivers that support it extrapolate the last sent position with the sent velocity,
+	// so while everyone does, a position is only sent once it deviates from that prediction
+	bool predicting = false;
+	VelocityEstimator avatarVelocity;
+	VelocityEstimator continentVelocity;
+	Gw2Api::Vector2D sentAvatarPosition;
+	Gw2Api::Vector2D sentAvatarVelocity;
+	ULONGLONG sentTime = 0;
+
+	Gw2Api::MumbleLink::Recorder recorder;
+	Gw2Api::MumbleLink::Replayer replayer;
+	ULONGLONG replayStart = 0;
+	bool replayFinished = false;
+
+	// Watched while Guild Wars 2 is in-game, so its exit is noticed right away instead of after onlineStateTransmissionThreshold
+	ProcessMonitor processMonitor;
+
+	HANDLE waitHandles[] = { hThreadStopEvent, hApiResponseEvent, NULL };
+	DWORD waitTime = 0;
+	DWORD waitResult;
+	while ((waitResult = WaitForMultipleObjects(processMonitor.isWatching() ? 3 : 2, waitHandles, FALSE, waitTime)) != WAIT_OBJECT_0) {
+		if (waitResult == WAIT_FAILED) {
+			debuglog("GW2Plugin: Waiting in the Mumble Link loop has failed: %d\n", GetLastError());
+			break;
+		}
+		bool apiResponded = waitResult == WAIT_OBJECT_0 + 1;
+		bool processExited = waitResult == WAIT_OBJECT_0 + 2;
+		LONGLONG loopTime = Gw2Api::Metrics::now();
+		Gw2Api::Metrics::add(Gw2Api::Metrics::MumbleLinkIterations);
+
+		LONG linkMode = InterlockedExchange(&linkModeRequest, LinkModeNone);
+		if (linkMode != LinkModeNone) {
+			applyLinkMode((LinkMode)linkMode, recorder, replayer);
+			processMonitor.stop();
+			replayStart = GetTickCount64();
+			replayFinished = false;
+			tickScheduler.reset();
+		} else if (recorder.hasFailed()) {
+			// The recorder has closed itself, report it and go on with live data
+			applyLinkMode(LinkModeLive, recorder, replayer);
+		}
+		if (replayer.isOpen()) {
+			// Frames are served at the pace they have been recorded at, the last one is kept for one more iteration
+			if (replayFinished) {
+				applyLinkMode(LinkModeLive, recorder, replayer);
+			} else {
+				replayFinished = !replayer.advance(GetTickCount64() - replayStart);
+			}
+		}
+
 		// Check if Guild Wars 2 is active through Mumble Link (it only gets updated when IN-game, so not in character screen, loading screens, etc.)
-		bool newIsOnline = Gw2Api::MumbleLink::isActive() && Gw2Api::MumbleLink::isGW2();
+		bool newIsOnline;
+		{
+			Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::MumbleRead);
+			newIsOnline = Gw2Api::MumbleLink::isActive() && Gw2Api::MumbleLink::isGW2();
+		}
+		if (processExited) {
+			debuglog("GW2Plugin: Guild Wars 2 has exited\n");
+			processMonitor.stop();
+			newIsOnline = false;
+		} else if (newIsOnline && !replayer.isOpen()) {
+			// Only done while uiTick advances, so the id belongs to a running Guild Wars 2 instead of a stale link;
+			// replayed data comes from a process that is long gone
+			processMonitor.watch(Gw2Api::MumbleLink::getProcessId());
+		}
+		waitHandles[2] = processMonitor.getHandle();
 		bool updated = false;
+		bool changed = false;
 		
 		if (newIsOnline) {
-			if (!prevIsOnline && difftime(time(NULL), lastOffline) >= Globals::onlineStateTransmissionThreshold) {
+			if (!prevIsOnline && Gw2Api::Metrics::elapsedMilliseconds(lastOffline, loopTime) >= Globals::onlineStateTransmissionThreshold) {
 				debuglog("GW2Plugin: Guild Wars 2 linked\n");
 				linked = true;
+				tickScheduler.reset();
+				Prefetcher::onLinked(onApiResponse);
 			}
 
 			lastOffline = 0; // Reset last offline time
-			Gw2Api::MumbleLink::MumbleIdentity newIdentity = Gw2Api::MumbleLink::getIdentity();
-			Gw2Api::Vector3D newAvatarPosition = Gw2Api::MumbleLink::getAvatarPosition();
+			Gw2Api::MumbleLink::MumbleIdentity newIdentity;
+			{
+				Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::IdentityDecode);
+				newIdentity = Gw2Api::MumbleLink::getIdentity();
+			}
+			Gw2Api::Vector3D newAvatarPosition;
+			{
+				Gw2Api::Metrics::ScopedTimer timer(Gw2Api::Metrics::MumbleRead);
+				newAvatarPosition = Gw2Api::MumbleLink::getAvatarPosition();
+			}
+			bool mapChanged = newIdentity.map_id != prevIdentity.map_id;
 
 			if (newIdentity != prevIdentity) {
 				// New identity from Mumble Link -> update
 				debuglog("GW2Plugin: New Guild Wars 2 identity\n");
+				changed = true;
 				gw2Info.characterName = newIdentity.name;
 				gw2Info.profession = newIdentity.profession;
 				gw2Info.mapId = newIdentity.map_id;
@@ -426,100 +885,134 @@ DWORD WINAPI mumbleLinkCheckLoop(LPVOID lpParam) {
 				gw2Info.teamColorId = newIdentity.team_color_id;
 				gw2Info.commander = newIdentity.commander;
 
-				// Get relevant names of the map, region and continent here, since getting it asynchronously upon receiving a command
-				// and requesting a right panel update seems to crash TS3 with an access violation
-				// TODO: This needs further investigation, because although getting relevant info here is a nice workaround,
-				//       it is not ideal (too much transfer data overhead)
-				Gw2Api::ApiInnerResponseObject<Gw2Api::MapsRootEntry, Gw2Api::MapEntry> map;
-				if (Gw2Api::getMap(gw2Info.mapId, &map)) {
-					gw2Info.mapName = map.value.map_name;
-					gw2Info.regionId = map.value.region_id;
-					gw2Info.regionName = map.value.region_name;
-					gw2Info.continentId = map.value.continent_id;
-					gw2Info.continentName = map.value.continent_name;
-				} else {
-					gw2Info.mapName = "Map " + to_string(gw2Info.mapId);
-					gw2Info.regionId = 0;
-					gw2Info.regionName = "Unknown region";
-					gw2Info.continentId = 0;
-					gw2Info.continentName = "Unknown continent";
-				}
+				if (mapChanged)
+					Prefetcher::onMapChanged(newIdentity.map_id, onApiResponse);
 
-				// Same comments + TODO as the previous code block: getting the world name here is not ideal
-				Gw2Api::WorldNamesRootEntry worldNames;
-				if (Gw2Api::getWorldNames(&worldNames) && worldNames.world_names.find(gw2Info.worldId) != worldNames.world_names.end()) {
-					gw2Info.worldName = worldNames.world_names[gw2Info.worldId].name;
-				} else {
-					gw2Info.worldName = "World " + to_string(gw2Info.worldId);
-				}
+				// The identity is sent right away with placeholder names if the API data isn't cached yet,
+				// the real names follow as soon as the downloads have finished
+				mapInfoPending = !resolveMapInfo(&gw2Info, true);
+				worldNamePending = !resolveWorldName(&gw2Info, true);
 
-				if (difftime(time(NULL), lastTransmissionTime) >= Globals::locationTransmissionThreshold) {
+				if (Gw2Api::Metrics::elapsedMilliseconds(lastTransmissionTime, loopTime) >= Globals::locationTransmissionThreshold) {
 					// Update timeout threshold exceeded -> update
 					updated = true;
 				}
 			}
 
-			if (newAvatarPosition != prevAvatarPosition) {
+			bool moved = newAvatarPosition != prevAvatarPosition || mapChanged;
+			if (moved) {
 				// New position from Mumble Link -> update
 				debuglog("GW2Plugin: New Guild Wars 2 position\n");
-
-				// Calculate continent position
-				Gw2Api::ApiInnerResponseObject<Gw2Api::MapsRootEntry, Gw2Api::MapEntry> map;
-				if (Gw2Api::getMap(gw2Info.mapId, &map)) {
-					Gw2Api::Gw2Position position = Gw2Api::Gw2Position(newAvatarPosition, Gw2Api::Gw2Position::Mumble,
-						gw2Info.mapId, map.value.map_rect, map.value.continent_rect).toContinentPosition();
-					gw2Info.characterContinentPosition = position.position;
-				}
-
-				// Calculate closest waypoint nearby
-				// Same comments + TODO as a couple of code blocks back: getting the waypoint name here is not ideal
-				Gw2Api::PointOfInterestEntry waypoint;
-				if (getClosestWaypoint(gw2Info.characterContinentPosition, gw2Info.mapId, &waypoint)) {
-					gw2Info.waypointId = waypoint.poi_id;
-					if (!waypoint.name.empty()) {
-						gw2Info.waypointName = waypoint.name;
-					} else {
-						gw2Info.waypointName = "Waypoint " + to_string(gw2Info.waypointId);
-					}
-					gw2Info.waypointContinentPosition = waypoint.coord;
-				} else {
-					gw2Info.waypointId = 0;
-					gw2Info.waypointName = "";
-					gw2Info.waypointContinentPosition = Gw2Api::Vector2D();
+				changed = true;
+				uint32_t prevWaypointId = gw2Info.waypointId;
+				positionPending = !resolvePosition(&gw2Info, newAvatarPosition, true);
+				if (gw2Info.waypointId != prevWaypointId &&
+					Gw2Api::Metrics::elapsedMilliseconds(lastTransmissionTime, loopTime) >= Globals::locationTransmissionThreshold) {
+					// Another waypoint is the closest one now -> update
+					updated = true;
 				}
+			}
 
-				if (difftime(time(NULL), lastTransmissionTime) >= Globals::locationTransmissionThreshold &&
-					newAvatarPosition.toVector2D().getDistance(prevDistancePosition) >= Globals::distanceTransmissionThreshold) {
+			ULONGLONG now = GetTickCount64();
+			if (mapChanged) {
+				avatarVelocity.reset();
+				continentVelocity.reset();
+			}
+			avatarVelocity.addSample(newAvatarPosition.toVector2D(), now);
+			if (gw2Info.characterContinentPosition != Gw2Api::Vector3D())
+				continentVelocity.addSample(gw2Info.characterContinentPosition.toVector2D(), now);
+			else
+				continentVelocity.reset();
+
+			// Standing still after moving is a deviation from the prediction as well
+			if (moved || (predicting && sentAvatarVelocity != Gw2Api::Vector2D())) {
+				Gw2Api::Vector2D expectedPosition = predicting ? DeadReckoning::predict(sentAvatarPosition, sentAvatarVelocity, now - sentTime) : prevDistancePosition;
+				if (Gw2Api::Metrics::elapsedMilliseconds(lastTransmissionTime, loopTime) >= Globals::locationTransmissionThreshold &&
+					newAvatarPosition.toVector2D().getDistance(expectedPosition) >= Globals::distanceTransmissionThreshold) {
 					// Update timeout and distance threshold exceeded -> update
 					prevDistancePosition = newAvatarPosition.toVector2D();
 					updated = true;
 				}
 			}
 
+			if (apiResponded && (mapInfoPending || worldNamePending || positionPending)) {
+				// Some API data has arrived; failed downloads are not queued again until the identity or position changes
+				bool resolved = false;
+				if (mapInfoPending && resolveMapInfo(&gw2Info, false)) {
+					mapInfoPending = false;
+					resolved = true;
+				}
+				if (worldNamePending && resolveWorldName(&gw2Info, false)) {
+					worldNamePending = false;
+					resolved = true;
+				}
+				if (positionPending) {
+					waypointTracker.reset();
+					positionPending = !resolvePosition(&gw2Info, newAvatarPosition, false);
+					resolved = true; // A partial result (e.g. only some floors) can still change the closest waypoint
+				}
+				if (resolved) {
+					debuglog("GW2Plugin: Resolved Guild Wars 2 info from the API\n");
+					updated = true;
+				}
+			}
+
+			if (updated)
+				gw2Info.characterContinentVelocity = continentVelocity.getVelocity();
 			prevIdentity = newIdentity;
 			prevAvatarPosition = newAvatarPosition;
 		} else {
 			if (prevIsOnline) {
-				lastOffline = time(NULL); // Remember "offline" time (timeout just to eleminate possible framerate lag, short loading screens, etc.)
-				// TODO: Check whether the Guild Wars 2 process is still active or not in order to get more accurate online/offline information
+				lastOffline = loopTime; // Remember "offline" time (timeout just to eleminate possible framerate lag, short loading screens, etc.)
 			}
 
-			if (linked && difftime(time(NULL), lastOffline) >= Globals::onlineStateTransmissionThreshold) {
-				// Offline threshold exceeded -> update
+			// A loading screen looks just like an exit to Mumble Link, but an exit of the watched process is certain
+			if (linked && (processExited || Gw2Api::Metrics::elapsedMilliseconds(lastOffline, loopTime) >= Globals::onlineStateTransmissionThreshold)) {
+				// Offline threshold exceeded or Guild Wars 2 has exited -> update
 				debuglog("GW2Plugin: Guild Wars 2 unlinked\n");
 				linked = false;
 				gw2Info.clear();
+				waypointTracker.reset();
+				mapInfoPending = worldNamePending = positionPending = false;
 				updated = true;
 			}
+			if (processExited)
+				lastOffline = 0; // Nothing to smooth over, a restarted Guild Wars 2 is linked as soon as it's in-game
 		}
 		prevIsOnline = newIsOnline;
 
+		if (InterlockedExchange(&serverConnectionsChanged, 0) != 0 && linked) {
+			// New connections get a snapshot, the others are skipped because nothing has changed for them
+			updated = true;
+		}
+
 		if (updated) {
-			lastTransmissionTime = time(NULL);
-			Commands::sendGW2Info(ts3Functions.getCurrentServerConnectionHandlerID(), gw2Info, PluginCommandTarget_SERVER, NULL);
+			lastTransmissionTime = Gw2Api::Metrics::now();
+			// Everything is computed once and published to every connected server, not only the active tab
+			localInfo.publish(gw2Info);
+			getPublishTargets(publishTargets);
+			Commands::publishGW2Info(publishTargets, gw2Info);
+
+			sentAvatarPosition = prevAvatarPosition.toVector2D();
+			sentAvatarVelocity = newIsOnline ? avatarVelocity.getVelocity() : Gw2Api::Vector2D();
+			sentTime = GetTickCount64();
+			predicting = !publishTargets.empty();
+			for (size_t i = 0; i < publishTargets.size(); i++)
+				predicting = predicting && publishTargets[i].compact;
 		}
 
-		Sleep(50); // Wait a bit so we are not uselessly looping when Guild Wars 2 hasn't updated Mumble Link yet (it updates once per frame)
+		// Wait a bit so we are not uselessly looping when Guild Wars 2 hasn't updated Mumble Link yet (it updates once per frame),
+		// and back off further when nothing is going on; intervals are re-applied every time to pick up changes from the config dialog
+		TickScheduler::Activity activity;
+		if (newIsOnline)
+			activity = changed ? TickScheduler::Changing : TickScheduler::Steady;
+		else
+			activity = linked ? TickScheduler::Stalled : TickScheduler::Unlinked;
+		tickScheduler.setIntervals(Globals::mumbleLinkMinPollInterval, Globals::mumbleLinkSteadyPollInterval, Globals::mumbleLinkMaxPollInterval);
+		waitTime = tickScheduler.next(activity);
 	}
+	Gw2Api::MumbleLink::setRecorder(NULL);
+	Gw2Api::MumbleLink::closeLink();
+	Gw2Api::JsonArena::releaseThread();
 	return 0;
 }
@@ -0,0 +1,66 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <algorithm>
+#include <vector>
+#include "prefetcher.h"
+using namespace Gw2Api;
+
+namespace Prefetcher {
+
+	namespace {
+
+		// Queues all missing floors at once, so they are downloaded and parsed by as many workers as the concurrency limit allows.
+		// The default floor goes first, it's the one that most likely has the closest waypoint.
+		void fetchFloors(const MapEntry& map, const Async::Callback& onFetched) {
+			std::vector<int> floors = map.floors;
+			std::vector<int>::iterator defaultFloor = std::find(floors.begin(), floors.end(), map.default_floor);
+			if (defaultFloor != floors.end())
+				std::rotate(floors.begin(), defaultFloor, defaultFloor + 1);
+
+			for (unsigned i = 0; i < floors.size(); i++) {
+				MapFloorRootEntryPtr mapFloorRoot;
+				if (!getCachedMapFloor(map.continent_id, floors[i], &mapFloorRoot))
+					Async::fetchMapFloor(map.continent_id, floors[i], onFetched);
+			}
+		}
+
+	}
+
+
+	void onLinked(const Async::Callback& onFetched) {
+		MapsRootEntryPtr mapsRootEntry;
+		if (!getCachedMaps(&mapsRootEntry))
+			Async::fetchMaps(onFetched);
+	}
+
+	void onMapChanged(int map_id, const Async::Callback& onFetched) {
+		if (map_id <= 0)
+			return;
+
+		ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
+		if (getCachedMap(map_id, &map)) {
+			fetchFloors(*map.value, onFetched);
+			return;
+		}
+
+		// Callbacks run on the worker thread, queueing more work from there is fine
+		Async::fetchMap(map_id, [=](bool success) {
+			ApiInnerResponseObject<MapsRootEntry, MapEntry> fetchedMap;
+			if (success && getCachedMap(map_id, &fetchedMap))
+				fetchFloors(*fetchedMap.value, onFetched);
+			if (onFetched)
+				onFetched(success);
+		});
+	}
+
+}
@@ -0,0 +1,29 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include "gw2api/gw2api.h"
+
+/*
+ * Downloads the API data the plugin is going to need before it is asked for, so waypoints can be resolved
+ * from the cache right after a loading screen instead of waiting for a couple of round trips.
+ * Everything is queued on the Gw2Api::Async workers; onFetched is called for every finished download (unless it's empty).
+ */
+namespace Prefetcher {
+
+	/* Loads the bulk maps.json once, which makes the per-map requests unnecessary */
+	void onLinked(const Gw2Api::Async::Callback& onFetched);
+
+	/* Loads all map floors of the new map concurrently, fetching the map itself first if it isn't known yet */
+	void onMapChanged(int map_id, const Gw2Api::Async::Callback& onFetched);
+
+}
@@ -0,0 +1,39 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include "processmonitor.h"
+
+bool ProcessMonitor::watch(DWORD processId) {
+	if (processId == 0)
+		return isWatching();
+	if (processId == this->processId || processId == failedProcessId)
+		return isWatching();
+
+	stop();
+	// Waiting on it is all that's needed, so only ask for that
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, processId);
+	if (process == NULL) {
+		failedProcessId = processId;
+		return false;
+	}
+	this->processId = processId;
+	handle = process;
+	failedProcessId = 0;
+	return true;
+}
+
+void ProcessMonitor::stop() {
+	if (handle != NULL)
+		CloseHandle(handle);
+	handle = NULL;
+	processId = 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <Windows.h>
+
+/*
+ * Holds a handle to the Guild Wars 2 process, which gets signalled as soon as the process exits.
+ * The Mumble Link loop waits on it next to its events, so an exit doesn't have to be guessed from uiTick standing still.
+ */
+class ProcessMonitor {
+
+private:
+	DWORD processId;
+	HANDLE handle;
+	DWORD failedProcessId; // Isn't opened again on every wake-up
+
+	ProcessMonitor(const ProcessMonitor&);
+	ProcessMonitor& operator=(const ProcessMonitor&);
+
+public:
+	ProcessMonitor() : processId(0), handle(NULL), failedProcessId(0) { }
+	~ProcessMonitor() { stop(); }
+
+	/* Starts watching the given process, unless it's already watched; returns false if nothing is watched afterwards */
+	bool watch(DWORD processId);
+	void stop();
+
+	/* Signalled once the watched process has exited, NULL while nothing is watched */
+	HANDLE getHandle() const { return handle; }
+	DWORD getProcessId() const { return processId; }
+	bool isWatching() const { return handle != NULL; }
+
+};
@@ -0,0 +1,163 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include "proximityindex.h"
+using namespace std;
+using namespace Gw2Api;
+
+ProximityIndex::ProximityIndex(double cellSize) : cellSize(cellSize) { }
+
+int ProximityIndex::getCell(double coordinate) const {
+	return (int)floor(coordinate / cellSize);
+}
+
+void ProximityIndex::update(uint64 serverConnectionHandlerID, anyID clientID, int mapId, const Vector2D& position) {
+	uint64 clientKey = makeClientKey(serverConnectionHandlerID, clientID);
+	uint64 gridKey = makeGridKey(serverConnectionHandlerID, mapId);
+	int x = getCell(position.x);
+	int y = getCell(position.y);
+	uint64 cellKey = makeCellKey(x, y);
+
+	LocationMap::iterator location = locations.find(clientKey);
+	if (location != locations.end()) {
+		if (location->second.gridKey == gridKey && location->second.cellKey == cellKey) {
+			location->second.position = position; // Moved within its cell, which is what most updates do
+			return;
+		}
+		removeLocation(location);
+	}
+
+	Grid& grid = grids[gridKey];
+	if (grid.clientCount == 0) {
+		grid.minX = grid.maxX = x;
+		grid.minY = grid.maxY = y;
+	} else {
+		grid.minX = min(grid.minX, x);
+		grid.maxX = max(grid.maxX, x);
+		grid.minY = min(grid.minY, y);
+		grid.maxY = max(grid.maxY, y);
+	}
+	grid.cells[cellKey].push_back(clientID);
+	grid.clientCount++;
+
+	Location& newLocation = locations[clientKey];
+	newLocation.gridKey = gridKey;
+	newLocation.cellKey = cellKey;
+	newLocation.position = position;
+}
+
+void ProximityIndex::removeLocation(LocationMap::iterator location) {
+	GridMap::iterator grid = grids.find(location->second.gridKey);
+	if (grid != grids.end()) {
+		CellMap::iterator cell = grid->second.cells.find(location->second.cellKey);
+		if (cell != grid->second.cells.end()) {
+			anyID clientID = (anyID)(location->first & 0xFFFF);
+			vector<anyID>& clientIDs = cell->second;
+			vector<anyID>::iterator it = find(clientIDs.begin(), clientIDs.end(), clientID);
+			if (it != clientIDs.end()) {
+				*it = clientIDs.back();
+				clientIDs.pop_back();
+				grid->second.clientCount--;
+			}
+			if (clientIDs.empty())
+				grid->second.cells.erase(cell);
+		}
+		if (grid->second.clientCount == 0)
+			grids.erase(grid);
+	}
+	locations.erase(location);
+}
+
+void ProximityIndex::remove(uint64 serverConnectionHandlerID, anyID clientID) {
+	LocationMap::iterator location = locations.find(makeClientKey(serverConnectionHandlerID, clientID));
+	if (location != locations.end())
+		removeLocation(location);
+}
+
+void ProximityIndex::removeServer(uint64 serverConnectionHandlerID) {
+	for (LocationMap::iterator it = locations.begin(); it != locations.end();) {
+		if ((it->first >> 16) == serverConnectionHandlerID)
+			it = locations.erase(it);
+		else
+			it++;
+	}
+	for (GridMap::iterator it = grids.begin(); it != grids.end();) {
+		if ((it->first >> 32) == serverConnectionHandlerID)
+			it = grids.erase(it);
+		else
+			it++;
+	}
+}
+
+size_t ProximityIndex::getClientCount(uint64 serverConnectionHandlerID, int mapId) const {
+	GridMap::const_iterator grid = grids.find(makeGridKey(serverConnectionHandlerID, mapId));
+	return grid != grids.end() ? grid->second.clientCount : 0;
+}
+
+static bool isCloser(const ProximityIndex::Neighbour& a, const ProximityIndex::Neighbour& b) {
+	return a.distance < b.distance;
+}
+
+void ProximityIndex::findNearest(uint64 serverConnectionHandlerID, int mapId, const Vector2D& position, size_t maxCount, anyID excludeClientID,
+	vector<Neighbour>& result) const {
+	result.clear();
+	GridMap::const_iterator gridIt = grids.find(makeGridKey(serverConnectionHandlerID, mapId));
+	if (gridIt == grids.end() || maxCount == 0)
+		return;
+	const Grid& grid = gridIt->second;
+
+	int centerX = getCell(position.x);
+	int centerY = getCell(position.y);
+	// Once the rings are past every occupied cell, there is nothing left to find
+	int lastRing = max(max(centerX - grid.minX, grid.maxX - centerX), max(centerY - grid.minY, grid.maxY - centerY));
+	for (int ring = 0; ring <= lastRing; ring++) {
+		for (int x = centerX - ring; x <= centerX + ring; x++) {
+			// Only the outline of the square, the inside has been visited by the previous rings
+			int step = (x == centerX - ring || x == centerX + ring) ? 1 : max(2 * ring, 1);
+			for (int y = centerY - ring; y <= centerY + ring; y += step) {
+				if (x < grid.minX || x > grid.maxX || y < grid.minY || y > grid.maxY)
+					continue;
+				CellMap::const_iterator cell = grid.cells.find(makeCellKey(x, y));
+				if (cell == grid.cells.end())
+					continue;
+				for (size_t i = 0; i < cell->second.size(); i++) {
+					anyID clientID = cell->second[i];
+					if (clientID == excludeClientID)
+						continue;
+					LocationMap::const_iterator location = locations.find(makeClientKey(serverConnectionHandlerID, clientID));
+					if (location == locations.end())
+						continue;
+					double dx = location->second.position.x - position.x;
+					double dy = location->second.position.y - position.y;
+					Neighbour neighbour;
+					neighbour.clientID = clientID;
+					neighbour.distance = sqrt(dx * dx + dy * dy);
+					result.push_back(neighbour);
+				}
+			}
+		}
+
+		// Everything in the next rings is at least this far away, so the closest ones can't change anymore
+		if (result.size() >= maxCount) {
+			nth_element(result.begin(), result.begin() + (maxCount - 1), result.end(), isCloser);
+			if (result[maxCount - 1].distance <= ring * cellSize)
+				break;
+		}
+	}
+
+	sort(result.begin(), result.end(), isCloser);
+	if (result.size() > maxCount)
+		result.resize(maxCount);
+}
@@ -0,0 +1,78 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "public_definitions.h"
+#include "gw2api/math.h"
+
+/*
+ * Finds the clients closest to a position on the same map, without looking at every client of the server connection.
+ * Clients are grouped by server connection and map, and every group is a uniform grid over the continent positions;
+ * searches visit the cells in rings around the position until no unvisited cell can hold a closer client.
+ * Not thread-safe, Gw2RemoteInfoContainer keeps it under its lock.
+ */
+class ProximityIndex {
+
+public:
+	struct Neighbour {
+		anyID clientID;
+		double distance; // In continent units
+	};
+
+	/* cellSize is in continent units; a map is a few thousand units wide */
+	explicit ProximityIndex(double cellSize = 256);
+
+	/* Adds the client or moves it to its new map and position */
+	void update(uint64 serverConnectionHandlerID, anyID clientID, int mapId, const Gw2Api::Vector2D& position);
+	void remove(uint64 serverConnectionHandlerID, anyID clientID);
+	void removeServer(uint64 serverConnectionHandlerID);
+
+	size_t getClientCount(uint64 serverConnectionHandlerID, int mapId) const;
+	/* Replaces result with up to maxCount clients on mapId, closest to position first; excludeClientID (0 for none) is left out */
+	void findNearest(uint64 serverConnectionHandlerID, int mapId, const Gw2Api::Vector2D& position, size_t maxCount, anyID excludeClientID,
+		std::vector<Neighbour>& result) const;
+
+private:
+	typedef std::unordered_map<uint64, std::vector<anyID>> CellMap;
+
+	struct Grid {
+		Grid() : clientCount(0), minX(0), maxX(0), minY(0), maxY(0) { }
+
+		CellMap cells; // By makeCellKey
+		size_t clientCount;
+		int minX, maxX, minY, maxY; // Cells that have been occupied so far; only grows until the grid is empty
+	};
+	typedef std::unordered_map<uint64, Grid> GridMap;
+
+	struct Location {
+		uint64 gridKey;
+		uint64 cellKey;
+		Gw2Api::Vector2D position;
+	};
+	typedef std::unordered_map<uint64, Location> LocationMap;
+
+	double cellSize;
+	GridMap grids; // By makeGridKey
+	LocationMap locations; // By makeClientKey
+
+	static uint64 makeClientKey(uint64 serverConnectionHandlerID, anyID clientID) { return (serverConnectionHandlerID << 16) | clientID; }
+	static uint64 makeGridKey(uint64 serverConnectionHandlerID, int mapId) { return (serverConnectionHandlerID << 32) | (uint32_t)mapId; }
+	static uint64 makeCellKey(int x, int y) { return ((uint64)(uint32_t)x << 32) | (uint32_t)y; }
+	int getCell(double coordinate) const;
+
+	void removeLocation(LocationMap::iterator location);
+
+};
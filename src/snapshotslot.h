@@ -0,0 +1,57 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+
+#pragma once
+#include <memory>
+#include <stdint.h>
+#include <Windows.h>
+
+/*
+ * Hands immutable snapshots of a value from the thread that produces it to the threads that read it.
+ * Publishing copies the value and swaps the pointer, and readers keep the snapshot they got for as long as they need it,
+ * so the lock is only held for the pointer copy and a reader never sees a half-updated value.
+ */
+template<typename T>
+class SnapshotSlot {
+public:
+	SnapshotSlot() : current(new T()), version(0) { InitializeSRWLock(&lock); }
+
+	std::shared_ptr<const T> get() const {
+		AcquireSRWLockShared(&lock);
+		std::shared_ptr<const T> snapshot = current;
+		ReleaseSRWLockShared(&lock);
+		return snapshot;
+	}
+
+	/* Returns the version of the new snapshot, the first published one is 1 */
+	uint32_t publish(const T& value) {
+		std::shared_ptr<const T> snapshot(new T(value));
+		AcquireSRWLockExclusive(&lock);
+		current.swap(snapshot);
+		uint32_t newVersion = ++version;
+		ReleaseSRWLockExclusive(&lock);
+		return newVersion; // The previous snapshot is released here, outside of the lock, unless a reader still holds it
+	}
+
+	uint32_t getVersion() const {
+		AcquireSRWLockShared(&lock);
+		uint32_t currentVersion = version;
+		ReleaseSRWLockShared(&lock);
+		return currentVersion;
+	}
+
+private:
+	mutable SRWLOCK lock;
+	std::shared_ptr<const T> current;
+	uint32_t version;
+};
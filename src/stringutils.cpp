@@ -34,6 +34,38 @@ void split(const string &s, char delim, size_t limit, vector<string> &elems) {
 	}
 }
 
+size_t split(const StringRef& s, char delim, StringRef* parts, size_t maxParts) {
+	const char* current = s.data();
+	const char* end = s.data() + s.size();
+	size_t count = 0;
+	while (current < end && count < maxParts) {
+		const char* delimiter = count + 1 < maxParts ? (const char*)memchr(current, delim, end - current) : NULL;
+		if (delimiter == NULL) {
+			parts[count++] = StringRef(current, end - current);
+			break;
+		}
+		parts[count++] = StringRef(current, delimiter - current);
+		current = delimiter + 1;
+	}
+	return count;
+}
+
+bool parseUnsigned(const StringRef& s, uint32_t* value) {
+	if (s.empty() || s.size() > 10)
+		return false;
+	uint64_t result = 0;
+	for (size_t i = 0; i < s.size(); i++) {
+		char c = s.data()[i];
+		if (c < '0' || c > '9')
+			return false;
+		result = result * 10 + (c - '0');
+	}
+	if (result > 0xFFFFFFFF)
+		return false;
+	*value = (uint32_t)result;
+	return true;
+}
+
 void split(const string &s, char delim, vector<string> &elems) {
 	split(s, delim, 0, elems);
 }
@@ -13,8 +13,33 @@
 #pragma once
 #include <string>
 #include <stdint.h>
+#include <string.h>
 #include <vector>
 
+/* A view on (a part of) a string that is owned elsewhere, so it can be split and compared without copying */
+class StringRef {
+public:
+	StringRef() : ptr(""), length(0) { }
+	StringRef(const char* ptr, size_t length) : ptr(ptr), length(length) { }
+	StringRef(const std::string& str) : ptr(str.c_str()), length(str.size()) { }
+
+	const char* data() const { return ptr; }
+	size_t size() const { return length; }
+	bool empty() const { return length == 0; }
+	std::string str() const { return std::string(ptr, length); }
+
+	bool equals(const char* str, size_t strLength) const { return length == strLength && memcmp(ptr, str, length) == 0; }
+
+private:
+	const char* ptr;
+	size_t length;
+};
+
+/* Like split below, but the parts point into s; returns the number of parts, of which the last one holds the rest of s */
+size_t split(const StringRef& s, char delim, StringRef* parts, size_t maxParts);
+/* Parses a decimal number without sign; false if s is empty, contains anything else or doesn't fit */
+bool parseUnsigned(const StringRef& s, uint32_t* value);
+
 void split(const std::string &s, char delim, size_t limit, std::vector<std::string> &elems);
 void split(const std::string &s, char delim, std::vector<std::string> &elems);
 std::vector<std::string> split(const std::string &s, char delim, int limit);
@@ -0,0 +1,79 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <string.h>
+#include "globals.h"
+#include "tickscheduler.h"
+
+TickScheduler::TickScheduler() {
+	memset(&stats, 0, sizeof(stats));
+	interval = 0;
+	setIntervals(DEFAULTCONFIG_MUMBLELINKMINPOLLINTERVAL, DEFAULTCONFIG_MUMBLELINKSTEADYPOLLINTERVAL, DEFAULTCONFIG_MUMBLELINKMAXPOLLINTERVAL);
+}
+
+void TickScheduler::setIntervals(DWORD minInterval, DWORD steadyInterval, DWORD maxInterval) {
+	if (minInterval < 1)
+		minInterval = 1;
+	if (steadyInterval < minInterval)
+		steadyInterval = minInterval;
+	if (maxInterval < steadyInterval)
+		maxInterval = steadyInterval;
+
+	this->minInterval = minInterval;
+	this->steadyInterval = steadyInterval;
+	this->maxInterval = maxInterval;
+	if (interval < minInterval)
+		interval = minInterval;
+	else if (interval > maxInterval)
+		interval = maxInterval;
+}
+
+DWORD TickScheduler::next(Activity activity) {
+	stats.wakeUps++;
+
+	switch (activity) {
+		case Unlinked:
+			// Nothing to do until the game starts, back off sharply
+			stats.unlinkedWakeUps++;
+			interval = interval * 2 > maxInterval ? maxInterval : interval * 2;
+			break;
+
+		case Stalled:
+			// Loading screens take a couple of seconds, back off a bit slower so we pick up the new map quickly
+			stats.stalledWakeUps++;
+			interval = interval + interval / 2 + 1 > maxInterval ? maxInterval : interval + interval / 2 + 1;
+			break;
+
+		case Steady:
+			// The game is running, but the player is standing still: converge to the steady interval
+			stats.steadyWakeUps++;
+			if (interval < steadyInterval)
+				interval = interval * 2 > steadyInterval ? steadyInterval : interval * 2;
+			else
+				interval = steadyInterval;
+			break;
+
+		case Changing:
+			// The player is moving, keep up with it
+			stats.changingWakeUps++;
+			interval = minInterval;
+			break;
+	}
+
+	return interval;
+}
+
+TickScheduler::Statistics TickScheduler::getStatistics() const {
+	Statistics result = stats;
+	result.currentInterval = interval;
+	return result;
+}
@@ -0,0 +1,58 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <Windows.h>
+
+/* Decides how long the Mumble Link loop may sleep before it checks LinkedMem::uiTick again */
+class TickScheduler {
+
+public:
+	enum Activity {
+		Unlinked, // Guild Wars 2 is not running or not linked
+		Stalled, // Linked, but uiTick has not advanced (loading screen, character select, alt-tab, ...)
+		Steady, // uiTick advances, but neither position nor identity changed
+		Changing // Position or identity changed since the previous wake-up
+	};
+
+	struct Statistics {
+		uint64_t wakeUps;
+		uint64_t unlinkedWakeUps;
+		uint64_t stalledWakeUps;
+		uint64_t steadyWakeUps;
+		uint64_t changingWakeUps;
+		DWORD currentInterval;
+	};
+
+private:
+	DWORD minInterval;
+	DWORD steadyInterval;
+	DWORD maxInterval;
+	DWORD interval;
+	Statistics stats;
+
+public:
+	TickScheduler();
+
+	void setIntervals(DWORD minInterval, DWORD steadyInterval, DWORD maxInterval);
+
+	/* Registers a wake-up with the given activity and returns the amount of milliseconds to sleep until the next one */
+	DWORD next(Activity activity);
+
+	/* Makes the next wake-up happen as soon as possible, e.g. after Guild Wars 2 has been linked again */
+	void reset() { interval = minInterval; }
+
+	DWORD getInterval() const { return interval; }
+	Statistics getStatistics() const;
+
+};
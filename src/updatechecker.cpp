@@ -11,9 +11,13 @@
 */
 
 #include <algorithm>
-#include <Windows.h>
-#include <WinInet.h>
+#include <time.h>
+#include <vector>
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
 #include "rapidjson/document.h"
+#include "gw2api/gw2api.h"
+#include "gw2api/http.h"
 #include "globals.h"
 #include "stringutils.h"
 #include "updatechecker.h"
@@ -31,43 +35,6 @@ const std::string githubAPI_tagsURL = "https://api.github.com/repos/Archomeda/TS
 const std::string github_releaseURL = "https://github.com/Archomeda/TS3-GW2-plugin/releases/tag/%s";
 
 
-static bool getFromHttpUrl(const string& url, string* result, long unsigned* lastError) {
-	HINTERNET hSession = InternetOpenA("TS3-GW2-plugin", 0, NULL, NULL, 0);
-	if (hSession == NULL) {
-		*lastError = GetLastError();
-		return false;
-	}
-
-	HINTERNET hOpenUrl = InternetOpenUrlA(hSession, url.c_str(), NULL, 0, 1, 1);
-	if (hOpenUrl == NULL) {
-		*lastError = GetLastError();
-		InternetCloseHandle(hOpenUrl);
-		return false;
-	}
-
-	char* buffer = new char[1025];
-	DWORD bytesRead = 0;
-	while (true) {
-		if (InternetReadFile(hOpenUrl, buffer, 1024, &bytesRead)) {
-			if (bytesRead == 0)
-				break;
-			buffer[bytesRead] = 0;
-			*result += buffer;
-		} else {
-			*lastError = GetLastError();
-			delete[] buffer;
-			InternetCloseHandle(hOpenUrl);
-			InternetCloseHandle(hSession);
-			return false;
-		}
-	}
-	delete[] buffer;
-
-	InternetCloseHandle(hOpenUrl);
-	InternetCloseHandle(hSession);
-	return true;
-}
-
 Version::Version(const string& versionString) {
 	major = minor = build = revision = postfixUnstableNumber = 0;
 	this->versionString = versionString;
@@ -101,44 +68,120 @@ bool checkForUpdate(Version& version, string& url) {
 	return checkForUpdate(false, version, url);
 }
 
-bool checkForUpdate(bool includeUnstable, Version& version, string& url) {
-	Version currentVersion = Version(PLUGIN_VERSION);
-	debuglog("GW2Plugin: Current version: %s (%d.%d.%d.%d-%s%d)\n", currentVersion.getVersionString().c_str(), currentVersion.getMajor(), currentVersion.getMinor(),
-		currentVersion.getBuild(), currentVersion.getRevision(), currentVersion.getPostfixUnstable().c_str(), currentVersion.getPostfixUnstableNumber());
+namespace {
+
+	const time_t updateCheckInterval = 3600;
+	const int maxUpdateCheckBackoff = 4; // The interval doubles for every failed check in a row, up to 2^4 times
+
+	// Fetches the names of all tags, or reads them from the config if they haven't changed since the last check
+	bool getTagNames(vector<string>& tagNames) {
+		QSettings cfg(QString::fromStdString(Globals::getConfigFilePath()), QSettings::IniFormat);
+		string etag = cfg.value("updateCheckEtag").toString().toStdString();
+		string headers;
+		if (!etag.empty() && cfg.contains("updateCheckTags"))
+			headers = "If-None-Match: " + etag + "\r\n";
+
+		Gw2Api::Http::Response response;
+		if (!Gw2Api::Http::get(githubAPI_tagsURL, headers, &response, NULL))
+			return false;
+
+		if (response.statusCode == 304 && !headers.empty()) {
+			debuglog("GW2Plugin: Tags haven't changed since the last update check\n");
+			QStringList storedTagNames = cfg.value("updateCheckTags").toStringList();
+			for (int i = 0; i < storedTagNames.size(); i++)
+				tagNames.push_back(storedTagNames[i].toStdString());
+			return true;
+		}
+		if (response.statusCode != 200)
+			return false;
 
-	string data;
-	if (getFromHttpUrl(githubAPI_tagsURL, &data, NULL)) {
 		rapidjson::Document json;
-		json.Parse<0>(data.c_str());
-		if (json.IsArray()) {
-			for (rapidjson::SizeType i = 0; i < json.Size(); i++) {
-				if (json[i].HasMember("name")) {
-					string tagName = json[i]["name"].GetString();
-					if (tagName.compare(0, 1, "v") == 0) {
-						try {
-							Version newVersion = Version(tagName.substr(1, tagName.length() - 1));
-							if (!includeUnstable && !newVersion.getPostfixUnstable().empty())
-								continue;
-
-							debuglog("GW2Plugin: Found version: %s (%d.%d.%d.%d-%s%d)\n", newVersion.getVersionString().c_str(), newVersion.getMajor(), newVersion.getMinor(),
-								newVersion.getBuild(), newVersion.getRevision(), newVersion.getPostfixUnstable().c_str(), newVersion.getPostfixUnstableNumber());
-							if (newVersion > currentVersion) {
-								version = newVersion;
-								char urlRelease[128];
-								sprintf_s(urlRelease, github_releaseURL.c_str(), tagName.c_str());
-								url = string(urlRelease);
-								debuglog("GW2Plugin: Newer version is available: %s\n", urlRelease);
-								return true;
-							} else {
-								debuglog("GW2Plugin: No newer version is available\n");
-								return false;
-							}
-						} catch (...) { }
+		json.Parse<0>(response.body.c_str());
+		if (!json.IsArray())
+			return false;
+		QStringList storedTagNames;
+		for (rapidjson::SizeType i = 0; i < json.Size(); i++) {
+			if (json[i].IsObject() && json[i].HasMember("name") && json[i]["name"].IsString()) {
+				tagNames.push_back(json[i]["name"].GetString());
+				storedTagNames.append(QString::fromStdString(tagNames.back()));
+			}
+		}
+		cfg.setValue("updateCheckEtag", QString::fromStdString(response.etag));
+		cfg.setValue("updateCheckTags", storedTagNames);
+		return true;
+	}
+
+	// Remembers the time of every attempt, not only of the successful ones, so a failing check isn't retried on every reconnect
+	bool isUpdateCheckDue() {
+		QSettings cfg(QString::fromStdString(Globals::getConfigFilePath()), QSettings::IniFormat);
+		time_t now = time(NULL);
+		time_t lastCheck = (time_t)cfg.value("updateCheckLastTime", 0).toLongLong();
+		int failures = min(cfg.value("updateCheckFailures", 0).toInt(), maxUpdateCheckBackoff);
+		if (lastCheck <= now && difftime(now, lastCheck) < updateCheckInterval << failures)
+			return false;
+		cfg.setValue("updateCheckLastTime", (qlonglong)now);
+		return true;
+	}
+
+	void setUpdateCheckFailed(bool failed) {
+		QSettings cfg(QString::fromStdString(Globals::getConfigFilePath()), QSettings::IniFormat);
+		cfg.setValue("updateCheckFailures", failed ? cfg.value("updateCheckFailures", 0).toInt() + 1 : 0);
+	}
+
+	bool findUpdate(bool includeUnstable, const vector<string>& tagNames, Version& version, string& url) {
+		Version currentVersion = Version(PLUGIN_VERSION);
+		debuglog("GW2Plugin: Current version: %s (%d.%d.%d.%d-%s%d)\n", currentVersion.getVersionString().c_str(), currentVersion.getMajor(), currentVersion.getMinor(),
+			currentVersion.getBuild(), currentVersion.getRevision(), currentVersion.getPostfixUnstable().c_str(), currentVersion.getPostfixUnstableNumber());
+
+		for (size_t i = 0; i < tagNames.size(); i++) {
+			const string& tagName = tagNames[i];
+			if (tagName.compare(0, 1, "v") == 0) {
+				try {
+					Version newVersion = Version(tagName.substr(1, tagName.length() - 1));
+					if (!includeUnstable && !newVersion.getPostfixUnstable().empty())
+						continue;
+
+					debuglog("GW2Plugin: Found version: %s (%d.%d.%d.%d-%s%d)\n", newVersion.getVersionString().c_str(), newVersion.getMajor(), newVersion.getMinor(),
+						newVersion.getBuild(), newVersion.getRevision(), newVersion.getPostfixUnstable().c_str(), newVersion.getPostfixUnstableNumber());
+					if (newVersion > currentVersion) {
+						version = newVersion;
+						char urlRelease[128];
+						sprintf_s(urlRelease, github_releaseURL.c_str(), tagName.c_str());
+						url = string(urlRelease);
+						debuglog("GW2Plugin: Newer version is available: %s\n", urlRelease);
+						return true;
+					} else {
+						debuglog("GW2Plugin: No newer version is available\n");
+						return false;
 					}
-				}
+				} catch (...) { }
 			}
 		}
+		debuglog("GW2Plugin: No newer version is available\n");
+		return false;
 	}
-	debuglog("GW2Plugin: No newer version is available\n");
-	return false;
+
+}
+
+bool checkForUpdate(bool includeUnstable, Version& version, string& url) {
+	vector<string> tagNames;
+	if (!getTagNames(tagNames))
+		return false;
+	return findUpdate(includeUnstable, tagNames, version, url);
+}
+
+bool queueUpdateCheck(bool includeUnstable, const UpdateCallback& onUpdateAvailable) {
+	return Gw2Api::Async::enqueue("updatecheck", [=]() -> bool {
+		if (!isUpdateCheckDue())
+			return true;
+
+		vector<string> tagNames;
+		bool success = getTagNames(tagNames);
+		setUpdateCheckFailed(!success);
+		Version version;
+		string url;
+		if (success && findUpdate(includeUnstable, tagNames, version, url) && onUpdateAvailable)
+			onUpdateAvailable(version, url);
+		return success;
+	}, Gw2Api::Async::Callback());
 }
@@ -11,6 +11,7 @@
 */
 
 #pragma once
+#include <functional>
 #include <string>
 
 class Version {
@@ -56,5 +57,18 @@ public:
 
 
 bool checkForUpdate(Version& version, std::string& url);
+/*
+ * Asks GitHub for the tags with the ETag of the previous answer, so an unchanged tag list costs a 304 without a body.
+ * The ETag and tag names are kept in the config file, so that holds across restarts as well.
+ */
 bool checkForUpdate(bool includeUnstable, Version& version, std::string& url);
 
+typedef std::function<void (Version version, const std::string& url)> UpdateCallback;
+
+/*
+ * Runs checkForUpdate on the Gw2Api::Async workers, unless the last check (of this or an earlier session) was less than an hour ago.
+ * Failed checks back off up to 16 hours. Calls while a check is queued or running join that one, so reconnects never pile up checks.
+ * onUpdateAvailable is called on the worker thread. Returns false if the check couldn't be queued.
+ */
+bool queueUpdateCheck(bool includeUnstable, const UpdateCallback& onUpdateAvailable);
+
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+"""
+Generates src/gw2api/embeddedtables.cpp (see src/gw2api/embeddeddata.h) from a response of the v1 API:
+
+    curl -o world_names.json https://api.guildwars2.com/v1/world_names.json
+    python tools/generate_embedded_data.py --worlds world_names.json
+
+Without any input the table is empty, and the plugin downloads the world names like before.
+"""
+
+import argparse
+import calendar
+import datetime
+import json
+import os
+
+OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "gw2api", "embeddedtables.cpp")
+
+HEADER = """/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+// Generated by tools/generate_embedded_data.py, don't edit
+
+#include "embeddeddata.h"
+
+namespace Gw2Api {
+
+	namespace EmbeddedData {
+
+"""
+
+FOOTER = """
+	}
+
+}
+"""
+
+
+class NamePool:
+    """Zero-terminated strings, each distinct one only once; offset 0 is the empty string"""
+
+    def __init__(self):
+        self.offsets = {"": 0}
+        self.names = [""]
+        self.size = 1
+
+    def add(self, name):
+        if name not in self.offsets:
+            self.offsets[name] = self.size
+            self.names.append(name)
+            self.size += len(name.encode("utf-8")) + 1
+        return self.offsets[name]
+
+
+def c_string(text):
+    # Octal escapes, since hex escapes would swallow following hex digits
+    result = ""
+    for byte in text.encode("utf-8"):
+        char = chr(byte)
+        if char in "\\\"":
+            result += "\\" + char
+        elif 32 <= byte < 127:
+            result += char
+        else:
+            result += "\\%03o" % byte
+    return '"' + result + '"'
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generates the embedded world table of the plugin")
+    parser.add_argument("--worlds", help="world_names.json of the v1 API")
+    parser.add_argument("--output", default=OUTPUT)
+    args = parser.parse_args()
+
+    pool = NamePool()
+    worlds = []
+
+    if args.worlds:
+        with open(args.worlds, encoding="utf-8") as f:
+            for world in json.load(f):
+                worlds.append((int(world["id"]), pool.add(world["name"])))
+        worlds.sort()
+
+    generated_from = ""
+    generated_time = 0
+    if worlds:
+        now = datetime.datetime.utcnow()
+        generated_from = "world_names.json of " + now.date().isoformat()
+        generated_time = calendar.timegm(now.utctimetuple())
+
+    lines = [HEADER]
+    lines.append("\t\tconst char* const generatedFrom = %s;\n" % c_string(generated_from))
+    lines.append("\t\tconst time_t generatedTime = %d;\n\n" % generated_time)
+    # Adjacent literals are concatenated and every entry adds its own terminator, the pool ends with an extra one
+    lines.append("\t\tconst char namePool[] =\n")
+    for name in pool.names:
+        lines.append("\t\t\t%s \"\\0\"\n" % c_string(name))
+    lines.append("\t\t\t;\n\n")
+    # Arrays can't be empty, so the empty table gets one unused record
+    lines.append("\t\tconst WorldRecord worlds[] = {\n")
+    for world in worlds:
+        lines.append("\t\t\t{ %d, %d },\n" % world)
+    if not worlds:
+        lines.append("\t\t\t{ 0, 0 }\n")
+    lines.append("\t\t};\n")
+    lines.append("\t\tconst size_t worldCount = %d;\n" % len(worlds))
+    lines.append(FOOTER)
+
+    with open(args.output, "w", encoding="utf-8", newline="\n") as f:
+        f.write("".join(lines))
+
+
+if __name__ == "__main__":
+    main()